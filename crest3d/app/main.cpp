@@ -3,8 +3,30 @@
 #include "EditorPrototyping.h"
 
 static void window_size_callback(GLFWwindow* window, int width, int height);
-
-int main() {
+static int runHeadless(EngineManager* engineManager, EditorPrototyping& example, Pipeline& pipeline, int numFrames, const std::string& profilePath);
+
+int main(int argc, char** argv) {
+
+	// --headless [--frames N] [--profile out.csv] renders without a window or editor and exits, for perf runs on CI
+	bool headless = false;
+	int headlessFrames = 500;
+	std::string profilePath;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--headless")
+		{
+			headless = true;
+		}
+		else if (arg == "--frames" && i + 1 < argc)
+		{
+			headlessFrames = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--profile" && i + 1 < argc)
+		{
+			profilePath = argv[++i];
+		}
+	}
 
 	float deltaTime = 0.0;
 	float lastFrame = 0.0;
@@ -16,7 +38,7 @@ int main() {
 	char infoLog[512];
 
 
-	EngineManager* engineManager = new EngineManager();
+	EngineManager* engineManager = new EngineManager(headless);
 	EditorPrototyping example(engineManager);
 	engineManager->initialiseExample(&example);
 
@@ -26,14 +48,18 @@ int main() {
 	// Setup Dear ImGui context
 	ImGui::CreateContext();
 	ImGuiIO& io = ImGui::GetIO(); (void)io;
-	auto normal_font = io.Fonts->AddFontFromFileTTF("res/font/Rubik-Light.ttf", 13.0f);
-	auto text_editor_font = io.Fonts->AddFontFromFileTTF("res/font/Cascadia.ttf", 16.0f);
-	
-	io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;           // Enable Docking
-	
-	//// Setup Platform/Renderer bindings
-	ImGui_ImplGlfw_InitForOpenGL(engineManager->window, false);
-	ImGui_ImplOpenGL3_Init("#version 440");
+	ImFont* text_editor_font = nullptr;
+	if (!headless)
+	{
+		auto normal_font = io.Fonts->AddFontFromFileTTF("res/font/Rubik-Light.ttf", 13.0f);
+		text_editor_font = io.Fonts->AddFontFromFileTTF("res/font/Cascadia.ttf", 16.0f);
+
+		io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;           // Enable Docking
+
+		//// Setup Platform/Renderer bindings
+		ImGui_ImplGlfw_InitForOpenGL(engineManager->window, false);
+		ImGui_ImplOpenGL3_Init("#version 440");
+	}
 	
 #define SOL_NO_EXCEPTIONS
 
@@ -46,26 +72,95 @@ int main() {
 	Shader fbShader("res/shaders/framebuffer.vert", "res/shaders/framebuffer.frag");
 	// Quad we use to render framebuffers
 	screenQuad renderQuad;
-	// Initialise buffers (uniform resolution for now)
-	FrameBuffer mainFB;
-	mainFB.initialise(CREST_WINDOW_WIDTH, CREST_WINDOW_HEIGHT, true);
-	FrameBuffer depthFB;
-	depthFB.initialise(CREST_WINDOW_WIDTH, CREST_WINDOW_HEIGHT, false);
-	FrameBuffer volumetricFB;
-	volumetricFB.initialise(CREST_WINDOW_WIDTH, CREST_WINDOW_HEIGHT, false);
-	FrameBuffer blurFB;
-	blurFB.initialise(CREST_WINDOW_WIDTH, CREST_WINDOW_HEIGHT, false);
-	FrameBuffer finalFB;
-	finalFB.initialise(CREST_WINDOW_WIDTH, CREST_WINDOW_HEIGHT, false);
+	// Post processing chain, framebuffers are pooled and aliased by the pipeline
+	glm::vec2 blurScale = glm::vec2(0.002);
+	Pipeline pipeline;
+	pipeline.addTarget("scene", true);
+	// scene resolution follows the gpu budget, the final pass upscales back to full size
+	DynamicResolution dynamicResolution;
+	// screenshots, frame captures and picking without stalling on glReadPixels
+	AsyncReadback readback;
+	int captureFrames = 60;
+	pipeline.addPass("Scene", nullptr, {}, "scene", [&](Pipeline& p) {
+		glEnable(GL_DEPTH_TEST);
+		glCullFace(GL_BACK);
+		// draw everything in the scene
+		example.renderBehaviour(deltaTime);
+		glDisable(GL_DEPTH_TEST);
+	});
+	// entity ids, only drawn on the frame after a ctrl + click asks for it
+	pipeline.addPass("Picking", nullptr, {}, "picking", [&](Pipeline& p) {
+		if (engineManager->scene == nullptr)
+		{
+			return;
+		}
+		glEnable(GL_DEPTH_TEST);
+		engineManager->scene->renderPicking();
+		glDisable(GL_DEPTH_TEST);
+	});
+	// where in the scene window the pick was, 0 - 1 from the bottom left
+	bool pickRequested = false;
+	glm::vec2 pickUV = glm::vec2(0.0f);
+	pipeline.addPass("Depth Visualisation", &depthShader, { "scene" }, "depth", [&](Pipeline& p) {
+		depthShader.use();
+		depthShader.setVec2("uvScale", p.GetUVScale("scene"));
+		renderQuad.Draw(depthShader, "screenTexture", p.GetDepthTexture("scene"));
+	});
+	pipeline.addPass("Volumetrics", &volumetricShader, { "scene" }, "volumetric", [&](Pipeline& p) {
+		volumetricShader.use();
+		if (engineManager->scene != nullptr && engineManager->scene->dirLightComponent != nullptr)
+		{
+			volumetricShader.setMat4("viewMatrix", engineManager->scene->sceneCamera->GetViewMatrix());
+			volumetricShader.setVec3("lightDir", engineManager->scene->dirLightComponent->direction);
+		}
+		volumetricShader.setVec2("uvScale", p.GetUVScale("scene"));
+		renderQuad.Draw(volumetricShader, "screenTexture", p.GetTexture("scene"));
+	});
+	pipeline.addPass("Blur", &blurShader, { "volumetric" }, "blur", [&](Pipeline& p) {
+		blurShader.use();
+		blurShader.setVec2("scale", blurScale);
+		renderQuad.Draw(blurShader, "screenTexture", p.GetTexture("volumetric"));
+	});
+	pipeline.addPass("Final", &fbShader, { "scene" }, "final", [&](Pipeline& p) {
+		fbShader.use();
+		fbShader.setFloat("exposure", exposure);
+		fbShader.setFloat("gamma", gamma);
+		fbShader.setVec2("uvScale", p.GetUVScale("scene"));
+		renderQuad.Draw(fbShader, "screenTexture", p.GetTexture("scene"));
+	});
+	// the editor always shows these, depth and blur are only kept while their windows are visible
+	pipeline.markOutput("scene");
+	pipeline.markOutput("final");
 
 	example.startBehaviour();
+	// every startup program has been built by now
+	ShaderCache::ReportStats();
+
+	// both the editor and headless runs leave through here
+	auto teardown = [&]() {
+		// gl objects have to go before the context does, the destructors run after glfwTerminate
+		readback.release();
+		pipeline.release();
+		// joins the job workers, the static thread list can't be destroyed while they're joinable
+		engineManager->shutdown();
+		glfwTerminate();
+		YSE::System().close();
+	};
+
+	if (headless)
+	{
+		int result = runHeadless(engineManager, example, pipeline, headlessFrames, profilePath);
+		teardown();
+		return result;
+	}
 
 	float lastWindowWidth = 0.0;
 	float lastWindowHeight = 0.0;
+	// whether the depth and blur windows were visible last frame, which decides if their targets are drawn
+	bool depthVisible = false;
+	bool blurVisible = false;
 
 	int vsync = 1;
-	
-	glm::vec2 blurScale = glm::vec2(0.002);
 
 	// TEXT EDITOR SAMPLE
 	TextEditor editor;
@@ -94,6 +189,7 @@ int main() {
 
 	bool shouldRun = true;
 	while (!glfwWindowShouldClose(engineManager->window)) {
+		Profiler::BeginFrame();
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
 
@@ -111,43 +207,63 @@ int main() {
 		int eventCounter = 0;
 
 
+		Profiler::BeginScope("Update", false);
 		engineManager->update();
 
-		//Render scene normally
-		glCullFace(GL_BACK);
-
-		mainFB.initForDrawing();
 		// perform scene pre-render stuff
 		example.earlyUpdateBehaviour(deltaTime);
 		// main game loop update
 		example.updateBehaviour(deltaTime);
-		// draw everything in the scene
-		example.renderBehaviour(deltaTime);
-		
-		mainFB.finishDrawing();
+		Profiler::EndScope();
 
-		glDisable(GL_DEPTH_TEST);
 		glDepthFunc(GL_LESS);
-
-		depthFB.initForDrawing();
-		depthShader.use();
-		renderQuad.Draw(depthShader, "screenTexture", mainFB.GetDepthTexture());
-		depthFB.finishDrawing();
-		
-		finalFB.initForDrawing();
-		fbShader.use();
-		fbShader.setFloat("exposure", exposure);
-		fbShader.setFloat("gamma", gamma);
-		glActiveTexture(GL_TEXTURE1);
-
-		glBindTexture(GL_TEXTURE_2D, blurFB.GetTexture());
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		renderQuad.Draw(fbShader, "screenTexture", mainFB.GetTexture());
-		finalFB.finishDrawing();
-
-		
-
+		dynamicResolution.update(Profiler::GetGPUTime("Pipeline"));
+		pipeline.setTargetScale("scene", dynamicResolution.GetScale());
+		// outputs are settled before execute, a window only shows its target once it has been drawn
+		if (depthVisible)
+		{
+			pipeline.markOutput("depth");
+		}
+		else
+		{
+			pipeline.unmarkOutput("depth");
+		}
+		if (blurVisible)
+		{
+			pipeline.markOutput("blur");
+		}
+		else
+		{
+			pipeline.unmarkOutput("blur");
+		}
+		Profiler::BeginScope("Pipeline");
+		pipeline.execute();
+		Profiler::EndScope();
+		if (pickRequested)
+		{
+			// the picking target was drawn by this execute, read the id under the cursor and stop drawing it
+			FrameBuffer* pickingFB = pipeline.GetFrameBuffer("picking");
+			int px = pickUV.x * pickingFB->GetRenderWidth();
+			int py = pickUV.y * pickingFB->GetRenderHeight();
+			readback.request(pickingFB, false, px, py, 1, 1, [&, px, py](ReadbackResult& result) {
+				unsigned int value = result.GetID(0, 0);
+				std::shared_ptr<Entity> picked = value != 0 && engineManager->scene != nullptr ? engineManager->scene->FindEntity(value - 1) : nullptr;
+				std::stringstream s;
+				s << "Picked (" << px << ", " << py << ") ";
+				if (picked != nullptr)
+				{
+					s << picked->name << " (" << value - 1 << ")";
+				}
+				else
+				{
+					s << "nothing";
+				}
+				Debug::Log(s.str().c_str());
+			});
+			pipeline.unmarkOutput("picking");
+			pickRequested = false;
+		}
+		readback.update();
 		glEnable(GL_DEPTH_TEST);
 
 		// docking stuff
@@ -176,20 +292,25 @@ int main() {
 			float dWidth = ImGui::GetWindowWidth();
 			float dHeight = ImGui::GetWindowHeight();
 			if (dHeight != lastWindowHeight || dWidth != lastWindowWidth){
-				mainFB.changeScreenSize(dWidth, dHeight);
-				volumetricFB.changeScreenSize(dWidth, dHeight);
-				blurFB.changeScreenSize(dWidth, dHeight);
-				depthFB.changeScreenSize(dWidth, dHeight);
-				finalFB.changeScreenSize(dWidth, dHeight);
+				pipeline.resize(dWidth, dHeight);
 				glViewport(0, 0, dWidth, dHeight);
 				if (engineManager->scene != nullptr){
 					engineManager->scene->sceneCamera->updateProjection(75.0f, dWidth, dHeight);
 				}
 			}
 
+			glm::vec2 sceneUV = pipeline.GetUVScale("scene");
+			// ctrl + click draws the picking target next frame and reads back the entity under the cursor
+			if (ImGui::IsWindowHovered() && ImGui::IsMouseClicked(0) && ImGui::GetIO().KeyCtrl)
+			{
+				ImVec2 mouse = ImGui::GetMousePos();
+				pickUV = glm::vec2((mouse.x - pos.x) / dWidth, 1.0f - (mouse.y - pos.y) / dHeight);
+				pickRequested = true;
+				pipeline.markOutput("picking");
+			}
 			ImGui::GetWindowDrawList()->AddImage(
-				(void*)mainFB.GetTexture(), ImVec2(ImGui::GetCursorScreenPos()),
-				ImVec2(ImGui::GetCursorScreenPos().x + ImGui::GetWindowWidth(), ImGui::GetCursorScreenPos().y + ImGui::GetWindowHeight()), ImVec2(0, 1), ImVec2(1, 0));
+				(void*)pipeline.GetTexture("scene"), ImVec2(ImGui::GetCursorScreenPos()),
+				ImVec2(ImGui::GetCursorScreenPos().x + ImGui::GetWindowWidth(), ImGui::GetCursorScreenPos().y + ImGui::GetWindowHeight()), ImVec2(0, sceneUV.y), ImVec2(sceneUV.x, 0));
 
 			lastWindowWidth = dWidth;
 			lastWindowHeight = dHeight;
@@ -197,7 +318,9 @@ int main() {
 		ImGui::End();
 		
 		ImGui::SetNextWindowDockID(dockspaceID, ImGuiCond_FirstUseEver);
-		if (ImGui::Begin("Depth Window", NULL, ImVec2(0, 0)))
+		bool depthDrawn = depthVisible;
+		depthVisible = ImGui::Begin("Depth Window", NULL, ImVec2(0, 0));
+		if (depthVisible)
 		{
 			if(ImGui::IsWindowFocused())
 			{
@@ -208,14 +331,19 @@ int main() {
 				ImGui::Text("Not focussed on this window");
 			}
 			
-			ImGui::GetWindowDrawList()->AddImage(
-				(void*)depthFB.GetTexture(), ImVec2(ImGui::GetCursorScreenPos()),
-				ImVec2(ImGui::GetCursorScreenPos().x + ImGui::GetWindowWidth(), ImGui::GetCursorScreenPos().y + ImGui::GetWindowHeight()), ImVec2(0, 1), ImVec2(1, 0));
+			if (depthDrawn)
+			{
+				ImGui::GetWindowDrawList()->AddImage(
+					(void*)pipeline.GetTexture("depth"), ImVec2(ImGui::GetCursorScreenPos()),
+					ImVec2(ImGui::GetCursorScreenPos().x + ImGui::GetWindowWidth(), ImGui::GetCursorScreenPos().y + ImGui::GetWindowHeight()), ImVec2(0, 1), ImVec2(1, 0));
+			}
 		}
 		ImGui::End();
 
 		ImGui::SetNextWindowDockID(dockspaceID, ImGuiCond_FirstUseEver);
-		if (ImGui::Begin("Volumetrics Blurred Window", NULL, ImVec2(0, 0)))
+		bool blurDrawn = blurVisible;
+		blurVisible = ImGui::Begin("Volumetrics Blurred Window", NULL, ImVec2(0, 0));
+		if (blurVisible)
 		{
 			if (ImGui::IsWindowFocused())
 			{
@@ -226,9 +354,12 @@ int main() {
 				ImGui::Text("Not focussed on this window");
 			}
 
-			ImGui::GetWindowDrawList()->AddImage(
-				(void*)blurFB.GetTexture(), ImVec2(ImGui::GetCursorScreenPos()),
-				ImVec2(ImGui::GetCursorScreenPos().x + ImGui::GetWindowWidth(), ImGui::GetCursorScreenPos().y + ImGui::GetWindowHeight()), ImVec2(0, 1), ImVec2(1, 0));
+			if (blurDrawn)
+			{
+				ImGui::GetWindowDrawList()->AddImage(
+					(void*)pipeline.GetTexture("blur"), ImVec2(ImGui::GetCursorScreenPos()),
+					ImVec2(ImGui::GetCursorScreenPos().x + ImGui::GetWindowWidth(), ImGui::GetCursorScreenPos().y + ImGui::GetWindowHeight()), ImVec2(0, 1), ImVec2(1, 0));
+			}
 		}
 		ImGui::End();
 		
@@ -244,7 +375,7 @@ int main() {
 				ImGui::Text("Not focussed on this window");
 			}
 			ImGui::GetWindowDrawList()->AddImage(
-				(void*)finalFB.GetTexture(), ImVec2(ImGui::GetCursorScreenPos()),
+				(void*)pipeline.GetTexture("final"), ImVec2(ImGui::GetCursorScreenPos()),
 				ImVec2(ImGui::GetCursorScreenPos().x + ImGui::GetWindowWidth(), ImGui::GetCursorScreenPos().y + ImGui::GetWindowHeight()), ImVec2(0, 1), ImVec2(1, 0));
 		}
 		ImGui::End();
@@ -295,12 +426,60 @@ int main() {
 			}
 			
 			ImGui::Auto(blurScale, "Blue Scale");
+
+			dynamicResolution.ui();
+			ShaderCache::ui();
+			engineManager->shaderManager->ui();
+			engineManager->materialLibrary->ui();
+
+			const char* renderPaths[] = { "Forward", "Deferred" };
+			int renderPath = engineManager->scene->renderPath;
+			if (ImGui::Combo("Render Path", &renderPath, renderPaths, 2))
+			{
+				engineManager->scene->renderPath = (RenderPath)renderPath;
+			}
+			engineManager->scene->GetLightAssignment().ui();
+			engineManager->scene->GetParticleBudget().ui();
+			ImGui::Checkbox("Order Independent Transparency", &engineManager->scene->orderIndependentTransparency);
+			if (engineManager->scene->orderIndependentTransparency)
+			{
+				engineManager->renderer->GetTransparency()->ui();
+			}
+			if (engineManager->scene->renderPath == RENDER_DEFERRED)
+			{
+				engineManager->renderer->GetDeferred()->ui();
+			}
+			std::shared_ptr<DirectionalLightComponent> dirLight = engineManager->scene->dirLightComponent;
+			if (dirLight != nullptr)
+			{
+				ImGui::Checkbox("Shadows", &dirLight->castShadows);
+				if (dirLight->castShadows)
+				{
+					dirLight->GetShadows()->ui();
+				}
+			}
+
+			if (ImGui::Button("Screenshot"))
+			{
+				std::string path = "screenshot_" + std::to_string(time(nullptr)) + ".tga";
+				readback.screenshot(pipeline.GetFrameBuffer("final"), path);
+			}
+			ImGui::InputInt("Capture Frames", &captureFrames);
+			if (!readback.IsCapturing() && ImGui::Button("Capture"))
+			{
+				readback.startCapture(pipeline.GetFrameBuffer("final"), std::max(captureFrames, 1), "capture");
+			}
+			readback.ui();
+			pipeline.ui();
 		}
 		ImGui::End();
 		
 		ImGui::SetNextWindowDockID(dockspaceID, ImGuiCond_FirstUseEver);
 		Debug::DrawConsole();
 
+		ImGui::SetNextWindowDockID(dockspaceID, ImGuiCond_FirstUseEver);
+		Profiler::DrawWindow();
+
 		ImGui::PushFont(text_editor_font);
 
 		// TEXT EDITOR SAMPLE RENDER
@@ -412,13 +591,81 @@ int main() {
 		YSE::System().update();
 
 		// Rendering
+		Profiler::BeginScope("Editor UI");
 		ImGui::Render();
 		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		Profiler::EndScope();
+		Profiler::EndFrame();
 		glfwPollEvents();
 		glfwSwapBuffers(engineManager->window);
 	}
 
-	glfwTerminate();
-	YSE::System().close();	
+	teardown();
 }
 
+static int runHeadless(EngineManager* engineManager, EditorPrototyping& example, Pipeline& pipeline, int numFrames, const std::string& profilePath)
+{
+	// fixed timestep so every run simulates the same frames
+	const float deltaTime = 1.0f / 60.0f;
+
+	pipeline.resize(CREST_WINDOW_WIDTH, CREST_WINDOW_HEIGHT);
+	if (engineManager->scene != nullptr)
+	{
+		engineManager->scene->sceneCamera->updateProjection(75.0f, CREST_WINDOW_WIDTH, CREST_WINDOW_HEIGHT);
+	}
+
+	std::vector<float> cpuTimes, gpuTimes;
+	cpuTimes.reserve(numFrames);
+	gpuTimes.reserve(numFrames);
+
+	std::cout << "Running " << numFrames << " headless frames at " << CREST_WINDOW_WIDTH << "x" << CREST_WINDOW_HEIGHT << std::endl;
+	for (int frame = 0; frame < numFrames; frame++)
+	{
+		Profiler::BeginFrame();
+
+		Profiler::BeginScope("Update", false);
+		engineManager->update();
+		example.earlyUpdateBehaviour(deltaTime);
+		example.updateBehaviour(deltaTime);
+		Profiler::EndScope();
+
+		glDepthFunc(GL_LESS);
+		Profiler::BeginScope("Pipeline");
+		pipeline.execute();
+		Profiler::EndScope();
+		glEnable(GL_DEPTH_TEST);
+
+		Profiler::EndFrame();
+		glfwPollEvents();
+		glfwSwapBuffers(engineManager->window);
+
+		// results lag a few frames behind, the first couple of frames have none
+		float cpu = Profiler::GetCPUTime("Frame");
+		float gpu = Profiler::GetGPUTime("Pipeline");
+		if (cpu >= 0.0f) { cpuTimes.emplace_back(cpu); }
+		if (gpu >= 0.0f) { gpuTimes.emplace_back(gpu); }
+	}
+	glFinish();
+
+	auto report = [](const char* label, std::vector<float>& times) {
+		if (times.empty())
+		{
+			std::cout << label << ": no samples" << std::endl;
+			return;
+		}
+		std::sort(times.begin(), times.end());
+		double total = 0.0;
+		for (float t : times) { total += t; }
+		printf("%s: avg %.3f ms, min %.3f ms, p95 %.3f ms, max %.3f ms (%u samples)\n", label, total / times.size(),
+			times.front(), times[(size_t)((times.size() - 1) * 0.95)], times.back(), (unsigned int)times.size());
+	};
+	report("CPU frame", cpuTimes);
+	report("GPU pipeline", gpuTimes);
+	Profiler::PrintSummary(std::cout);
+
+	if (!profilePath.empty() && !Profiler::ExportCSV(profilePath))
+	{
+		return 1;
+	}
+	return 0;
+}
@@ -7,7 +7,19 @@
 #include "gfx/AnimatedModel.h"
 #include "gfx/Cubemap.h"
 #include "gfx/FrameBuffer.h"
+#include "gfx/DynamicResolution.h"
+#include "gfx/AsyncReadback.h"
+#include "gfx/ShaderCache.h"
+#include "gfx/SamplerCache.h"
+#include "gfx/DeferredRenderer.h"
+#include "gfx/TransparencyRenderer.h"
+#include "gfx/DepthHistory.h"
+#include "gfx/LightAssignment.h"
+#include "gfx/CascadedShadowMap.h"
+#include "gfx/ParticleEmitter.h"
 #include "gfx/ParticleSystem.h"
+#include "gfx/GPUParticleSystem.h"
+#include "gfx/ParticleBudget.h"
 #include "primitives/Quad.h"
 #include "primitives/Cube.h"
 #include "PhysicsManager.h"
@@ -17,6 +29,8 @@
 //
 #include "Entity.h"
 #include "Debug.h"
+#include "Profiler.h"
+#include "JobSystem.h"
 #include "serialization/Serializer.hpp"
 
 // Components
@@ -1,14 +1,24 @@
 #include "EngineManager.h"
 #include "Example.h"
+#include "JobSystem.h"
+#include "Profiler.h"
 #include "glm/gtx/range.hpp"
 
-EngineManager::EngineManager()
+EngineManager::EngineManager(bool _headless)
 {
-	initialise(800, 600);
+	headless = _headless;
+	// nothing after this works without a context, better to say why now than crash in the first gl call
+	if (initialise(800, 600) < 0)
+	{
+		std::cout << "Couldn't create an OpenGL context, exiting" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	JobSystem::Init();
 	renderer = std::make_unique<Renderer>();
 	physicsManager = std::make_unique<PhysicsManager>();
 	assetManager = std::make_unique<AssetManager>();
-	shaderManager = std::make_unique<ShaderManager>();
+	shaderManager = std::make_unique<ShaderManager>(window);
+	materialLibrary = std::make_unique<MaterialLibrary>(shaderManager->meshVariants.get(), assetManager.get());
 	scene = std::shared_ptr<Scene>(new Scene("debugScene", this));
 	input = std::unique_ptr<InputManager>(new InputManager(window));
 	debug = std::make_unique<Debug>();
@@ -22,29 +32,76 @@ void EngineManager::InitImgui()
 
 int EngineManager::initialise(int screenWidth, int screenHeight)
 {
-	glfwInit();
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-	window = glfwCreateWindow(1024, 600, "LearnOpenGL", NULL, NULL);
-	if (window == NULL)
+	if (glfwInit() != GLFW_TRUE)
 	{
-		std::cout << "Failed to create GLFW window" << std::endl;
-		glfwTerminate();
+		const char* description = nullptr;
+		glfwGetError(&description);
+		std::cout << "Failed to initialise GLFW: " << (description != nullptr ? description : "unknown error") << std::endl;
 		return -1;
 	}
-	glfwMakeContextCurrent(window);
-	glewExperimental = GL_TRUE;
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-	if (GLEW_OK != glewInit())
+	if (headless)
 	{
-		std::cout << "Failed to initalise GLEW \n";
-		return -1;
+		// never shown, so rendering goes to framebuffers only. this is still a hidden glfw window, see the
+		// README for what a machine without a display needs. the native api is tried first since that's what
+		// our GLEW build loads through, EGL and OSMesa only help with a GLEW that can load from them
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		const int contextApis[3] = { GLFW_NATIVE_CONTEXT_API, GLFW_EGL_CONTEXT_API, GLFW_OSMESA_CONTEXT_API };
+		const char* contextNames[3] = { "native", "EGL", "OSMesa" };
+		window = NULL;
+		for (int i = 0; i < 3 && window == NULL; i++)
+		{
+			glfwWindowHint(GLFW_CONTEXT_CREATION_API, contextApis[i]);
+			window = glfwCreateWindow(CREST_WINDOW_WIDTH, CREST_WINDOW_HEIGHT, "crest3d (headless)", NULL, NULL);
+			if (window == NULL)
+			{
+				continue;
+			}
+			// a context is only any use if GLEW can load the functions from it
+			glfwMakeContextCurrent(window);
+			glewExperimental = GL_TRUE;
+			GLenum result = glewInit();
+			if (result != GLEW_OK)
+			{
+				std::cout << "Headless " << contextNames[i] << " context can't load GL: " << glewGetErrorString(result) << std::endl;
+				glfwMakeContextCurrent(NULL);
+				glfwDestroyWindow(window);
+				window = NULL;
+				continue;
+			}
+			std::cout << "Created headless " << contextNames[i] << " context" << std::endl;
+		}
+		if (window == NULL)
+		{
+			std::cout << "Failed to create a headless context" << std::endl;
+			glfwTerminate();
+			return -1;
+		}
 	}
 	else
 	{
-		std::cout << "Successfully initialised GLEW \n";
+		window = glfwCreateWindow(1024, 600, "LearnOpenGL", NULL, NULL);
+		if (window == NULL)
+		{
+			std::cout << "Failed to create GLFW window" << std::endl;
+			glfwTerminate();
+			return -1;
+		}
+		glfwMakeContextCurrent(window);
+		glewExperimental = GL_TRUE;
+
+		if (GLEW_OK != glewInit())
+		{
+			std::cout << "Failed to initalise GLEW \n";
+			return -1;
+		}
+		else
+		{
+			std::cout << "Successfully initialised GLEW \n";
+		}
 	}
 	//Enable depth
 	glEnable(GL_DEPTH_TEST);
@@ -61,6 +118,7 @@ int EngineManager::initialise(int screenWidth, int screenHeight)
 void EngineManager::update()
 {
 	input->GetMouseMovement();
+	shaderManager->update();
 }
 
 void window_size_callback(GLFWwindow* window, int width, int height)
@@ -455,5 +513,6 @@ void EngineManager::AttachComponentToEntity(unsigned entityID, EngineComponent*
 
 void EngineManager::shutdown()
 {
-	
+	JobSystem::Shutdown();
+	Profiler::Shutdown();
 }
@@ -18,7 +18,7 @@ class EngineManager
 {
 public:
 
-	EngineManager();
+	EngineManager(bool _headless = false);
 	~EngineManager();
 
 	int initialise(int screenWidth, int screenHeight);
@@ -30,6 +30,7 @@ public:
 	std::unique_ptr<ShaderManager> shaderManager;
 	std::unique_ptr<PhysicsManager> physicsManager;
 	std::unique_ptr<AssetManager> assetManager;
+	std::unique_ptr<MaterialLibrary> materialLibrary;
 	std::shared_ptr<Scene> scene;
 	std::shared_ptr<InputManager> input;
 	std::unique_ptr<Example> example;
@@ -38,6 +39,8 @@ public:
 
 	// probably should be made generic (likely wil switch to SDL at somepoint) 
 	GLFWwindow* window;
+	// hidden window with an offscreen context, no editor
+	bool headless;
 	
 
 	std::vector<unsigned int> componentIds;
@@ -0,0 +1,116 @@
+#include "JobSystem.h"
+#include "Debug.h"
+
+void JobSystem::Init(unsigned int numThreads)
+{
+	if (!workers.empty())
+	{
+		return;
+	}
+	if (numThreads == 0)
+	{
+		unsigned int cores = std::thread::hardware_concurrency();
+		numThreads = cores > 1 ? cores - 1 : 0;
+	}
+	stopping = false;
+	for (unsigned int i = 0; i < numThreads; i++)
+	{
+		workers.emplace_back(&JobSystem::WorkerLoop);
+	}
+	Debug::Log<JobSystem>(("Started " + std::to_string(numThreads) + " job threads").c_str());
+}
+
+void JobSystem::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	ready.notify_all();
+	for (auto& w : workers)
+	{
+		w.join();
+	}
+	workers.clear();
+}
+
+void JobSystem::Run(JobCounter& counter, std::function<void()> job)
+{
+	counter.pending++;
+	if (workers.empty())
+	{
+		job();
+		counter.pending--;
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back({ std::move(job), &counter });
+	}
+	ready.notify_one();
+}
+
+void JobSystem::ParallelFor(JobCounter& counter, unsigned int count, unsigned int chunkSize, std::function<void(unsigned int, unsigned int, unsigned int)> fn)
+{
+	chunkSize = std::max(chunkSize, 1u);
+	unsigned int numChunks = (count + chunkSize - 1) / chunkSize;
+	// the caller is about to wait anyway, so it takes the first chunk itself
+	for (unsigned int c = 1; c < numChunks; c++)
+	{
+		unsigned int begin = c * chunkSize;
+		unsigned int end = std::min(begin + chunkSize, count);
+		Run(counter, [fn, begin, end, c]() { fn(begin, end, c); });
+	}
+	if (numChunks > 0)
+	{
+		fn(0, std::min(chunkSize, count), 0);
+	}
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+	while (!counter.IsDone())
+	{
+		if (!RunOne())
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+bool JobSystem::RunOne()
+{
+	Job job;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (queue.empty())
+		{
+			return false;
+		}
+		job = std::move(queue.front());
+		queue.pop_front();
+	}
+	job.fn();
+	job.counter->pending--;
+	return true;
+}
+
+void JobSystem::WorkerLoop()
+{
+	while (true)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			ready.wait(lock, [] { return stopping || !queue.empty(); });
+			if (queue.empty())
+			{
+				return;
+			}
+			job = std::move(queue.front());
+			queue.pop_front();
+		}
+		job.fn();
+		job.counter->pending--;
+	}
+}
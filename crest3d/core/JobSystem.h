@@ -0,0 +1,52 @@
+#pragma once
+#include "Common.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <atomic>
+
+// jobs still to finish in a batch, wait on it with JobSystem::Wait
+struct JobCounter
+{
+	std::atomic<unsigned int> pending{ 0 };
+	inline bool IsDone() { return pending.load() == 0; }
+};
+
+// a fixed pool of worker threads, one per core less the main thread's. Wait runs queued jobs itself
+// until its counter empties, so a job can start more jobs and wait on them without holding up a worker.
+// before Init (or with one core) jobs just run on the calling thread.
+class JobSystem
+{
+public:
+	// 0 picks from the hardware
+	static void Init(unsigned int numThreads = 0);
+	// runs whatever is still queued, then joins the workers
+	static void Shutdown();
+
+	static void Run(JobCounter& counter, std::function<void()> job);
+	// fn(begin, end, chunk) for every chunkSize slice of [0, count). the slices don't depend on the
+	// number of threads, so per chunk work (random streams) comes out the same on any machine
+	static void ParallelFor(JobCounter& counter, unsigned int count, unsigned int chunkSize, std::function<void(unsigned int, unsigned int, unsigned int)> fn);
+	static void Wait(JobCounter& counter);
+
+	inline static unsigned int GetNumThreads() { return (unsigned int)workers.size(); }
+
+private:
+	struct Job
+	{
+		std::function<void()> fn;
+		JobCounter* counter;
+	};
+
+	// false if there was nothing queued
+	static bool RunOne();
+	static void WorkerLoop();
+
+	inline static std::vector<std::thread> workers;
+	inline static std::deque<Job> queue;
+	inline static std::mutex mutex;
+	inline static std::condition_variable ready;
+	inline static bool stopping = false;
+};
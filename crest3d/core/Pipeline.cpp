@@ -1,3 +1,333 @@
 #pragma once
 #include "Pipeline.h"
+#include "Debug.h"
+#include "Profiler.h"
 
+Pipeline::Pipeline()
+{
+	width = CREST_WINDOW_WIDTH;
+	height = CREST_WINDOW_HEIGHT;
+	dirty = true;
+	numCulledPasses = 0;
+}
+
+void Pipeline::addTarget(const std::string& name, bool multiSample)
+{
+	RenderTarget t;
+	t.name = name;
+	t.multiSample = multiSample;
+	targets[name] = t;
+	dirty = true;
+}
+
+void Pipeline::addPass(const std::string& name, Shader* shader, std::vector<std::string> inputs, const std::string& output, std::function<void(Pipeline&)> execute)
+{
+	for (auto& p : passes)
+	{
+		if (p.output == output)
+		{
+			std::string s = "Render target '" + output + "' already has a writer, ignoring pass " + name;
+			Debug::Warn<Pipeline>(s.c_str());
+			return;
+		}
+	}
+
+	if (targets.find(output) == targets.end())
+	{
+		addTarget(output);
+	}
+
+	RenderPass pass(name, shader);
+	pass.inputs = inputs;
+	pass.output = output;
+	pass.execute = execute;
+	passes.emplace_back(pass);
+	dirty = true;
+}
+
+void Pipeline::markOutput(const std::string& target)
+{
+	if (targets.find(target) != targets.end() && !targets[target].persistent)
+	{
+		targets[target].persistent = true;
+		dirty = true;
+	}
+}
+
+void Pipeline::unmarkOutput(const std::string& target)
+{
+	if (targets.find(target) != targets.end() && targets[target].persistent)
+	{
+		targets[target].persistent = false;
+		dirty = true;
+	}
+}
+
+void Pipeline::release()
+{
+	for (auto& t : targets)
+	{
+		t.second.fb = nullptr;
+	}
+	pool.clear();
+	dirty = true;
+}
+
+void Pipeline::setTargetScale(const std::string& target, float scale)
+{
+	if (targets.find(target) != targets.end())
+	{
+		targets[target].scale = scale;
+	}
+}
+
+void Pipeline::compile()
+{
+	// walk backwards from the outputs, a pass only lives if someone reads what it writes
+	std::map<std::string, bool> needed;
+	std::map<std::string, FrameBuffer*> previous;
+	for (auto& t : targets)
+	{
+		needed[t.first] = t.second.persistent;
+		previous[t.first] = t.second.fb;
+		t.second.firstUse = -1;
+		t.second.lastUse = -1;
+		t.second.fb = nullptr;
+	}
+
+	numCulledPasses = 0;
+	for (int i = (int)passes.size() - 1; i >= 0; i--)
+	{
+		RenderPass& p = passes[i];
+		p.culled = !needed[p.output];
+		if (p.culled)
+		{
+			numCulledPasses++;
+			continue;
+		}
+		for (auto& input : p.inputs)
+		{
+			needed[input] = true;
+		}
+	}
+
+	// lifetimes in pass indices
+	const int end = passes.size();
+	for (int i = 0; i < end; i++)
+	{
+		RenderPass& p = passes[i];
+		if (p.culled)
+		{
+			continue;
+		}
+		RenderTarget& out = targets[p.output];
+		if (out.firstUse < 0) { out.firstUse = i; }
+		out.lastUse = std::max(out.lastUse, i);
+
+		for (auto& input : p.inputs)
+		{
+			RenderTarget& in = targets[input];
+			in.lastUse = std::max(in.lastUse, i);
+		}
+	}
+	for (auto& t : targets)
+	{
+		if (t.second.persistent && t.second.firstUse >= 0)
+		{
+			t.second.lastUse = end;
+		}
+	}
+
+	// hand out framebuffers, a target can reuse any framebuffer whose previous owner is dead
+	std::vector<FrameBuffer*> freeList;
+	for (auto& fb : pool)
+	{
+		freeList.emplace_back(fb.get());
+	}
+	std::map<std::string, bool> released;
+	std::vector<std::unique_ptr<FrameBuffer>> newPool;
+
+	// outputs keep the framebuffer they had, things outside the graph (captures, editor windows) hold on to it
+	for (auto& t : targets)
+	{
+		FrameBuffer* fb = previous[t.first];
+		if (!t.second.persistent || t.second.firstUse < 0 || fb == nullptr || fb->IsMultiSample() != t.second.multiSample)
+		{
+			continue;
+		}
+		auto it = std::find(freeList.begin(), freeList.end(), fb);
+		if (it != freeList.end())
+		{
+			t.second.fb = fb;
+			freeList.erase(it);
+		}
+	}
+
+	for (int i = 0; i < end; i++)
+	{
+		// return framebuffers of targets that died before this pass
+		for (auto& t : targets)
+		{
+			if (t.second.fb != nullptr && t.second.lastUse < i && !released[t.first])
+			{
+				released[t.first] = true;
+				freeList.emplace_back(t.second.fb);
+			}
+		}
+
+		if (passes[i].culled)
+		{
+			continue;
+		}
+
+		RenderTarget& out = targets[passes[i].output];
+		if (out.fb != nullptr)
+		{
+			continue;
+		}
+
+		for (auto it = freeList.begin(); it != freeList.end(); it++)
+		{
+			if ((*it)->IsMultiSample() == out.multiSample)
+			{
+				out.fb = *it;
+				freeList.erase(it);
+				break;
+			}
+		}
+
+		if (out.fb == nullptr)
+		{
+			std::unique_ptr<FrameBuffer> fb = std::make_unique<FrameBuffer>();
+			fb->initialise(width, height, out.multiSample);
+			out.fb = fb.get();
+			newPool.emplace_back(std::move(fb));
+		}
+	}
+
+	// keep every framebuffer something was assigned to, the rest are freed
+	for (auto& fb : pool)
+	{
+		bool used = false;
+		for (auto& t : targets)
+		{
+			if (t.second.fb == fb.get())
+			{
+				used = true;
+				break;
+			}
+		}
+		if (used)
+		{
+			newPool.emplace_back(std::move(fb));
+		}
+	}
+	pool = std::move(newPool);
+
+	std::stringstream s;
+	s << "Compiled render graph: " << (passes.size() - numCulledPasses) << "/" << passes.size() << " passes, "
+		<< pool.size() << " framebuffers (" << (GetTargetMemory() / (1024 * 1024)) << " MB)";
+	Debug::Log<Pipeline>(s.str().c_str());
+	dirty = false;
+}
+
+void Pipeline::execute()
+{
+	if (dirty)
+	{
+		compile();
+	}
+
+	for (auto& p : passes)
+	{
+		if (p.culled)
+		{
+			continue;
+		}
+
+		Profiler::Scope scope(p.name.c_str());
+		FrameBuffer* fb = targets[p.output].fb;
+		// aliased framebuffers are shared, so the scale is applied per pass
+		fb->SetRenderScale(targets[p.output].scale);
+		fb->initForDrawing();
+		glViewport(0, 0, fb->GetRenderWidth(), fb->GetRenderHeight());
+		p.execute(*this);
+		fb->finishDrawing();
+	}
+}
+
+void Pipeline::resize(float newWidth, float newHeight)
+{
+	width = newWidth;
+	height = newHeight;
+	for (auto& fb : pool)
+	{
+		fb->changeScreenSize(width, height);
+	}
+}
+
+FrameBuffer* Pipeline::GetFrameBuffer(const std::string& target)
+{
+	if (targets.find(target) == targets.end())
+	{
+		return nullptr;
+	}
+	return targets[target].fb;
+}
+
+unsigned int Pipeline::GetTexture(const std::string& target)
+{
+	FrameBuffer* fb = GetFrameBuffer(target);
+	return fb != nullptr ? fb->GetTexture() : 0;
+}
+
+unsigned int Pipeline::GetDepthTexture(const std::string& target)
+{
+	FrameBuffer* fb = GetFrameBuffer(target);
+	return fb != nullptr ? fb->GetDepthTexture() : 0;
+}
+
+glm::vec2 Pipeline::GetUVScale(const std::string& target)
+{
+	FrameBuffer* fb = GetFrameBuffer(target);
+	return fb != nullptr ? fb->GetUVScale() : glm::vec2(1.0f);
+}
+
+bool Pipeline::IsPassCulled(const std::string& pass)
+{
+	for (auto& p : passes)
+	{
+		if (p.name == pass)
+		{
+			return p.culled;
+		}
+	}
+	return true;
+}
+
+size_t Pipeline::GetTargetMemory()
+{
+	size_t total = 0;
+	for (auto& fb : pool)
+	{
+		total += fb->GetMemoryUsage();
+	}
+	return total;
+}
+
+void Pipeline::ui()
+{
+	ImGui::Text("Render graph: %u passes, %u culled", GetNumPasses(), GetNumCulledPasses());
+	ImGui::Text("Framebuffers: %u (%.1f MB)", GetNumFrameBuffers(), GetTargetMemory() / (1024.0f * 1024.0f));
+	for (auto& p : passes)
+	{
+		if (p.culled)
+		{
+			ImGui::TextDisabled("  %s -> %s (culled)", p.name.c_str(), p.output.c_str());
+		}
+		else
+		{
+			ImGui::Text("  %s -> %s", p.name.c_str(), p.output.c_str());
+		}
+	}
+}
@@ -2,28 +2,84 @@
 #include "Common.h"
 #include "gfx/FrameBuffer.h"
 #include "RenderGroup.h"
+#include <functional>
+
+class Pipeline;
+
+// a named image passes read from and write to.
+// the actual FrameBuffer is borrowed from the pipeline's pool when the graph is compiled
+struct RenderTarget
+{
+	std::string name;
+	bool multiSample = false;
+	bool persistent = false; // read outside of the pipeline (editor windows etc.) so must live to the end of the frame
+	float scale = 1.0f; // fraction of the pipeline resolution actually drawn, see DynamicResolution
+
+	// filled in by Pipeline::compile
+	int firstUse = -1;
+	int lastUse = -1;
+	FrameBuffer* fb = nullptr;
+};
 
 struct RenderPass {
-public: 
-	RenderPass(Shader* _shader) { shader = _shader; pipe = false; }
-	~RenderPass() { delete fb; }
+public:
+	RenderPass(const std::string& _name, Shader* _shader) { name = _name; shader = _shader; culled = false; }
+
+	std::string name;
 	PropertyGroup properties;
 
-	unsigned int id; // location of the render pass frame buffer
-	bool pipe; // is the output of this shader used in the next / future pass
-	
-private:
-	unsigned int resolution_x, resolution_y;
-	FrameBuffer* fb;
-	Shader* shader;
+	std::vector<std::string> inputs; // targets sampled by this pass
+	std::string output; // target drawn in to by this pass
+	std::function<void(Pipeline&)> execute;
 
+	bool culled; // nothing downstream reads the output, so the pass is skipped entirely
+	Shader* shader;
 };
 
 class Pipeline
 {
-	// must be in sequence. 
-	std::vector<RenderPass> passes;
-	unsigned int finalImageId; // assumed to be final pass
+public:
+	Pipeline();
+	~Pipeline() {};
+
+	void addTarget(const std::string& name, bool multiSample = false);
+	// passes must be added in the order they should execute
+	void addPass(const std::string& name, Shader* shader, std::vector<std::string> inputs, const std::string& output, std::function<void(Pipeline&)> execute);
+	// mark a target as consumed outside the graph, anything feeding it is kept alive. while it stays marked
+	// it keeps the same FrameBuffer through recompiles, so the pointer can be held on to
+	void markOutput(const std::string& target);
+	void unmarkOutput(const std::string& target);
+	// draw a target at a fraction of the pipeline resolution without reallocating it
+	void setTargetScale(const std::string& target, float scale);
+
+	// cull unused passes and alias transient targets, called lazily by execute when the graph changes
+	void compile();
+	void execute();
+	void resize(float newWidth, float newHeight);
+	// frees every FrameBuffer while there's still a context, the next execute recompiles
+	void release();
+
+	unsigned int GetTexture(const std::string& target);
+	unsigned int GetDepthTexture(const std::string& target);
+	FrameBuffer* GetFrameBuffer(const std::string& target);
+	// multiply uvs by this when sampling a scaled target
+	glm::vec2 GetUVScale(const std::string& target);
+	bool IsPassCulled(const std::string& pass);
+
+	size_t GetTargetMemory();
+	inline unsigned int GetNumPasses() { return passes.size(); }
+	inline unsigned int GetNumCulledPasses() { return numCulledPasses; }
+	inline unsigned int GetNumFrameBuffers() { return pool.size(); }
 
+	void ui();
 
-};
\ No newline at end of file
+private:
+	// must be in sequence.
+	std::vector<RenderPass> passes;
+	std::map<std::string, RenderTarget> targets;
+	std::vector<std::unique_ptr<FrameBuffer>> pool;
+
+	float width, height;
+	bool dirty;
+	unsigned int numCulledPasses;
+};
@@ -0,0 +1,397 @@
+#include "Profiler.h"
+#include "Debug.h"
+
+double Profiler::CPUNow(FrameSlot& slot)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - slot.cpuStart).count();
+}
+
+unsigned int Profiler::IssueTimestamp(FrameSlot& slot)
+{
+	if (slot.queriesUsed == slot.queries.size())
+	{
+		// grow the pool, it settles after the first few frames
+		unsigned int q;
+		glGenQueries(1, &q);
+		slot.queries.emplace_back(q);
+	}
+	unsigned int q = slot.queries[slot.queriesUsed++];
+	glQueryCounter(q, GL_TIMESTAMP);
+	return q;
+}
+
+void Profiler::Shutdown()
+{
+	for (auto& slot : slots)
+	{
+		if (!slot.queries.empty())
+		{
+			glDeleteQueries(slot.queries.size(), slot.queries.data());
+		}
+		slot.queries.clear();
+		slot.queriesUsed = 0;
+		slot.pending = false;
+	}
+	stack.clear();
+	inFrame = false;
+}
+
+void Profiler::BeginFrame()
+{
+	if (!enabled || inFrame)
+	{
+		return;
+	}
+	gpuSupported = GLEW_ARB_timer_query || GLEW_VERSION_3_3;
+
+	FrameSlot& slot = slots[frameIndex % FRAMES_IN_FLIGHT];
+	if (slot.pending)
+	{
+		Resolve(slot);
+	}
+
+	slot.frame.index = frameIndex;
+	slot.frame.samples.clear();
+	slot.frame.cpuTime = 0.0;
+	slot.frame.gpuTime = 0.0;
+	slot.frame.gpuValid = gpuSupported;
+	slot.queriesUsed = 0;
+	slot.cpuStart = std::chrono::high_resolution_clock::now();
+	stack.clear();
+	inFrame = true;
+
+	// the frame itself is the root scope, everything else nests under it
+	BeginScope("Frame");
+}
+
+void Profiler::EndFrame()
+{
+	if (!inFrame)
+	{
+		return;
+	}
+
+	while (!stack.empty())
+	{
+		EndScope();
+	}
+
+	FrameSlot& slot = slots[frameIndex % FRAMES_IN_FLIGHT];
+	slot.frame.cpuTime = slot.frame.samples[0].cpuEnd;
+	slot.pending = true;
+	inFrame = false;
+	frameIndex++;
+}
+
+void Profiler::BeginScope(const char* name, bool gpu)
+{
+	if (!inFrame)
+	{
+		return;
+	}
+
+	FrameSlot& slot = slots[frameIndex % FRAMES_IN_FLIGHT];
+	Sample s;
+	s.name = name;
+	s.depth = stack.size();
+	s.gpu = gpu && gpuSupported;
+	s.cpuStart = CPUNow(slot);
+	s.cpuEnd = s.cpuStart;
+	s.gpuStart = s.gpuEnd = 0.0;
+	s.queryBegin = s.gpu ? IssueTimestamp(slot) : 0;
+	s.queryEnd = 0;
+
+	stack.emplace_back(slot.frame.samples.size());
+	slot.frame.samples.emplace_back(s);
+}
+
+void Profiler::EndScope()
+{
+	if (!inFrame || stack.empty())
+	{
+		return;
+	}
+
+	FrameSlot& slot = slots[frameIndex % FRAMES_IN_FLIGHT];
+	Sample& s = slot.frame.samples[stack.back()];
+	stack.pop_back();
+
+	if (s.gpu)
+	{
+		s.queryEnd = IssueTimestamp(slot);
+	}
+	s.cpuEnd = CPUNow(slot);
+}
+
+void Profiler::Resolve(FrameSlot& slot)
+{
+	slot.pending = false;
+	Frame& f = slot.frame;
+
+	if (f.gpuValid && slot.queriesUsed > 0)
+	{
+		// queries complete in order, so the last one being ready means they all are
+		int available = 0;
+		glGetQueryObjectiv(slot.queries[slot.queriesUsed - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+		{
+			f.gpuValid = false;
+		}
+	}
+
+	if (f.gpuValid && !f.samples.empty())
+	{
+		GLuint64 origin = 0;
+		glGetQueryObjectui64v(f.samples[0].queryBegin, GL_QUERY_RESULT, &origin);
+		for (auto& s : f.samples)
+		{
+			if (!s.gpu)
+			{
+				continue;
+			}
+			GLuint64 begin = 0, end = 0;
+			glGetQueryObjectui64v(s.queryBegin, GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(s.queryEnd, GL_QUERY_RESULT, &end);
+			s.gpuStart = (begin - origin) / 1000000.0;
+			s.gpuEnd = (end - origin) / 1000000.0;
+		}
+		f.gpuTime = f.samples[0].gpuEnd;
+	}
+
+	if (paused)
+	{
+		return;
+	}
+
+	history.emplace_back(f);
+	if (history.size() > HISTORY_LENGTH)
+	{
+		history.pop_front();
+	}
+}
+
+const Profiler::Sample* Profiler::FindLatest(const std::string& name)
+{
+	if (history.empty())
+	{
+		return nullptr;
+	}
+	for (auto& s : history.back().samples)
+	{
+		if (s.name == name)
+		{
+			return &s;
+		}
+	}
+	return nullptr;
+}
+
+float Profiler::GetCPUTime(const std::string& name)
+{
+	const Sample* s = FindLatest(name);
+	return s != nullptr ? (float)(s->cpuEnd - s->cpuStart) : -1.0f;
+}
+
+float Profiler::GetGPUTime(const std::string& name)
+{
+	const Sample* s = FindLatest(name);
+	if (s == nullptr || !s->gpu || !history.back().gpuValid)
+	{
+		return -1.0f;
+	}
+	return (float)(s->gpuEnd - s->gpuStart);
+}
+
+bool Profiler::ExportCSV(const std::string& path)
+{
+	std::ofstream out(path.c_str());
+	if (!out.good())
+	{
+		std::string m = "Failed to open " + path + " for writing";
+		Debug::Error<Profiler>(m.c_str());
+		return false;
+	}
+
+	out << "frame,scope,depth,cpu_start_ms,cpu_ms,gpu_start_ms,gpu_ms\n";
+	for (auto& f : history)
+	{
+		for (auto& s : f.samples)
+		{
+			out << f.index << "," << s.name << "," << s.depth << "," << s.cpuStart << "," << (s.cpuEnd - s.cpuStart) << ",";
+			if (s.gpu && f.gpuValid)
+			{
+				out << s.gpuStart << "," << (s.gpuEnd - s.gpuStart);
+			}
+			else
+			{
+				out << ",";
+			}
+			out << "\n";
+		}
+	}
+	out.close();
+
+	std::string m = "Exported " + std::to_string(history.size()) + " frames to " + path;
+	Debug::Log<Profiler>(m.c_str());
+	return true;
+}
+
+void Profiler::PrintSummary(std::ostream& out)
+{
+	if (history.empty())
+	{
+		out << "No frames recorded" << std::endl;
+		return;
+	}
+
+	// scopes in the order they appear in the latest frame
+	for (auto& s : history.back().samples)
+	{
+		double cpu = 0.0, gpu = 0.0;
+		int cpuCount = 0, gpuCount = 0;
+		for (auto& f : history)
+		{
+			for (auto& hs : f.samples)
+			{
+				if (hs.name != s.name)
+				{
+					continue;
+				}
+				cpu += hs.cpuEnd - hs.cpuStart;
+				cpuCount++;
+				if (hs.gpu && f.gpuValid)
+				{
+					gpu += hs.gpuEnd - hs.gpuStart;
+					gpuCount++;
+				}
+				break;
+			}
+		}
+
+		out << std::string(s.depth * 2, ' ') << s.name << ": cpu " << (cpuCount > 0 ? cpu / cpuCount : 0.0) << " ms";
+		if (gpuCount > 0)
+		{
+			out << ", gpu " << gpu / gpuCount << " ms";
+		}
+		out << std::endl;
+	}
+}
+
+void Profiler::DrawWindow()
+{
+	if (!ImGui::Begin("Profiler"))
+	{
+		ImGui::End();
+		return;
+	}
+
+	ImGui::Checkbox("Enabled", &enabled);
+	ImGui::SameLine();
+	ImGui::Checkbox("Pause", &paused);
+	ImGui::SameLine();
+	if (ImGui::Button("Export CSV"))
+	{
+		ExportCSV("profile.csv");
+	}
+
+	if (history.empty())
+	{
+		ImGui::Text("No frames recorded yet");
+		ImGui::End();
+		return;
+	}
+
+	const Frame& f = history.back();
+	if (f.gpuValid)
+	{
+		ImGui::Text("Frame %llu: CPU %.3f ms, GPU %.3f ms", f.index, f.cpuTime, f.gpuTime);
+	}
+	else
+	{
+		ImGui::Text("Frame %llu: CPU %.3f ms, GPU not ready", f.index, f.cpuTime);
+	}
+
+	// timeline, cpu on the top row and gpu underneath, on a shared ms scale
+	const float rowHeight = 18.0f;
+	float span = (float)std::max(std::max(f.cpuTime, f.gpuTime), 16.6);
+	float width = std::max(ImGui::GetContentRegionAvail().x, 100.0f);
+	ImVec2 origin = ImGui::GetCursorScreenPos();
+	ImDrawList* draw = ImGui::GetWindowDrawList();
+	int maxDepth = 0;
+	for (auto& s : f.samples)
+	{
+		maxDepth = std::max(maxDepth, s.depth);
+	}
+	float gpuRow = (maxDepth + 1) * rowHeight + 4.0f;
+
+	for (auto& s : f.samples)
+	{
+		ImU32 colour = ImGui::GetColorU32(ImVec4(0.3f + 0.15f * (s.depth % 4), 0.5f, 0.8f - 0.1f * (s.depth % 4), 1.0f));
+		float y = origin.y + s.depth * rowHeight;
+		ImVec2 a(origin.x + (float)(s.cpuStart / span) * width, y);
+		ImVec2 b(origin.x + (float)(s.cpuEnd / span) * width, y + rowHeight - 2.0f);
+		draw->AddRectFilled(a, b, colour);
+		draw->AddText(ImVec2(a.x + 2.0f, a.y + 2.0f), IM_COL32_WHITE, s.name.c_str());
+
+		if (s.gpu && f.gpuValid)
+		{
+			ImVec2 ga(origin.x + (float)(s.gpuStart / span) * width, y + gpuRow);
+			ImVec2 gb(origin.x + (float)(s.gpuEnd / span) * width, y + gpuRow + rowHeight - 2.0f);
+			draw->AddRectFilled(ga, gb, ImGui::GetColorU32(ImVec4(0.8f, 0.4f, 0.2f + 0.1f * (s.depth % 4), 1.0f)));
+			draw->AddText(ImVec2(ga.x + 2.0f, ga.y + 2.0f), IM_COL32_WHITE, s.name.c_str());
+		}
+	}
+	ImGui::Dummy(ImVec2(width, gpuRow * 2.0f));
+
+	// averages over the recorded history
+	ImGui::Columns(4, "profiler_scopes");
+	ImGui::Text("Scope"); ImGui::NextColumn();
+	ImGui::Text("CPU ms"); ImGui::NextColumn();
+	ImGui::Text("GPU ms"); ImGui::NextColumn();
+	ImGui::Text("GPU avg ms"); ImGui::NextColumn();
+	ImGui::Separator();
+	for (auto& s : f.samples)
+	{
+		double total = 0.0;
+		int count = 0;
+		for (auto& h : history)
+		{
+			if (!h.gpuValid)
+			{
+				continue;
+			}
+			for (auto& hs : h.samples)
+			{
+				if (hs.gpu && hs.name == s.name)
+				{
+					total += hs.gpuEnd - hs.gpuStart;
+					count++;
+					break;
+				}
+			}
+		}
+
+		ImGui::Text("%*s%s", s.depth * 2, "", s.name.c_str()); ImGui::NextColumn();
+		ImGui::Text("%.3f", s.cpuEnd - s.cpuStart); ImGui::NextColumn();
+		if (s.gpu && f.gpuValid)
+		{
+			ImGui::Text("%.3f", s.gpuEnd - s.gpuStart);
+		}
+		else
+		{
+			ImGui::TextDisabled("-");
+		}
+		ImGui::NextColumn();
+		if (count > 0)
+		{
+			ImGui::Text("%.3f", total / count);
+		}
+		else
+		{
+			ImGui::TextDisabled("-");
+		}
+		ImGui::NextColumn();
+	}
+	ImGui::Columns(1);
+	ImGui::End();
+}
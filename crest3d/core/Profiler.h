@@ -0,0 +1,82 @@
+#pragma once
+#include "Common.h"
+#include <chrono>
+#include <deque>
+
+// cpu and gpu timing of named scopes on one per-frame timeline.
+// gpu scopes are bracketed with glQueryCounter(GL_TIMESTAMP) from a ring of per-frame query pools,
+// a frame's queries are only read back when its slot comes round again so the cpu never waits on the gpu.
+class Profiler
+{
+public:
+	struct Sample
+	{
+		std::string name;
+		int depth;
+		bool gpu; // also timed on the gpu
+		// ms from the start of the frame, gpu times are relative to the gpu frame start
+		double cpuStart, cpuEnd;
+		double gpuStart, gpuEnd;
+		unsigned int queryBegin, queryEnd;
+	};
+
+	struct Frame
+	{
+		unsigned long long index;
+		std::vector<Sample> samples;
+		double cpuTime, gpuTime; // ms
+		bool gpuValid; // false if the queries were not ready in time
+	};
+
+	static void BeginFrame();
+	static void EndFrame();
+	// deletes the timestamp queries, while the context is still around. unresolved frames are dropped
+	static void Shutdown();
+
+	static void BeginScope(const char* name, bool gpu = true);
+	static void EndScope();
+
+	// ends the scope when it leaves c++ scope
+	struct Scope
+	{
+		Scope(const char* name, bool gpu = true) { Profiler::BeginScope(name, gpu); }
+		~Scope() { Profiler::EndScope(); }
+	};
+
+	// duration of a named scope in the most recently resolved frame, -1 if it was not recorded
+	static float GetCPUTime(const std::string& name);
+	static float GetGPUTime(const std::string& name);
+
+	static bool ExportCSV(const std::string& path);
+	// average cpu/gpu time per scope over the recorded history
+	static void PrintSummary(std::ostream& out);
+	static void DrawWindow();
+
+	inline static bool enabled = true;
+	inline static bool paused = false;
+
+private:
+	static const int FRAMES_IN_FLIGHT = 4;
+	static const int HISTORY_LENGTH = 240;
+
+	struct FrameSlot
+	{
+		Frame frame;
+		std::vector<unsigned int> queries;
+		unsigned int queriesUsed = 0;
+		bool pending = false;
+		std::chrono::high_resolution_clock::time_point cpuStart;
+	};
+
+	static double CPUNow(FrameSlot& slot);
+	static unsigned int IssueTimestamp(FrameSlot& slot);
+	static void Resolve(FrameSlot& slot);
+	static const Sample* FindLatest(const std::string& name);
+
+	inline static FrameSlot slots[FRAMES_IN_FLIGHT];
+	inline static std::vector<int> stack;
+	inline static std::deque<Frame> history;
+	inline static unsigned long long frameIndex = 0;
+	inline static bool inFrame = false;
+	inline static bool gpuSupported = true;
+};
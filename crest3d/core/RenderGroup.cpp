@@ -1,71 +1,223 @@
 #include "RenderGroup.h"
+#include "Debug.h"
 
-void PropertyGroup::AddProperty(std::string name, float value)
+// std140 base alignment and size of each type. mat3 is three vec4 columns
+static unsigned int PropertyAlignment(PropertyType type)
 {
-	// if the name isnt already being used
-	if (indexMapping.find(name) != indexMapping.end())
+	switch (type)
 	{
-		indexMapping[name] = propertyCounter;
-		floatProperties[propertyCounter] = value;
-		propertyCounter++;
+	case PROPERTY_INT: return 4;
+	case PROPERTY_FLOAT: return 4;
+	case PROPERTY_VEC2: return 8;
+	default: return 16;
 	}
 }
-void PropertyGroup::AddProperty(std::string name, unsigned int value)
+
+static unsigned int PropertySize(PropertyType type)
 {
-	if (indexMapping.find(name) != indexMapping.end())
+	switch (type)
 	{
-		indexMapping[name] = propertyCounter;
-		intProperties[propertyCounter] = value;
-		propertyCounter++;
+	case PROPERTY_INT: return 4;
+	case PROPERTY_FLOAT: return 4;
+	case PROPERTY_VEC2: return 8;
+	case PROPERTY_VEC3: return 12;
+	case PROPERTY_VEC4: return 16;
+	case PROPERTY_QUAT: return 16;
+	case PROPERTY_MAT3: return 48;
+	case PROPERTY_MAT4: return 64;
 	}
+	return 0;
 }
 
-void PropertyGroup::AddProperty(std::string name, glm::quat value)
+PropertyId PropertySchema::Intern(const std::string& name)
 {
-	// if the name isnt already being used
-	if (indexMapping.find(name) != indexMapping.end())
+	auto it = internedIds.find(name);
+	if (it != internedIds.end())
 	{
-		indexMapping[name] = propertyCounter;
-		quatProperties[propertyCounter] = value;
-		propertyCounter++;
+		return it->second;
 	}
+	PropertyId id = internedNames.size();
+	internedIds[name] = id;
+	internedNames.emplace_back(name);
+	return id;
 }
-void PropertyGroup::AddProperty(std::string name, glm::vec2 value)
+
+const std::string& PropertySchema::NameOf(PropertyId id)
 {
-	if (indexMapping.find(name) != indexMapping.end())
+	return internedNames.at(id);
+}
+
+PropertyId PropertySchema::add(const std::string& name, PropertyType type)
+{
+	PropertyId id = Intern(name);
+	if (find(id) != nullptr)
 	{
-		indexMapping[name] = propertyCounter;
-		vec2Properties[propertyCounter] = value;
-		propertyCounter++;
+		return id;
 	}
+
+	unsigned int alignment = PropertyAlignment(type);
+	Entry e;
+	e.id = id;
+	e.type = type;
+	e.offset = (size + alignment - 1) & ~(alignment - 1);
+	entries.emplace_back(e);
+	size = e.offset + PropertySize(type);
+	return id;
 }
 
-void PropertyGroup::AddProperty(std::string name, glm::vec3 value)
+const PropertySchema::Entry* PropertySchema::find(PropertyId id) const
 {
-	// if the name isnt already being used
-	if (indexMapping.find(name) != indexMapping.end())
+	// schemas are a handful of entries, a linear scan beats anything fancier
+	for (auto& e : entries)
 	{
-		indexMapping[name] = propertyCounter;
-		vec3Properties[propertyCounter] = value;
-		propertyCounter++;
+		if (e.id == id)
+		{
+			return &e;
+		}
 	}
+	return nullptr;
 }
-void PropertyGroup::AddProperty(std::string name, glm::mat3 value)
+
+PropertyGroup::PropertyGroup()
+{
+	schema = std::make_shared<PropertySchema>();
+}
+
+PropertyGroup::PropertyGroup(const std::shared_ptr<const PropertySchema>& _schema)
 {
-	if (indexMapping.find(name) != indexMapping.end())
+	schema = _schema;
+	data.resize(schema->GetSize(), 0);
+}
+
+PropertyId PropertyGroup::extend(const std::string& name, PropertyType type)
+{
+	PropertyId id = PropertySchema::Intern(name);
+	if (schema->find(id) != nullptr)
 	{
-		indexMapping[name] = propertyCounter;
-		mat3Properties[propertyCounter] = value;
-		propertyCounter++;
+		return id;
 	}
+
+	// the schema may be shared with other groups, so extend a copy
+	std::shared_ptr<PropertySchema> extended = std::make_shared<PropertySchema>(*schema);
+	extended->add(name, type);
+	schema = extended;
+	data.resize(schema->GetSize(), 0);
+	return id;
+}
+
+void PropertyGroup::write(PropertyId id, PropertyType type, const void* value, size_t bytes)
+{
+	const PropertySchema::Entry* e = schema->find(id);
+	if (e == nullptr)
+	{
+		return;
+	}
+	if (e->type != type)
+	{
+		std::string s = "Property '" + PropertySchema::NameOf(id) + "' written with the wrong type";
+		Debug::Warn<PropertyGroup>(s.c_str());
+		return;
+	}
+	memcpy(data.data() + e->offset, value, std::min<size_t>(bytes, PropertySize(e->type)));
+	version = ++versionCounter;
+}
+
+void PropertyGroup::read(const PropertySchema::Entry& e, void* value, size_t bytes) const
+{
+	if (e.type == PROPERTY_MAT3 && bytes == sizeof(glm::mat3))
+	{
+		// columns are padded to vec4
+		for (int c = 0; c < 3; c++)
+		{
+			memcpy((unsigned char*)value + c * sizeof(glm::vec3), data.data() + e.offset + c * 16, sizeof(glm::vec3));
+		}
+		return;
+	}
+	memcpy(value, data.data() + e.offset, std::min<size_t>(bytes, PropertySize(e.type)));
+}
+
+void PropertyGroup::SetProperty(PropertyId id, glm::mat3 value)
+{
+	glm::mat3x4 padded = glm::mat3x4(glm::vec4(value[0], 0.0f), glm::vec4(value[1], 0.0f), glm::vec4(value[2], 0.0f));
+	write(id, PROPERTY_MAT3, &padded, sizeof(padded));
+}
+
+void PropertyGroup::AddProperty(std::string name, float value)
+{
+	SetProperty(extend(name, PROPERTY_FLOAT), value);
+}
+
+void PropertyGroup::AddProperty(std::string name, unsigned int value)
+{
+	SetProperty(extend(name, PROPERTY_INT), value);
+}
+
+void PropertyGroup::AddProperty(std::string name, glm::quat value)
+{
+	SetProperty(extend(name, PROPERTY_QUAT), value);
+}
+
+void PropertyGroup::AddProperty(std::string name, glm::vec2 value)
+{
+	SetProperty(extend(name, PROPERTY_VEC2), value);
+}
+
+void PropertyGroup::AddProperty(std::string name, glm::vec3 value)
+{
+	SetProperty(extend(name, PROPERTY_VEC3), value);
+}
+
+void PropertyGroup::AddProperty(std::string name, glm::vec4 value)
+{
+	SetProperty(extend(name, PROPERTY_VEC4), value);
+}
+
+void PropertyGroup::AddProperty(std::string name, glm::mat3 value)
+{
+	SetProperty(extend(name, PROPERTY_MAT3), value);
 }
 
 void PropertyGroup::AddProperty(std::string name, glm::mat4 value)
 {
-	if (indexMapping.find(name) != indexMapping.end())
+	SetProperty(extend(name, PROPERTY_MAT4), value);
+}
+
+PropertyBuffer::~PropertyBuffer()
+{
+	if (ubo != 0)
+	{
+		glDeleteBuffers(1, &ubo);
+	}
+}
+
+void PropertyBuffer::upload(const PropertyGroup& group)
+{
+	if (&group == uploaded && group.version == uploadedVersion)
+	{
+		return;
+	}
+
+	if (ubo == 0)
+	{
+		glGenBuffers(1, &ubo);
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+	if (group.GetSize() != size)
+	{
+		size = group.GetSize();
+		glBufferData(GL_UNIFORM_BUFFER, size, group.GetData(), GL_DYNAMIC_DRAW);
+	}
+	else
 	{
-		indexMapping[name] = propertyCounter;
-		mat4Properties[propertyCounter] = value;
-		propertyCounter++;
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, size, group.GetData());
 	}
-}
\ No newline at end of file
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	uploaded = &group;
+	uploadedVersion = group.version;
+}
+
+void PropertyBuffer::bind(unsigned int binding)
+{
+	glBindBufferBase(GL_UNIFORM_BUFFER, binding, ubo);
+}
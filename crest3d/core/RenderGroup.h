@@ -4,48 +4,140 @@ class Mesh;
 class AnimatedModel;
 class ParticleSystem;
 
+// property names are interned once, after that everything is addressed by id
+typedef unsigned int PropertyId;
+
+enum PropertyType
+{
+	PROPERTY_INT,
+	PROPERTY_FLOAT,
+	PROPERTY_VEC2,
+	PROPERTY_VEC3,
+	PROPERTY_VEC4,
+	PROPERTY_QUAT,
+	PROPERTY_MAT3,
+	PROPERTY_MAT4
+};
+
+// uniform block binding points shared by every shader, set up in Shader::fillMappings
+enum PropertyBlockBinding : unsigned int
+{
+	PROPERTY_BLOCK_MATERIAL = 0
+};
+
+// layout of a property block. offsets follow std140, so a PropertyGroup's bytes can go straight in to a uniform buffer
+class PropertySchema
+{
+public:
+	struct Entry
+	{
+		PropertyId id;
+		PropertyType type;
+		unsigned int offset;
+	};
+
+	// appends a property, returns its id. adding the same name twice returns the existing id
+	PropertyId add(const std::string& name, PropertyType type);
+	// nullptr if the schema doesn't have it
+	const Entry* find(PropertyId id) const;
+	// padded to a multiple of 16 as std140 blocks are
+	inline unsigned int GetSize() const { return (size + 15) & ~15u; }
+	inline const std::vector<Entry>& GetEntries() const { return entries; }
+
+	static PropertyId Intern(const std::string& name);
+	static const std::string& NameOf(PropertyId id);
+
+private:
+	std::vector<Entry> entries;
+	unsigned int size = 0;
+
+	inline static std::map<std::string, PropertyId> internedIds;
+	inline static std::vector<std::string> internedNames;
+};
+
+// a block of typed properties in one contiguous buffer.
+// groups made from the same schema share it, AddProperty copies the schema before extending it
 struct PropertyGroup
 {
 public:
+	PropertyGroup();
+	PropertyGroup(const std::shared_ptr<const PropertySchema>& schema);
+
+	// adds the property if the name is new, otherwise sets it
 	void AddProperty(std::string name, unsigned int value);
 	void AddProperty(std::string name, float value);
 	void AddProperty(std::string name, glm::quat value);
 	void AddProperty(std::string name, glm::vec2 value);
 	void AddProperty(std::string name, glm::vec3 value);
+	void AddProperty(std::string name, glm::vec4 value);
 	void AddProperty(std::string name, glm::mat3 value);
 	void AddProperty(std::string name, glm::mat4 value);
 
+	// properties not in the schema are ignored
+	void SetProperty(PropertyId id, unsigned int value) { write(id, PROPERTY_INT, &value, sizeof(value)); }
+	void SetProperty(PropertyId id, float value) { write(id, PROPERTY_FLOAT, &value, sizeof(value)); }
+	void SetProperty(PropertyId id, glm::quat value) { write(id, PROPERTY_QUAT, &value, sizeof(value)); }
+	void SetProperty(PropertyId id, glm::vec2 value) { write(id, PROPERTY_VEC2, &value, sizeof(value)); }
+	void SetProperty(PropertyId id, glm::vec3 value) { write(id, PROPERTY_VEC3, &value, sizeof(value)); }
+	void SetProperty(PropertyId id, glm::vec4 value) { write(id, PROPERTY_VEC4, &value, sizeof(value)); }
+	void SetProperty(PropertyId id, glm::mat3 value);
+	void SetProperty(PropertyId id, glm::mat4 value) { write(id, PROPERTY_MAT4, &value, sizeof(value)); }
+
 	template <typename T>
-	T GetProperty(std::string name)
+	T GetProperty(PropertyId id) const
 	{
-		// property exists in index mapping
-		if (indexMapping.find(name) != indexMapping.end())
+		T value = T();
+		const PropertySchema::Entry* e = schema->find(id);
+		if (e != nullptr)
 		{
-			unsigned int index = indexMapping.at(name);
-
-			if (intProperties.find(index) != intProperties.end()) { return intProperties.at(index); }
-			if (floatProperties.find(index) != floatProperties.end()) { return floatProperties.at(index); }
-			if (quatProperties.find(index) != quatProperties.end()) { return quatProperties.at(index); }
-			if (vec2Properties.find(index) != vec2Properties.end()) { return vec2Properties.at(index); }
-			if (vec3Properties.find(index) != vec3Properties.end()) { return vec3Properties.at(index); }
-			if (mat3Properties.find(index) != mat3Properties.end()) { return mat3Properties.at(index); }
-			if (mat4Properties.find(index) != mat4Properties.end()) { return mat4Properties.at(index); }
+			read(*e, &value, sizeof(T));
 		}
+		return value;
+	}
 
-		return NULL;
+	template <typename T>
+	T GetProperty(const std::string& name) const
+	{
+		return GetProperty<T>(PropertySchema::Intern(name));
 	}
 
+	inline bool HasProperty(PropertyId id) const { return schema->find(id) != nullptr; }
+	inline const std::shared_ptr<const PropertySchema>& GetSchema() const { return schema; }
+	inline const unsigned char* GetData() const { return data.data(); }
+	inline unsigned int GetSize() const { return data.size(); }
+	inline bool empty() const { return schema->GetEntries().empty(); }
+
+	// unique per write across all groups, lets a PropertyBuffer skip uploading unchanged data
+	unsigned int version = 0;
+
 private:
-	std::map<std::string, unsigned int> indexMapping;
-	std::map<unsigned int, unsigned int> intProperties;
-	std::map<unsigned int, float> floatProperties;
-	std::map<unsigned int, glm::quat> quatProperties;
-	std::map<unsigned int, glm::vec2> vec2Properties;
-	std::map<unsigned int, glm::vec3> vec3Properties;
-	std::map<unsigned int, glm::mat3> mat3Properties;
-	std::map<unsigned int, glm::mat4> mat4Properties;
-	std::vector<unsigned int> activeIndices;
-	unsigned short propertyCounter = 0;
+	PropertyId extend(const std::string& name, PropertyType type);
+	void write(PropertyId id, PropertyType type, const void* value, size_t bytes);
+	void read(const PropertySchema::Entry& e, void* value, size_t bytes) const;
+
+	std::shared_ptr<const PropertySchema> schema;
+	std::vector<unsigned char> data;
+
+	inline static unsigned int versionCounter = 0;
+};
+
+// uniform buffer holding a PropertyGroup, only re-uploaded when the group changed
+class PropertyBuffer
+{
+public:
+	PropertyBuffer() {};
+	~PropertyBuffer();
+	PropertyBuffer(const PropertyBuffer&) = delete;
+	PropertyBuffer& operator=(const PropertyBuffer&) = delete;
+
+	void upload(const PropertyGroup& group);
+	void bind(unsigned int binding);
+
+private:
+	unsigned int ubo = 0;
+	unsigned int size = 0;
+	const PropertyGroup* uploaded = nullptr;
+	unsigned int uploadedVersion = 0;
 };
 
 struct RenderGroup
@@ -56,4 +148,4 @@ struct RenderGroup
 
 	glm::mat4 view, proj;
 
-};
\ No newline at end of file
+};
@@ -1,33 +1,46 @@
 #include "Renderer.h"
+#include "gfx/DeferredRenderer.h"
+#include "gfx/TransparencyRenderer.h"
 
 Renderer::Renderer()
 {
 	
 }
 
-void Renderer::RenderMesh(const std::shared_ptr<Mesh>& m, const std::shared_ptr<Shader>& _shader, const PropertyGroup& props)
+Renderer::~Renderer()
 {
-	int diffuseCount = 0;
-	int specularCount = 0;
-	int reflectionCount = 0;
-	int normalCount = 0;
 
-	for (unsigned int i = 0; i < m->textures.size(); i++)
+}
+
+DeferredRenderer* Renderer::GetDeferred()
+{
+	if (deferred == nullptr)
 	{
-		glActiveTexture(GL_TEXTURE0 + i);
-		unsigned int uniformLocation = _shader->textureIdMappings[m->textures[i].t_Type];
-		_shader->setIntID(uniformLocation, i);
-		glBindTexture(GL_TEXTURE_2D, m->textures[i].t_Id);
+		deferred = std::make_unique<DeferredRenderer>();
 	}
+	return deferred.get();
+}
 
-	glBindVertexArray(m->vao);
-	glDrawElements(GL_TRIANGLES, m->indices.size(), GL_UNSIGNED_INT, 0);
-	for (int i = 0; i < m->textures.size(); i++)
+TransparencyRenderer* Renderer::GetTransparency()
+{
+	if (transparency == nullptr)
 	{
-		glActiveTexture(GL_TEXTURE0 + i);
-		glBindTexture(GL_TEXTURE_2D, 0);
+		transparency = std::make_unique<TransparencyRenderer>();
+	}
+	return transparency.get();
+}
+
+void Renderer::RenderMesh(const std::shared_ptr<Mesh>& m, const std::shared_ptr<Shader>& _shader, const PropertyGroup& props)
+{
+	if (m->material != nullptr)
+	{
+		m->material->bind();
+		m->DrawGeometry();
+	}
+	else
+	{
+		m->Draw(_shader);
 	}
-	glBindVertexArray(0);
 }
 
 void Renderer::RenderAnim(const std::shared_ptr<AnimatedModel>& anim, const std::shared_ptr<Shader>& _shader, const PropertyGroup& props)
@@ -37,12 +50,12 @@ void Renderer::RenderAnim(const std::shared_ptr<AnimatedModel>& anim, const std:
 	for (unsigned int i = 0; i < anim->m_Entries.size(); i++) {
 		const unsigned int MaterialIndex = anim->m_Entries[i].MaterialIndex;
 
+		// the diffuse sampler is fixed to its material unit, see MaterialSlot
 		for (unsigned int j = 0; j < anim->m_Entries[i].Textures.size(); j++)
 		{
-			glActiveTexture(GL_TEXTURE0 + i);
 			if (anim->m_Entries[i].Textures[j].t_Type == TextureType::diffuse)
 			{
-				_shader->setInt("mat.m_Diffuse", i);
+				glActiveTexture(GL_TEXTURE0 + MATERIAL_DIFFUSE);
 				glBindTexture(GL_TEXTURE_2D, anim->m_Entries[i].Textures[j].t_Id);
 			}
 		}
@@ -59,14 +72,15 @@ void Renderer::RenderAnim(const std::shared_ptr<AnimatedModel>& anim, const std:
 
 void Renderer::RenderParticleSystem(const std::shared_ptr<ParticleSystem>& ps, const std::shared_ptr<Shader>& _shader, const PropertyGroup& props)
 {
-	GLCall(glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_ONE));
+	// the caller sets the blending, see Scene::renderBehaviour
+	ps->prepareBuffers();
 	GLCall(glBindVertexArray(ps->vertex_array_id));
 	GLCall(glBindBuffer(GL_ARRAY_BUFFER, ps->particles_position_buffer));
-	GLCall(glBufferData(GL_ARRAY_BUFFER, ps->MAX_PARTICLES * 4 * sizeof(GLfloat), NULL, GL_STREAM_DRAW)); // Buffer orphaning, a common way to improve streaming perf. See above link for details.
+	GLCall(glBufferData(GL_ARRAY_BUFFER, ps->GetCapacity() * 4 * sizeof(GLfloat), NULL, GL_STREAM_DRAW)); // Buffer orphaning, a common way to improve streaming perf. See above link for details.
 	GLCall(glBufferSubData(GL_ARRAY_BUFFER, 0, ps->particleCount * sizeof(GLfloat) * 4, ps->g_particule_position_size_data));
 
 	GLCall(glBindBuffer(GL_ARRAY_BUFFER, ps->particles_colour_buffer));
-	GLCall(glBufferData(GL_ARRAY_BUFFER, ps->MAX_PARTICLES * 4 * sizeof(GLubyte), NULL, GL_STREAM_DRAW)); // Buffer orphaning, a common way to improve streaming perf. See above link for details.
+	GLCall(glBufferData(GL_ARRAY_BUFFER, ps->GetCapacity() * 4 * sizeof(GLubyte), NULL, GL_STREAM_DRAW)); // Buffer orphaning, a common way to improve streaming perf. See above link for details.
 	GLCall(glBufferSubData(GL_ARRAY_BUFFER, 0, ps->particleCount * sizeof(GLubyte) * 4, ps->g_particule_color_data));
 
 	_shader->use();
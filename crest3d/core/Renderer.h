@@ -4,11 +4,15 @@
 #include "Scene.h"
 #include "Pipeline.h"
 #include "RenderGroup.h"
+
+class DeferredRenderer;
+class TransparencyRenderer;
+
 class Renderer
 {
 public: 
 	Renderer();
-	~Renderer() {};
+	~Renderer();
 
 	// render every type of drawable in the engine
 	void RenderMesh(const std::shared_ptr<Mesh>& m, const std::shared_ptr<Shader>& _shader, const PropertyGroup& props);
@@ -16,4 +20,13 @@ public:
 	void RenderParticleSystem(const std::shared_ptr<ParticleSystem>& ps, const std::shared_ptr<Shader>& _shader, const PropertyGroup& props);
 	void RenderPipeline(const std::shared_ptr<RenderGroup>& renderGroup, const std::shared_ptr<Pipeline>& pipeline);
 	void RenderPass(const std::shared_ptr<RenderGroup>& renderGroup, const std::shared_ptr<RenderPass>& pipeline);
+
+	// created the first time a scene asks for the deferred path
+	DeferredRenderer* GetDeferred();
+	// created the first time a scene draws order independent transparency
+	TransparencyRenderer* GetTransparency();
+
+private:
+	std::unique_ptr<DeferredRenderer> deferred;
+	std::unique_ptr<TransparencyRenderer> transparency;
 };
@@ -2,6 +2,9 @@
 #include "components/MeshComponent.h"
 #include "components/lighting/DirectionalLightComponent.h"
 #include "EngineManager.h"
+#include "gfx/DeferredRenderer.h"
+#include "gfx/TransparencyRenderer.h"
+#include "components/RigidbodyComponent.h"
 
 
 Scene::Scene(const char* _name, EngineManager* em)
@@ -10,6 +13,9 @@ Scene::Scene(const char* _name, EngineManager* em)
 	rootEntity = std::shared_ptr<Entity>(new Entity("root", engineManager, nullptr));
 	rootEntity->transform->setParent(nullptr);
 	DEBUG_SPHERE_RADIUS = 1.0f;
+	renderPath = RENDER_FORWARD;
+	orderIndependentTransparency = true;
+	activeShadows = nullptr;
 }
 
 
@@ -83,6 +89,13 @@ void childUpdate(std::shared_ptr<Entity> e, float deltaTime)
 void Scene::updateBehaviour(float deltaTime)
 {
 	engineManager->physicsManager->update(deltaTime);
+	particleBudget.update(particleSystems, sceneCamera);
+	for (auto& ps : particleSystems)
+	{
+		// a sum doesn't care about order, and neither does the TransparencyRenderer, so neither is sorted
+		ParticleBlend blend = ps->particleSystem->emitter.blend;
+		ps->particleSystem->orderIndependent = blend == PARTICLE_BLEND_ADDITIVE || (orderIndependentTransparency && blend == PARTICLE_BLEND_ALPHA);
+	}
 	childUpdate(rootEntity, deltaTime);
 }
 
@@ -103,40 +116,126 @@ void Scene::renderBehaviour(float deltaTime)
 	// childRender(rootEntity, deltaTime, view);
 
 	// sceneCamera->MakeFrustum();
-	engineManager->shaderManager->defaultShader->shader->use();
-	engineManager->shaderManager->defaultShader->setProjection(sceneCamera->GetProjectionMatrix());
-	engineManager->shaderManager->defaultShader->setView(view);
-	engineManager->shaderManager->defaultShader->UpdateShader(view);
-	updateShaderComponentLightSources(engineManager->shaderManager->defaultShader);
-	engineManager->shaderManager->defaultShader->shader->setVec3("viewPosition", sceneCamera->attachedEntity->transform->position);
+	// group drawables by material, ordered by shader variant so each program is set up once.
+	// a material's textures and parameters are bound once for all of its meshes
+	unsigned int numPointLights = pointLightComponents.size();
+	MaterialLibrary* materials = engineManager->materialLibrary.get();
+	// variants are sized for the longest per mesh light list rather than every light in the scene
+	lightAssignment.update(meshes, pointLightComponents);
+	if (updateStaticCasters() && dirLightComponent != nullptr)
+	{
+		dirLightComponent->invalidateShadows();
+	}
+	activeShadows = nullptr;
+	if (dirLightComponent != nullptr && dirLightComponent->castShadows)
+	{
+		activeShadows = dirLightComponent->GetShadows();
+		activeShadows->render(view, sceneCamera->GetProjectionMatrix(), dirLightComponent->direction, meshes, animatedModels);
+		activeShadows->bindTexture();
+	}
+	materials->update(lightAssignment.GetMaxLights(), activeShadows != nullptr);
+	for (auto& batch : meshBatches)
+	{
+		batch.second.clear();
+	}
+	for (unsigned int i = 0; i < meshes.size(); i++)
+	{
+		const std::shared_ptr<Material>& m = meshes[i]->mesh->material;
+		meshBatches[((unsigned long long)m->features << 32) | m->id].emplace_back(i);
+	}
+
+	if (renderPath == RENDER_DEFERRED && !DeferredRenderer::IsSupported())
+	{
+		Debug::Warn<Scene>("Deferred rendering needs compute shaders, using forward");
+		renderPath = RENDER_FORWARD;
+	}
 
-	bindDefaultTextures(engineManager->shaderManager->defaultShader);
-	for (std::shared_ptr<MeshComponent> mesh : meshes)
+	materials->reset();
+	if (renderPath == RENDER_DEFERRED)
+	{
+		renderDeferred(view);
+	}
+	else
 	{
-		mesh->draw(view, engineManager->shaderManager->defaultShader);
+		std::shared_ptr<ShaderComponent> current = nullptr;
+		for (auto& batch : meshBatches)
+		{
+			if (batch.second.empty())
+			{
+				continue;
+			}
+			const std::shared_ptr<Material>& m = materials->GetMaterial(batch.first & 0xFFFFFFFF);
+			if (m->shader != current)
+			{
+				current = m->shader;
+				prepareShader(current, view, false);
+			}
+			materials->bind(m);
+			for (unsigned int i : batch.second)
+			{
+				const std::vector<int>& lights = lightAssignment.GetLights(i);
+				current->SetLightIndices(lights.data(), lights.size());
+				meshes[i]->draw(view, current);
+			}
+		}
 	}
 
-	engineManager->shaderManager->defaultAnimShader->shader->use();
-	engineManager->shaderManager->defaultAnimShader->setProjection(sceneCamera->GetProjectionMatrix());
-	engineManager->shaderManager->defaultAnimShader->setView(view);
-	engineManager->shaderManager->defaultAnimShader->UpdateShader(view);
-	engineManager->shaderManager->defaultAnimShader->shader->setVec3("viewPosition", sceneCamera->attachedEntity->transform->position);
-	updateShaderComponentLightSources(engineManager->shaderManager->defaultAnimShader);
+	// animated models and particles stay forward on either path
 
-	bindDefaultTextures(engineManager->shaderManager->defaultAnimShader);
-	for (std::shared_ptr<AnimatedModelComponent> anim : animatedModels)
+	// AnimatedModel only binds diffuse maps, so the skinned shader never needs the others
+	if (!animatedModels.empty())
 	{
-		anim->draw(view, engineManager->shaderManager->defaultAnimShader);
+		std::shared_ptr<ShaderComponent> sc = engineManager->shaderManager->animVariants->get(activeShadows != nullptr ? SHADER_SHADOWS : 0, numPointLights);
+		prepareShader(sc, view);
+		materials->bind(materials->GetDefault());
+		for (std::shared_ptr<AnimatedModelComponent> anim : animatedModels)
+		{
+			anim->draw(view, sc);
+		}
 	}
+	materials->unbind();
 
-	auto particleShader = engineManager->shaderManager->defaultParticleShader;
 	auto sceneCamera = engineManager->scene->sceneCamera;
-	
-	particleShader->shader->use();
-	updateShaderComponentLightSources(particleShader);
-	for(std::shared_ptr<ParticleSystemComponent> ps : particleSystems)
+	// the opaque depth is complete. copied before the particles, additive ones still write depth
+	depthHistory.record(view, sceneCamera->GetProjectionMatrix());
+
+	auto drawParticles = [&](std::shared_ptr<ShaderComponent> particleShader, ParticleBlend blend)
+	{
+		particleShader->shader->use();
+		updateShaderComponentLightSources(particleShader);
+		depthHistory.bind(particleShader->shader.get());
+		particleShader->shader->setInt("additive", blend == PARTICLE_BLEND_ADDITIVE ? 1 : 0);
+		for (std::shared_ptr<ParticleSystemComponent> ps : particleSystems)
+		{
+			if (ps->particleSystem->emitter.blend == blend)
+			{
+				ps->draw(deltaTime, view, particleShader);
+			}
+		}
+	};
+
+	// additive emitters sum, which is already order independent, so they never go through the TransparencyRenderer
+	glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_ONE);
+	drawParticles(engineManager->shaderManager->defaultParticleShader, PARTICLE_BLEND_ADDITIVE);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	bool anyAlphaBlended = std::any_of(particleSystems.begin(), particleSystems.end(), [](std::shared_ptr<ParticleSystemComponent>& ps) {
+		return ps->particleSystem->emitter.blend == PARTICLE_BLEND_ALPHA;
+	});
+	if (anyAlphaBlended)
 	{
-		ps->draw(deltaTime, view, particleShader);
+		if (orderIndependentTransparency)
+		{
+			TransparencyRenderer* transparency = engineManager->renderer->GetTransparency();
+			transparency->begin();
+			drawParticles(engineManager->shaderManager->oitParticleShader, PARTICLE_BLEND_ALPHA);
+			transparency->end();
+		}
+		else
+		{
+			// depth sorted by their update
+			drawParticles(engineManager->shaderManager->defaultParticleShader, PARTICLE_BLEND_ALPHA);
+		}
 	}
 
 	glClear(GL_DEPTH_BUFFER_BIT);
@@ -146,28 +245,117 @@ void Scene::renderBehaviour(float deltaTime)
 	engineManager->physicsManager->render(deltaTime);
 }
 
-void Scene::bindDefaultTextures(std::shared_ptr<ShaderComponent> sc)
+void Scene::renderPicking()
+{
+	glm::mat4 view = sceneCamera->GetViewMatrix();
+	const float zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	glClearBufferfv(GL_COLOR, 0, zero);
+	// blending would mix the id bytes
+	glDisable(GL_BLEND);
+
+	std::shared_ptr<ShaderComponent> sc = engineManager->shaderManager->pickingShader;
+	sc->shader->use();
+	sc->setProjection(sceneCamera->GetProjectionMatrix());
+	sc->setView(view);
+	sc->UpdateShader(glm::mat4(1.0f));
+	for (auto& mesh : meshes)
+	{
+		sc->shader->setInt("entityId", (int)mesh->attachedEntity->GetID());
+		mesh->draw(view, sc);
+	}
+
+	if (!animatedModels.empty())
+	{
+		sc = engineManager->shaderManager->animPickingShader;
+		sc->shader->use();
+		sc->setProjection(sceneCamera->GetProjectionMatrix());
+		sc->setView(view);
+		sc->UpdateShader(glm::mat4(1.0f));
+		for (auto& anim : animatedModels)
+		{
+			sc->shader->setInt("entityId", (int)anim->attachedEntity->GetID());
+			anim->drawDepth(sc);
+		}
+	}
+	glEnable(GL_BLEND);
+}
+
+static std::shared_ptr<Entity> FindChild(const std::shared_ptr<Entity>& e, unsigned int id)
+{
+	if (e->GetID() == id)
+	{
+		return e;
+	}
+	for (auto& child : e->children)
+	{
+		std::shared_ptr<Entity> found = FindChild(child, id);
+		if (found != nullptr)
+		{
+			return found;
+		}
+	}
+	return nullptr;
+}
+
+std::shared_ptr<Entity> Scene::FindEntity(unsigned int id)
+{
+	return FindChild(rootEntity, id);
+}
+
+void Scene::renderDeferred(glm::mat4 view)
+{
+	MaterialLibrary* materials = engineManager->materialLibrary.get();
+	DeferredRenderer* deferred = engineManager->renderer->GetDeferred();
+
+	// same batches as forward, the g-buffer variants keep the feature order
+	deferred->beginGeometry();
+	std::shared_ptr<ShaderComponent> current = nullptr;
+	for (auto& batch : meshBatches)
+	{
+		if (batch.second.empty())
+		{
+			continue;
+		}
+		const std::shared_ptr<Material>& m = materials->GetMaterial(batch.first & 0xFFFFFFFF);
+		const std::shared_ptr<ShaderComponent>& sc = materials->GetGBufferShader(*m);
+		if (sc != current)
+		{
+			current = sc;
+			prepareShader(current, view, false);
+		}
+		materials->bind(m);
+		for (unsigned int i : batch.second)
+		{
+			meshes[i]->draw(view, current);
+		}
+	}
+	deferred->endGeometry();
+
+	// the lighting pass reuses the material units
+	materials->unbind();
+	deferred->light(view, sceneCamera->GetProjectionMatrix(), sceneCamera->attachedEntity->transform->position,
+		dirLightComponent, lightAssignment.GetNumLights(), activeShadows);
+}
+
+void Scene::prepareShader(std::shared_ptr<ShaderComponent> sc, glm::mat4 view, bool pointLightUniforms)
 {
-	// Diffuse
-	glActiveTexture(GL_TEXTURE0);
-	sc->shader->setIntID(sc->shader->textureIdMappings[TextureType::diffuse], 0);
-	glBindTexture(GL_TEXTURE_2D, engineManager->assetManager->defaultDiffuse->asset->t_Id);
-	// Normal
-	glActiveTexture(GL_TEXTURE1);
-	sc->shader->setIntID(sc->shader->textureIdMappings[TextureType::normal], 1);
-	glBindTexture(GL_TEXTURE_2D, engineManager->assetManager->defaultNormal->asset->t_Id);
-	// AO
-	glActiveTexture(GL_TEXTURE2);
-	sc->shader->setIntID(sc->shader->textureIdMappings[TextureType::ao], 2);
-	glBindTexture(GL_TEXTURE_2D, engineManager->assetManager->defaultAO->asset->t_Id);
-	// Roughness
-	glActiveTexture(GL_TEXTURE3);
-	sc->shader->setIntID(sc->shader->textureIdMappings[TextureType::roughness], 3);
-	glBindTexture(GL_TEXTURE_2D, engineManager->assetManager->defaultRoughness->asset->t_Id);
-	// metallic
-	glActiveTexture(GL_TEXTURE4);
-	sc->shader->setIntID(sc->shader->textureIdMappings[TextureType::metallic], 4);
-	glBindTexture(GL_TEXTURE_2D, engineManager->assetManager->defaultMetallic->asset->t_Id);
+	sc->shader->use();
+	sc->setProjection(sceneCamera->GetProjectionMatrix());
+	sc->setView(view);
+	sc->UpdateShader(view);
+	if (pointLightUniforms)
+	{
+		updateShaderComponentLightSources(sc);
+	}
+	else if (dirLightComponent != nullptr)
+	{
+		dirLightComponent->Bind(sc);
+	}
+	sc->shader->setVec3("viewPosition", sceneCamera->attachedEntity->transform->position);
+	if (activeShadows != nullptr)
+	{
+		activeShadows->setUniforms(sc->shader.get());
+	}
 }
 
 void childUi(std::shared_ptr<Entity> e, float deltaTime)
@@ -257,6 +445,42 @@ void Scene::updateDrawables()
 	animatedModels = FindComponentsInScene<AnimatedModelComponent>();
 	meshes = FindComponentsInScene<MeshComponent>();
 	particleSystems = FindComponentsInScene<ParticleSystemComponent>();
+
+	// materials are built here, once per texture set, rather than at draw time
+	for (auto& mesh : meshes)
+	{
+		if (mesh->mesh->material == nullptr)
+		{
+			mesh->mesh->material = engineManager->materialLibrary->get(mesh->mesh->textures);
+		}
+	}
+	engineManager->materialLibrary->packTextures();
+
+	updateStaticCasters();
+	if (dirLightComponent != nullptr)
+	{
+		dirLightComponent->invalidateShadows();
+	}
+}
+
+bool Scene::updateStaticCasters()
+{
+	bool changed = false;
+	for (auto& mesh : meshes)
+	{
+		// anything physics can move is drawn in to the shadow map every frame, the rest is cached
+		std::shared_ptr<RigidbodyComponent> rb = mesh->attachedEntity->GetComponent<RigidbodyComponent>();
+		bool isStatic = !(rb != nullptr && rb->getMass() > 0.0f);
+		glm::mat4 model = mesh->attachedEntity->transform->getModelMatrix();
+		// a static mesh that was moved by hand, or a mass change either way, leaves it in the cache where it was
+		if (isStatic != mesh->isStatic || (isStatic && model != mesh->cachedModel))
+		{
+			changed = true;
+		}
+		mesh->isStatic = isStatic;
+		mesh->cachedModel = model;
+	}
+	return changed;
 }
 
 void Scene::updateSceneLighting()
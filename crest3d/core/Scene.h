@@ -10,6 +10,17 @@
 #include "gfx/ShaderManager.h"
 #include "PhysicsManager.h"
 #include "components/ParticleSystemComponent.h"
+#include "gfx/LightAssignment.h"
+#include "gfx/CascadedShadowMap.h"
+#include "gfx/ParticleBudget.h"
+#include "gfx/DepthHistory.h"
+
+// how a scene lights its meshes. deferred pays off once there are lots of point lights
+enum RenderPath
+{
+	RENDER_FORWARD,
+	RENDER_DEFERRED
+};
 
 class Scene
 {
@@ -27,6 +38,11 @@ public:
 	void fixedUpdateBehaviour();
 	void updateBehaviour(float deltaTime);
 	void renderBehaviour(float deltaTime);
+	// every mesh and animated model's entity id + 1 in to the bound target's colour, 0 where there's nothing.
+	// read it back with ReadbackResult::GetID
+	void renderPicking();
+	// searches the whole hierarchy, null if no entity has the id
+	std::shared_ptr<Entity> FindEntity(unsigned int id);
 	void uiBehaviour(float deltaTime);
 
 
@@ -36,6 +52,9 @@ public:
 	void updateShaderLightSources(std::shared_ptr<Entity> e);
 	void updateShaderComponentLightSources(std::shared_ptr<ShaderComponent> sc);
 	void updateDrawables();
+	// works out which meshes are static again, true if one moved or changed between static and dynamic since
+	// the last call, leaving the shadow cache stale
+	bool updateStaticCasters();
 	void updateSceneLighting();
 	// the concept of a scene camera will die with renderer
 	// .. need a distinction between a real camera to be rendered.
@@ -56,9 +75,34 @@ public:
 	
 	
 	float DEBUG_SPHERE_RADIUS;
+	// falls back to forward if compute shaders aren't available
+	RenderPath renderPath;
+	// alpha blended particles through the TransparencyRenderer, unsorted, rather than depth sorted. additive ones
+	// are order independent already and always draw additive
+	bool orderIndependentTransparency;
+
+	inline LightAssignment& GetLightAssignment() { return lightAssignment; }
+	inline ParticleBudget& GetParticleBudget() { return particleBudget; }
+	inline DepthHistory& GetDepthHistory() { return depthHistory; }
 private:
 
 	
 	void updateLightComponentsVector(std::shared_ptr<Entity> e);
-	void bindDefaultTextures(std::shared_ptr<ShaderComponent> sc);
+	// use, camera and lights for a shader about to draw
+	// pointLightUniforms binds every light to the shader's pointLights array, the material shaders
+	// read them from the LightAssignment instead
+	void prepareShader(std::shared_ptr<ShaderComponent> sc, glm::mat4 view, bool pointLightUniforms = true);
+	// opaque meshes in to the g-buffer, then lit with every point light by the DeferredRenderer
+	void renderDeferred(glm::mat4 view);
+
+	// indices in to meshes by shader variant features then material id, rebuilt every frame but keeps its allocations
+	std::map<unsigned long long, std::vector<unsigned int>> meshBatches;
+	// point lights reaching each mesh
+	LightAssignment lightAssignment;
+	// shares particles out between the particle systems, and culls them
+	ParticleBudget particleBudget;
+	// the opaque depth, that particles fade against and, a frame later, collide with
+	DepthHistory depthHistory;
+	// the directional light's shadow map when it's rendered this frame
+	CascadedShadowMap* activeShadows;
 };
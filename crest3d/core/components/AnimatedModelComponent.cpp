@@ -28,6 +28,7 @@ void AnimatedModelComponent::getBoneShaderIDLocations(std::shared_ptr<ShaderComp
 		gPrevBoneShaderIDs.push_back(sc->shader->getMat4Location(currentBoneLocation.str()));
 		currentBoneLocation.clear();
 	}
+	boneLocationProgram = sc->shader->id;
 }
 
 void AnimatedModelComponent::init()
@@ -69,6 +70,10 @@ void AnimatedModelComponent::draw(glm::mat4 view, std::shared_ptr<ShaderComponen
 {
 	if (shouldDraw)
 	{
+		if (_shader->shader->id != boneLocationProgram)
+		{
+			getBoneShaderIDLocations(_shader);
+		}
 		for (int i = 0; i < anim->NumBones(); i++)
 		{
 			SetBoneTransformID(_shader, gBoneShaderIDs[i], boneTransforms[i]);
@@ -85,6 +90,20 @@ void AnimatedModelComponent::draw(glm::mat4 view, std::shared_ptr<ShaderComponen
 	}
 }
 
+void AnimatedModelComponent::drawDepth(std::shared_ptr<ShaderComponent> _shader)
+{
+	if (shouldDraw)
+	{
+		// the whole palette in one upload, and the cached per bone locations stay with the main shader
+		if (!boneTransforms.empty())
+		{
+			glUniformMatrix4fv(_shader->shader->getMat4Location("gBones"), boneTransforms.size(), GL_FALSE, glm::value_ptr(boneTransforms[0]));
+		}
+		_shader->UpdateModel(attachedEntity->transform->getModelMatrix());
+		anim->Draw(_shader);
+	}
+}
+
 void AnimatedModelComponent::SetBoneTransformID(std::shared_ptr<ShaderComponent> shader, unsigned id, glm::mat4 transform)
 {
 	shader->shader->setMat4ID(id, transform);
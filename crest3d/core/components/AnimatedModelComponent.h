@@ -15,6 +15,8 @@ public:
 	void render(float deltaTime, glm::mat4 view) override;
 	void ui(float deltaTime) override;
 	void draw(glm::mat4 view, std::shared_ptr<ShaderComponent> _shader);
+	// current pose for a depth only pass, leaves the motion blur history alone. view and projection are set by the caller
+	void drawDepth(std::shared_ptr<ShaderComponent> _shader);
 	void setShouldDraw(bool newValue) { shouldDraw = newValue; }
 
 	bool shouldDraw;
@@ -33,6 +35,8 @@ private:
 	static const int MAX_NUM_BONES = 250;
 	std::vector<unsigned int> gBoneShaderIDs;
 	std::vector<unsigned int> gPrevBoneShaderIDs;
+	// program the bone locations above were queried from, they change with the variant or a reload
+	unsigned int boneLocationProgram = 0;
 	std::vector<glm::mat4> boneTransforms;
 	std::vector<glm::mat4> previousBoneTransforms;
 };
\ No newline at end of file
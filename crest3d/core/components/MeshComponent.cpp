@@ -30,10 +30,34 @@ void MeshComponent::draw(glm::mat4 view, std::shared_ptr<ShaderComponent> _shade
 	if (shouldDraw)
 	{
 		_shader->UpdateModel(attachedEntity->transform->getModelMatrix());
-		mesh->Draw(_shader->shader);
+		// with a material the textures are already bound by the scene
+		if (mesh->material != nullptr)
+		{
+			mesh->DrawGeometry();
+		}
+		else
+		{
+			mesh->Draw(_shader->shader);
+		}
 	}
 }
 
+Bounds MeshComponent::getWorldBounds()
+{
+	// transform the box's centre and extents rather than all eight corners
+	glm::mat4 modelMatrix = attachedEntity->transform->getModelMatrix();
+	glm::vec3 centre = (mesh->boundsMin + mesh->boundsMax) * 0.5f;
+	glm::vec3 extent = (mesh->boundsMax - mesh->boundsMin) * 0.5f;
+	glm::mat3 absolute = glm::mat3(glm::abs(glm::vec3(modelMatrix[0])), glm::abs(glm::vec3(modelMatrix[1])), glm::abs(glm::vec3(modelMatrix[2])));
+	glm::vec3 worldCentre = glm::vec3(modelMatrix * glm::vec4(centre, 1.0f));
+	glm::vec3 worldExtent = absolute * extent;
+
+	Bounds b;
+	b.min = worldCentre - worldExtent;
+	b.max = worldCentre + worldExtent;
+	return b;
+}
+
 bool MeshComponent::isConvex(std::vector<glm::vec3> points, std::vector<unsigned int> triangles, float threshold = 0.001)
 {
 	for (unsigned long i = 0; i < triangles.size() / 3; i++)
@@ -30,6 +30,8 @@ public:;
 	  void ui(float deltaTime) override;
 	  void draw(glm::mat4 view, std::shared_ptr<ShaderComponent> _shader);
 	  void setShouldDraw(bool newValue) { shouldDraw = newValue; }
+	  // the mesh's bounds moved in to world space by the entity's transform
+	  Bounds getWorldBounds();
 
 	  bool meshIsConvex;
 	  // definitely can be changed to be unique
@@ -37,6 +39,10 @@ public:;
 	  std::shared_ptr<Model> model;
 	
 	  bool shouldDraw;
+	  // never moves, so it can be cached (in shadow maps). the scene clears it for meshes with a dynamic rigidbody
+	  bool isStatic = true;
+	  // the model matrix the shadow cache was last drawn with, see Scene::updateStaticCasters
+	  glm::mat4 cachedModel = glm::mat4(0.0f);
 private:
 	int i = 0;
 
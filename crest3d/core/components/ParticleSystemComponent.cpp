@@ -1,11 +1,19 @@
 #include "components/ParticleSystemComponent.h"
 #include "EngineManager.h"
+#include "Profiler.h"
+#include "serialization/Serializer.hpp"
+
+// how much faster than real time an emitter runs while it catches up
+static const float CATCH_UP_SPEED = 4.0f;
 
 ParticleSystemComponent::ParticleSystemComponent(std::shared_ptr<Entity> e)
 {
 	name = "ParticleSystemComponent";
 	attachedEntity = e;
 	particleSystem = std::make_shared<ParticleSystem>();
+	gpuSimulation = false;
+	priority = 1.0f;
+	skippedTime = 0.0f;
 }
 
 
@@ -29,30 +37,147 @@ void ParticleSystemComponent::earlyUpdate(float deltaTime)
 
 void ParticleSystemComponent::update(float deltaTime)
 {
+	Profiler::Scope scope("Particles", false);
 	particleSystem->position = attachedEntity->transform->position;
 	particleSystem->scale = attachedEntity->transform->scale;
-	particleSystem->update(deltaTime, cam);
+
+	// off screen emitters stand still. once back they run at up to CATCH_UP_SPEED times real time until
+	// they've made up what they missed, which never needs to be more than a particle's life
+	if (!budgetShare.visible)
+	{
+		skippedTime = std::min(skippedTime + deltaTime, particleSystem->emitter.lifetimeMax);
+		return;
+	}
+	float catchUp = std::min(skippedTime, deltaTime * (CATCH_UP_SPEED - 1.0f));
+	skippedTime -= catchUp;
+	float step = deltaTime + catchUp;
+	float spawnCapScale = deltaTime > 0.0f ? step / deltaTime : 1.0f;
+
+	if (gpuSimulation && gpuParticleSystem == nullptr)
+	{
+		if (GPUParticleSystem::IsSupported())
+		{
+			gpuParticleSystem = std::make_shared<GPUParticleSystem>(ParticleSystem::MIN_CAPACITY);
+		}
+		else
+		{
+			Debug::Warn<ParticleSystemComponent>("Compute shaders aren't supported, simulating particles on the cpu");
+			gpuSimulation = false;
+		}
+	}
+	if (gpuSimulation)
+	{
+		// sized for what the emitter keeps alive at its budgeted rate, with some room for catch up and bursts
+		gpuParticleSystem->fit((unsigned int)std::min(particleSystem->emitter.GetSteadyCount() * particleSystem->spawnScale * 1.25f, (float)ParticleSystem::MAX_PARTICLES));
+		gpuParticleSystem->update(step, particleSystem->position, glm::length(particleSystem->scale), particleSystem->emitter,
+			&attachedEntity->engineManager->scene->GetDepthHistory(), particleSystem->spawnScale, spawnCapScale);
+	}
+	else
+	{
+		particleSystem->update(step, cam, spawnCapScale);
+	}
 }
 
 void ParticleSystemComponent::ui(float deltaTime)
 {
-	
+	// every system shares the one window
+	if (ImGui::Begin("Particles"))
+	{
+		ImGui::PushID(this);
+		ImGui::Text("%s", attachedEntity->name.c_str());
+		ImGui::Checkbox("GPU Simulation", &gpuSimulation);
+		ImGui::DragFloat("Priority", &priority, 0.05f, 0.0f, 100.0f);
+		if (ImGui::TreeNode("Emitter"))
+		{
+			char pathBuffer[256];
+			strncpy(pathBuffer, emitterPath.c_str(), sizeof(pathBuffer) - 1);
+			pathBuffer[sizeof(pathBuffer) - 1] = '\0';
+			if (ImGui::InputText("File", pathBuffer, sizeof(pathBuffer)))
+			{
+				emitterPath = pathBuffer;
+			}
+			if (ImGui::Button("Reload"))
+			{
+				reload();
+			}
+			particleSystem->emitter.ui();
+			ImGui::TreePop();
+		}
+		if (gpuSimulation && gpuParticleSystem != nullptr)
+		{
+			gpuParticleSystem->ui();
+		}
+		else
+		{
+			particleSystem->ui();
+		}
+		ImGui::PopID();
+	}
+	ImGui::End();
+}
+
+tinyxml2::XMLElement* ParticleSystemComponent::serialize_component(tinyxml2::XMLDocument* doc)
+{
+	auto psElement = doc->NewElement("ParticleSystemComponent");
+	psElement->LinkEndChild(Serializer::SerializeString(emitterPath, "emitterPath", doc));
+	psElement->LinkEndChild(Serializer::SerializeBool(gpuSimulation, "gpuSimulation", doc));
+	psElement->LinkEndChild(Serializer::SerializeFloat(priority, "priority", doc));
+	psElement->LinkEndChild(particleSystem->emitter.serialize(doc));
+	return psElement;
 }
 
 void ParticleSystemComponent::deserialize_component(tinyxml2::XMLElement* e)
 {
-	
+	auto path = Serializer::FindElementInComponent(e, "String", "emitterPath");
+	if (path != nullptr && path->Attribute("value") != nullptr)
+	{
+		emitterPath = path->Attribute("value");
+	}
+	auto gpu = Serializer::FindElementInComponent(e, "Boolean", "gpuSimulation");
+	if (gpu != nullptr)
+	{
+		gpuSimulation = gpu->BoolAttribute("value");
+	}
+	auto p = Serializer::FindElementInComponent(e, "Float", "priority");
+	if (p != nullptr)
+	{
+		priority = Serializer::DeserializeFloat(p->Attribute("value"));
+	}
+	// a file wins over a copy saved in the scene, so editing it changes every scene that uses it
+	if (emitterPath.empty() || !particleSystem->emitter.load(emitterPath.c_str()))
+	{
+		auto emitter = e->FirstChildElement("ParticleEmitter");
+		if (emitter != nullptr)
+		{
+			particleSystem->emitter.deserialize(emitter);
+		}
+	}
 }
 
 
 void ParticleSystemComponent::reload()
 {
-	
+	if (!emitterPath.empty())
+	{
+		particleSystem->emitter.load(emitterPath.c_str());
+	}
 }
 
 void ParticleSystemComponent::draw(float deltaTime, glm::mat4 view, std::shared_ptr<ShaderComponent> _shader)
 {
-	particleSystem->render(deltaTime, cam, _shader->shader);
+	if (!budgetShare.visible)
+	{
+		return;
+	}
+	_shader->shader->setFloat("softDistance", particleSystem->emitter.softDistance);
+	if (gpuSimulation && gpuParticleSystem != nullptr)
+	{
+		gpuParticleSystem->render(cam, _shader->shader, particleSystem->texture);
+	}
+	else
+	{
+		particleSystem->render(deltaTime, cam, _shader->shader);
+	}
 }
 
 
@@ -1,7 +1,9 @@
 #pragma once
 #include "components/EngineComponent.h"
 #include "gfx/ParticleSystem.h"
+#include "gfx/GPUParticleSystem.h"
 #include "components/ShaderComponent.h"
+#include "gfx/ParticleBudget.h"
 
 class ParticleSystemComponent : public EngineComponent
 {
@@ -16,11 +18,26 @@ public:
 	void ui(float deltaTime) override;
 	void draw(float deltaTime, glm::mat4 view, std::shared_ptr<ShaderComponent> _shader);
 
+	// loads the emitter from emitterPath again
 	void reload();
 
 	std::shared_ptr<ParticleSystem> particleSystem;
+	// simulated and drawn by compute shaders instead, made on first use. falls back to the cpu where compute isn't supported
+	bool gpuSimulation;
+	std::shared_ptr<GPUParticleSystem> gpuParticleSystem;
 	std::shared_ptr<Texture> texture;
 	std::shared_ptr<CameraComponent> cam;
+	// weights this emitter's share of the ParticleBudget
+	float priority;
+	// written by the ParticleBudget before update
+	ParticleBudgetShare budgetShare;
+	// an xml file with a ParticleEmitter, empty keeps the built in fountain
+	std::string emitterPath;
+	tinyxml2::XMLElement* serialize_component(tinyxml2::XMLDocument* doc) override;
 	void deserialize_component(tinyxml2::XMLElement* e) override;
 
+private:
+	// time missed while off screen, caught up on a few frames at a time once it's back
+	float skippedTime;
+
 };
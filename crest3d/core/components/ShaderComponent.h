@@ -17,11 +17,32 @@ public:
 		view = glm::mat4(1.0);
 		projection = glm::mat4(1.0);
 
+		refreshLocations();
+	};
+
+	// a permutation of the shader, see ShaderVariants
+	ShaderComponent(std::shared_ptr<Entity> e, const char* vertexPath, const char* fragPath, const std::vector<std::string>& defines)
+	{
+		name = "ShaderComponent";
+		_vertexPath = vertexPath;
+		_fragPath = fragPath;
+		attachedEntity = std::shared_ptr<Entity>(e);
+		shader = std::shared_ptr<Shader>(new Shader(vertexPath, fragPath, defines));
+		view = glm::mat4(1.0);
+		projection = glm::mat4(1.0);
+
+		refreshLocations();
+	};
+
+	// re-query cached uniform locations, needed whenever the program changes (hot reload)
+	inline void refreshLocations()
+	{
 		modelId = shader->getMat4Location("model");
 		viewId = shader->getMat4Location("view");
 		projectionId = shader->getMat4Location("projection");
 		numPointLightsId = shader->getIntLocation("numPointLights");
-	};
+		lightIndicesId = shader->getIntLocation("lightIndices");
+	}
 
 	inline void UpdateShader(glm::mat4 modelMatrix)
 	{
@@ -50,6 +71,16 @@ public:
 		shader->setIntID(numPointLightsId, numPointLights);
 	}
 
+	// the point lights reaching this draw, as indices in to the LightAssignment buffer
+	inline void SetLightIndices(const int* indices, unsigned int count)
+	{
+		if (count > 0)
+		{
+			glUniform1iv(lightIndicesId, count, indices);
+		}
+		shader->setIntID(numPointLightsId, count);
+	}
+
 	tinyxml2::XMLElement* serialize_component(tinyxml2::XMLDocument* doc) override
 	{
 		auto scElement = doc->NewElement("ShaderComponent");
@@ -68,4 +99,5 @@ public:
 	std::string _vertexPath, _fragPath;
 	unsigned int modelId, projectionId, viewId;
 	unsigned int numPointLightsId;
+	unsigned int lightIndicesId;
 };
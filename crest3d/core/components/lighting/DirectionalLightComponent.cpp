@@ -1,5 +1,6 @@
 #include "components/lighting/DirectionalLightComponent.h"
 #include "Entity.h"
+#include "gfx/CascadedShadowMap.h"
 #include "serialization/Serializer.hpp"
 
 float clampAngle(float input)
@@ -55,6 +56,7 @@ DirectionalLightComponent::DirectionalLightComponent(std::shared_ptr<Entity> e,
 	this->ambient = ambient;
 	this->diffuse = diffuse;
 	this->specular = specular;
+	castShadows = true;
 }
 
 DirectionalLightComponent::DirectionalLightComponent(std::shared_ptr<Entity> e)
@@ -65,6 +67,24 @@ DirectionalLightComponent::DirectionalLightComponent(std::shared_ptr<Entity> e)
 	this->ambient = glm::vec3(0.3f);
 	this->diffuse = glm::vec3(1.0f);
 	this->specular = glm::vec3(0.2f);
+	castShadows = true;
+}
+
+CascadedShadowMap* DirectionalLightComponent::GetShadows()
+{
+	if (shadows == nullptr)
+	{
+		shadows = std::make_shared<CascadedShadowMap>();
+	}
+	return shadows.get();
+}
+
+void DirectionalLightComponent::invalidateShadows()
+{
+	if (shadows != nullptr)
+	{
+		shadows->invalidate();
+	}
 }
 
 tinyxml2::XMLElement* DirectionalLightComponent::serialize_component(tinyxml2::XMLDocument* doc)
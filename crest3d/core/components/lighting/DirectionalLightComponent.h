@@ -3,6 +3,8 @@
 #include "components/lighting/LightComponent.h"
 #include "components/ShaderComponent.h"
 
+class CascadedShadowMap;
+
 class DirectionalLightComponent : public LightComponent
 {
 public:
@@ -19,4 +21,13 @@ public:
 	glm::vec3 ambient;
 	glm::vec3 diffuse;
 	glm::vec3 specular;
+
+	bool castShadows;
+	// created the first time it's asked for
+	CascadedShadowMap* GetShadows();
+	// static casters moved or changed, redraw the cached cascades
+	void invalidateShadows();
+
+private:
+	std::shared_ptr<CascadedShadowMap> shadows;
 };
\ No newline at end of file
@@ -360,11 +360,6 @@ int AnimatedModel::TextureFromFile(char const* path, const std::string& director
 	glGenTextures(1, &id);
 
 	glBindTexture(GL_TEXTURE_2D, id);
-	// set the texture wrapping/filtering options (on the currently bound texture object)
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	// load and generate the texture
 	int width, height, nrChannels;
 	stbi_set_flip_vertically_on_load(false);
@@ -393,6 +388,7 @@ int AnimatedModel::TextureFromFile(char const* path, const std::string& director
 		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
 		glGenerateMipmap(GL_TEXTURE_2D);
 
+		// only for code that samples without a sampler object bound, materials use SamplerCache
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -416,11 +412,6 @@ int AnimatedModel::EmbeddedTexture(int index)
 	glGenTextures(1, &id);
 
 	glBindTexture(GL_TEXTURE_2D, id);
-	// set the texture wrapping/filtering options (on the currently bound texture object)
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	// load and generate the texture
 	int width, height, nrChannels;
 
@@ -434,6 +425,7 @@ int AnimatedModel::EmbeddedTexture(int index)
 	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
 	glGenerateMipmap(GL_TEXTURE_2D);
 
+	// only for code that samples without a sampler object bound, materials use SamplerCache
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -481,12 +473,12 @@ void AnimatedModel::Draw(std::shared_ptr<ShaderComponent> shader)
 	for (unsigned int i = 0; i < m_Entries.size(); i++) {
 		const unsigned int MaterialIndex = m_Entries[i].MaterialIndex;
 
+		// the diffuse sampler is fixed to its material unit, see MaterialSlot
 		for (unsigned int j = 0; j < m_Entries[i].Textures.size(); j++)
 		{
-			glActiveTexture(GL_TEXTURE0 + i);
 			if (m_Entries[i].Textures[j].t_Type == TextureType::diffuse)
 			{
-				shader->shader->setInt("mat.m_Diffuse", i);
+				glActiveTexture(GL_TEXTURE0 + MATERIAL_DIFFUSE);
 				glBindTexture(GL_TEXTURE_2D, m_Entries[i].Textures[j].t_Id);
 			}
 		}
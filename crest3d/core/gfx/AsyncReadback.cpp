@@ -0,0 +1,335 @@
+#include "AsyncReadback.h"
+#include "Debug.h"
+#include <iomanip>
+#include <filesystem>
+
+glm::vec4 ReadbackResult::GetColor(int x, int y)
+{
+	if (depth || x < 0 || y < 0 || x >= width || y >= height)
+	{
+		return glm::vec4(0.0f);
+	}
+	unsigned char* p = &data[(y * width + x) * 4];
+	return glm::vec4(p[0], p[1], p[2], p[3]) / 255.0f;
+}
+
+unsigned int ReadbackResult::GetID(int x, int y)
+{
+	if (depth || x < 0 || y < 0 || x >= width || y >= height)
+	{
+		return 0;
+	}
+	unsigned char* p = &data[(y * width + x) * 4];
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+float ReadbackResult::GetDepth(int x, int y)
+{
+	if (!depth || x < 0 || y < 0 || x >= width || y >= height)
+	{
+		return 1.0f;
+	}
+	float d;
+	memcpy(&d, &data[(y * width + x) * sizeof(float)], sizeof(float));
+	return d;
+}
+
+AsyncReadback::AsyncReadback()
+{
+	numPending = 0;
+	captureTarget = nullptr;
+	captureFramesLeft = 0;
+	captureFrame = 0;
+	captureSkipped = 0;
+	numQueuedWrites = 0;
+	stopWriter = false;
+
+	for (int i = 0; i < NUM_SLOTS; i++)
+	{
+		glGenBuffers(1, &slots[i].pbo);
+	}
+
+	writer = std::thread(&AsyncReadback::writerLoop, this);
+}
+
+AsyncReadback::~AsyncReadback()
+{
+	release();
+}
+
+void AsyncReadback::release()
+{
+	if (writer.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(writeMutex);
+			stopWriter = true;
+		}
+		writeReady.notify_all();
+		// finishes whatever is still queued first
+		writer.join();
+	}
+
+	for (int i = 0; i < NUM_SLOTS; i++)
+	{
+		if (slots[i].fence != nullptr)
+		{
+			glDeleteSync(slots[i].fence);
+			slots[i].fence = nullptr;
+		}
+		if (slots[i].pbo != 0)
+		{
+			glDeleteBuffers(1, &slots[i].pbo);
+			slots[i].pbo = 0;
+		}
+		slots[i].callback = nullptr;
+	}
+	numPending = 0;
+	captureFramesLeft = 0;
+}
+
+bool AsyncReadback::request(FrameBuffer* fb, bool depth, std::function<void(ReadbackResult&)> callback)
+{
+	if (fb == nullptr)
+	{
+		return false;
+	}
+	return request(fb, depth, 0, 0, fb->GetRenderWidth(), fb->GetRenderHeight(), callback);
+}
+
+bool AsyncReadback::request(FrameBuffer* fb, bool depth, int x, int y, int width, int height, std::function<void(ReadbackResult&)> callback)
+{
+	if (fb == nullptr || width <= 0 || height <= 0)
+	{
+		return false;
+	}
+
+	Slot* slot = nullptr;
+	for (int i = 0; i < NUM_SLOTS; i++)
+	{
+		if (slots[i].fence == nullptr)
+		{
+			slot = &slots[i];
+			break;
+		}
+	}
+	if (slot == nullptr)
+	{
+		// everything is still in flight, waiting here would be the stall we are trying to avoid
+		Debug::Warn<AsyncReadback>("All readback slots in use, dropping request");
+		return false;
+	}
+
+	size_t size = (size_t)width * height * (depth ? sizeof(float) : 4);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+	if (slot->capacity < size)
+	{
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+		slot->capacity = size;
+	}
+
+	// the resolved (non multisampled) fbo, so this works for MSAA targets too
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fb->GetFBO());
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	if (depth)
+	{
+		glReadPixels(x, y, width, height, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+	}
+	else
+	{
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	}
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot->result.width = width;
+	slot->result.height = height;
+	slot->result.depth = depth;
+	slot->callback = callback;
+	numPending++;
+	return true;
+}
+
+bool AsyncReadback::requestPixel(FrameBuffer* fb, int x, int y, std::function<void(glm::vec4, float)> callback)
+{
+	// half a result would report a colour that was never read
+	if (fb == nullptr || GetNumFreeSlots() < 2)
+	{
+		Debug::Warn<AsyncReadback>("Not enough free readback slots, dropping pixel request");
+		return false;
+	}
+	// colour and depth arrive separately, hand them over together once both are back
+	auto colour = std::make_shared<glm::vec4>(0.0f);
+	request(fb, false, x, y, 1, 1, [colour](ReadbackResult& r) {
+		*colour = r.GetColor(0, 0);
+	});
+	request(fb, true, x, y, 1, 1, [colour, callback](ReadbackResult& r) {
+		callback(*colour, r.GetDepth(0, 0));
+	});
+	return true;
+}
+
+bool AsyncReadback::screenshot(FrameBuffer* fb, const std::string& path)
+{
+	return request(fb, false, [this, path](ReadbackResult& r) {
+		{
+			std::lock_guard<std::mutex> lock(writeMutex);
+			writeQueue.push({ path, std::move(r) });
+			numQueuedWrites++;
+		}
+		writeReady.notify_one();
+	});
+}
+
+void AsyncReadback::startCapture(FrameBuffer* fb, unsigned int numFrames, const std::string& directory)
+{
+	captureTarget = fb;
+	captureFramesLeft = numFrames;
+	captureFrame = 0;
+	captureSkipped = 0;
+	captureDirectory = directory;
+
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+	if (error)
+	{
+		std::string m = "Could not create capture directory " + directory + ": " + error.message();
+		Debug::Error<AsyncReadback>(m.c_str());
+		captureFramesLeft = 0;
+		return;
+	}
+	std::string m = "Capturing " + std::to_string(numFrames) + " frames to " + directory;
+	Debug::Log<AsyncReadback>(m.c_str());
+}
+
+void AsyncReadback::update()
+{
+	// slots are checked in slot order, not request order, but slots from the same frame signal together
+	for (int i = 0; i < NUM_SLOTS; i++)
+	{
+		Slot& slot = slots[i];
+		if (slot.fence == nullptr)
+		{
+			continue;
+		}
+
+		// zero timeout, just poll
+		GLenum status = glClientWaitSync(slot.fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+		{
+			continue;
+		}
+		glDeleteSync(slot.fence);
+		slot.fence = nullptr;
+		numPending--;
+
+		size_t size = (size_t)slot.result.width * slot.result.height * (slot.result.depth ? sizeof(float) : 4);
+		slot.result.data.resize(size);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+		void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+		if (mapped != nullptr)
+		{
+			memcpy(slot.result.data.data(), mapped, size);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		if (mapped == nullptr)
+		{
+			Debug::Error<AsyncReadback>("Failed to map readback buffer");
+			continue;
+		}
+		if (slot.callback)
+		{
+			slot.callback(slot.result);
+		}
+	}
+
+	// one read per frame while a capture is running
+	if (captureFramesLeft > 0 && captureTarget != nullptr)
+	{
+		std::stringstream path;
+		path << captureDirectory << "/frame_" << std::setw(5) << std::setfill('0') << captureFrame << ".tga";
+		if (!screenshot(captureTarget, path.str()))
+		{
+			captureSkipped++;
+			return;
+		}
+		captureFrame++;
+		captureFramesLeft--;
+		if (captureFramesLeft == 0)
+		{
+			std::string m = "Capture finished";
+			if (captureSkipped > 0)
+			{
+				m += ", " + std::to_string(captureSkipped) + " rendered frames were skipped waiting for a free slot";
+			}
+			Debug::Log<AsyncReadback>(m.c_str());
+		}
+	}
+}
+
+void AsyncReadback::writerLoop()
+{
+	while (true)
+	{
+		WriteJob job;
+		{
+			std::unique_lock<std::mutex> lock(writeMutex);
+			writeReady.wait(lock, [this] { return stopWriter || !writeQueue.empty(); });
+			if (writeQueue.empty())
+			{
+				return;
+			}
+			job = std::move(writeQueue.front());
+			writeQueue.pop();
+		}
+
+		// the console isn't thread safe, so failures only go to stdout from here
+		if (!WriteTGA(job.path, job.result))
+		{
+			std::cout << "AsyncReadback: failed to write " << job.path << std::endl;
+		}
+		numQueuedWrites--;
+	}
+}
+
+bool AsyncReadback::WriteTGA(const std::string& path, ReadbackResult& result)
+{
+	std::ofstream out(path.c_str(), std::ios::binary);
+	if (!out.good())
+	{
+		return false;
+	}
+
+	// uncompressed true colour, origin bottom left which matches gl's row order
+	unsigned char header[18] = { 0 };
+	header[2] = 2;
+	header[12] = result.width & 0xFF;
+	header[13] = (result.width >> 8) & 0xFF;
+	header[14] = result.height & 0xFF;
+	header[15] = (result.height >> 8) & 0xFF;
+	header[16] = 32;
+	header[17] = 8;
+	out.write((char*)header, sizeof(header));
+
+	// RGBA -> BGRA
+	std::vector<unsigned char> pixels(result.data.size());
+	for (size_t i = 0; i + 3 < result.data.size(); i += 4)
+	{
+		pixels[i + 0] = result.data[i + 2];
+		pixels[i + 1] = result.data[i + 1];
+		pixels[i + 2] = result.data[i + 0];
+		pixels[i + 3] = result.data[i + 3];
+	}
+	out.write((char*)pixels.data(), pixels.size());
+	out.close();
+	return out.good();
+}
+
+void AsyncReadback::ui()
+{
+	ImGui::Text("Readbacks in flight: %u, files queued: %u", GetNumPending(), GetNumQueuedWrites());
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "Common.h"
+#include "FrameBuffer.h"
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <atomic>
+
+// pixels copied out of a framebuffer, rows are bottom to top as gl gives them to us
+struct ReadbackResult
+{
+	int width, height;
+	bool depth; // one float per pixel if true, otherwise RGBA8
+	std::vector<unsigned char> data;
+
+	glm::vec4 GetColor(int x, int y);
+	// the four colour bytes as one little endian number, for id targets
+	unsigned int GetID(int x, int y);
+	float GetDepth(int x, int y);
+};
+
+// reads framebuffers back in to cpu memory without stalling the pipeline.
+// glReadPixels goes in to a pixel buffer object guarded by a fence, the result is mapped a few frames later
+// once the fence has signalled. files are written on a worker thread so the render thread never touches the disk.
+class AsyncReadback
+{
+public:
+	AsyncReadback();
+	~AsyncReadback();
+
+	// queue a copy of the drawn region of fb, callback runs on the render thread from update()
+	bool request(FrameBuffer* fb, bool depth, std::function<void(ReadbackResult&)> callback);
+	bool request(FrameBuffer* fb, bool depth, int x, int y, int width, int height, std::function<void(ReadbackResult&)> callback);
+	// single pixel colour and depth. both reads are queued or neither, false if there weren't two free slots
+	bool requestPixel(FrameBuffer* fb, int x, int y, std::function<void(glm::vec4, float)> callback);
+
+	// save the next frame of fb as a .tga
+	// false if no slot was free, nothing is saved then
+	bool screenshot(FrameBuffer* fb, const std::string& path);
+	// save the next n frames of fb as numbered .tga files in directory. fb is read every frame, so it has to be
+	// a marked pipeline output, which keeps its framebuffer when the graph recompiles
+	void startCapture(FrameBuffer* fb, unsigned int numFrames, const std::string& directory);
+	inline bool IsCapturing() { return captureFramesLeft > 0; }
+
+	// call once a frame after rendering, issues capture reads and hands finished reads to their callbacks
+	void update();
+	// finishes queued writes and frees the pixel buffers, the destructor does this if it hasn't been called
+	void release();
+
+	inline unsigned int GetNumPending() { return numPending; }
+	inline unsigned int GetNumQueuedWrites() { return numQueuedWrites; }
+
+	void ui();
+
+private:
+	static const int NUM_SLOTS = 8;
+	struct Slot
+	{
+		unsigned int pbo = 0;
+		size_t capacity = 0;
+		GLsync fence = nullptr;
+		ReadbackResult result;
+		std::function<void(ReadbackResult&)> callback;
+	};
+	Slot slots[NUM_SLOTS];
+	unsigned int numPending;
+	inline unsigned int GetNumFreeSlots() { return NUM_SLOTS - numPending; }
+
+	FrameBuffer* captureTarget;
+	unsigned int captureFramesLeft, captureFrame;
+	// frames that found every slot busy, the same file is tried again the frame after
+	unsigned int captureSkipped;
+	std::string captureDirectory;
+
+	// disk writer
+	struct WriteJob
+	{
+		std::string path;
+		ReadbackResult result;
+	};
+	void writerLoop();
+	static bool WriteTGA(const std::string& path, ReadbackResult& result);
+
+	std::thread writer;
+	std::mutex writeMutex;
+	std::condition_variable writeReady;
+	std::queue<WriteJob> writeQueue;
+	std::atomic<unsigned int> numQueuedWrites;
+	bool stopWriter;
+};
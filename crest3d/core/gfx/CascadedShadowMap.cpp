@@ -0,0 +1,333 @@
+#include "CascadedShadowMap.h"
+#include "components/MeshComponent.h"
+#include "components/AnimatedModelComponent.h"
+#include "Debug.h"
+
+CascadedShadowMap::CascadedShadowMap()
+{
+	numCascades = 4;
+	splitLambda = 0.8f;
+	maxDistance = 80.0f;
+	resolution = 2048;
+
+	staticMap = shadowMap = 0;
+	fbo = copyFbo = 0;
+	allocatedResolution = 0;
+	staticOnly = true;
+	numCacheUpdates = 0;
+	for (auto& c : cascades)
+	{
+		c = Cascade();
+		c.valid = false;
+	}
+
+	// depth only, the fragment stage does nothing
+	meshShader = std::make_shared<ShaderComponent>(nullptr, "res/shaders/pbr.vert", "res/shaders/shadow.frag");
+	animShader = std::make_shared<ShaderComponent>(nullptr, "res/shaders/anim.vert", "res/shaders/shadow.frag");
+}
+
+CascadedShadowMap::~CascadedShadowMap()
+{
+	unsigned int textures[2] = { staticMap, shadowMap };
+	glDeleteTextures(2, textures);
+	unsigned int framebuffers[2] = { fbo, copyFbo };
+	glDeleteFramebuffers(2, framebuffers);
+}
+
+static unsigned int MakeShadowArray(int resolution)
+{
+	unsigned int t;
+	glGenTextures(1, &t);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, t);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, resolution, resolution, MAX_CASCADES, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+	// hardware compare with bilinear filtering, outside the map is lit
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	float border[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	return t;
+}
+
+void CascadedShadowMap::allocate()
+{
+	if (fbo != 0)
+	{
+		unsigned int textures[2] = { staticMap, shadowMap };
+		glDeleteTextures(2, textures);
+	}
+	else
+	{
+		glGenFramebuffers(1, &fbo);
+		glGenFramebuffers(1, &copyFbo);
+	}
+	staticMap = MakeShadowArray(resolution);
+	shadowMap = MakeShadowArray(resolution);
+	allocatedResolution = resolution;
+	invalidate();
+}
+
+void CascadedShadowMap::invalidate()
+{
+	for (auto& c : cascades)
+	{
+		c.valid = false;
+	}
+}
+
+void CascadedShadowMap::fit(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& lightDirection)
+{
+	// the camera's clip planes, straight from its projection
+	float nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+	float farPlane = std::min(projection[3][2] / (projection[2][2] + 1.0f), maxDistance);
+	glm::mat4 inverseViewProjection = glm::inverse(projection * view);
+	auto ndcDepth = [&](float distance)
+	{
+		glm::vec4 clip = projection * glm::vec4(0.0f, 0.0f, -distance, 1.0f);
+		return clip.z / clip.w;
+	};
+
+	glm::vec3 direction = glm::normalize(lightDirection);
+	glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), direction, up);
+	glm::mat4 inverseLightRotation = glm::inverse(lightRotation);
+
+	float previousSplit = nearPlane;
+	for (int i = 0; i < numCascades; i++)
+	{
+		Cascade& c = cascades[i];
+		float t = (float)(i + 1) / numCascades;
+		float logSplit = nearPlane * std::pow(farPlane / nearPlane, t);
+		float uniformSplit = nearPlane + (farPlane - nearPlane) * t;
+		c.split = glm::mix(uniformSplit, logSplit, splitLambda);
+
+		// bounding sphere of the slice, its size doesn't change as the camera turns
+		glm::vec3 corners[8];
+		glm::vec3 centre = glm::vec3(0.0f);
+		for (int corner = 0; corner < 8; corner++)
+		{
+			glm::vec4 ndc = glm::vec4(corner & 1 ? 1.0f : -1.0f, corner & 2 ? 1.0f : -1.0f, ndcDepth(corner & 4 ? c.split : previousSplit), 1.0f);
+			glm::vec4 world = inverseViewProjection * ndc;
+			corners[corner] = glm::vec3(world) / world.w;
+			centre += corners[corner] / 8.0f;
+		}
+		float radius = 0.0f;
+		for (auto& corner : corners)
+		{
+			radius = std::max(radius, glm::length(corner - centre));
+		}
+		radius = std::ceil(radius);
+
+		// snap the centre to a grid a quarter of the cascade across, and grow the box by that much so
+		// the slice is always covered. the matrices, and so the cache, only change when the grid cell does
+		float snap = std::max(std::ceil(radius * 0.25f), 1.0f);
+		c.halfSize = radius + snap;
+		c.texelSize = c.halfSize * 2.0f / allocatedResolution;
+		glm::vec3 lightSpace = glm::vec3(lightRotation * glm::vec4(centre, 1.0f));
+		lightSpace = glm::floor(lightSpace / snap) * snap;
+		glm::vec3 snappedCentre = glm::vec3(inverseLightRotation * glm::vec4(lightSpace, 1.0f));
+
+		// reaches back past the slice so casters between the light and the camera are kept
+		c.depthRange = c.halfSize + maxDistance;
+		glm::mat4 cascadeView = glm::lookAt(snappedCentre - direction * c.depthRange, snappedCentre, up);
+		glm::mat4 cascadeProjection = glm::ortho(-c.halfSize, c.halfSize, -c.halfSize, c.halfSize, 0.0f, c.depthRange * 2.0f);
+		if (cascadeView != c.view || cascadeProjection != c.projection)
+		{
+			c.view = cascadeView;
+			c.projection = cascadeProjection;
+			c.valid = false;
+		}
+		previousSplit = c.split;
+	}
+}
+
+bool CascadedShadowMap::overlaps(const Cascade& c, const Bounds& b)
+{
+	glm::vec3 centre = glm::vec3(c.view * glm::vec4((b.min + b.max) * 0.5f, 1.0f));
+	glm::vec3 extent = (b.max - b.min) * 0.5f;
+	glm::mat3 absolute = glm::mat3(glm::abs(glm::vec3(c.view[0])), glm::abs(glm::vec3(c.view[1])), glm::abs(glm::vec3(c.view[2])));
+	extent = absolute * extent;
+
+	// depth clamp keeps anything in front of the near plane, so only the far side culls
+	return centre.x + extent.x >= -c.halfSize && centre.x - extent.x <= c.halfSize
+		&& centre.y + extent.y >= -c.halfSize && centre.y - extent.y <= c.halfSize
+		&& centre.z + extent.z >= -c.depthRange * 2.0f;
+}
+
+void CascadedShadowMap::attach(unsigned int texture, unsigned int layer)
+{
+	glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+}
+
+void CascadedShadowMap::render(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& lightDirection,
+	const std::vector<std::shared_ptr<MeshComponent>>& meshes, const std::vector<std::shared_ptr<AnimatedModelComponent>>& animatedModels)
+{
+	numCascades = glm::clamp(numCascades, 1, (int)MAX_CASCADES);
+	if (resolution != allocatedResolution)
+	{
+		allocate();
+	}
+	fit(view, projection, lightDirection);
+
+	int previousFramebuffer = 0, previousReadFramebuffer = 0;
+	int viewport[4];
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousReadFramebuffer);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+	glDrawBuffer(GL_NONE);
+	glViewport(0, 0, resolution, resolution);
+	glEnable(GL_DEPTH_CLAMP);
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(1.5f, 4.0f);
+
+	// static casters, only for cascades whose cache is stale
+	meshShader->shader->use();
+	numCacheUpdates = 0;
+	for (int i = 0; i < numCascades; i++)
+	{
+		Cascade& c = cascades[i];
+		if (c.valid)
+		{
+			continue;
+		}
+		attach(staticMap, i);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		meshShader->setView(c.view);
+		meshShader->setProjection(c.projection);
+		meshShader->UpdateShader(glm::mat4(1.0f));
+		c.numStatic = 0;
+		for (auto& mesh : meshes)
+		{
+			if (mesh->isStatic && mesh->shouldDraw && overlaps(c, mesh->getWorldBounds()))
+			{
+				mesh->draw(c.view, meshShader);
+				c.numStatic++;
+			}
+		}
+		c.valid = true;
+		numCacheUpdates++;
+	}
+
+	for (auto& c : cascades)
+	{
+		c.numDynamic = 0;
+	}
+	bool hasDynamic = !animatedModels.empty();
+	for (auto& mesh : meshes)
+	{
+		hasDynamic = hasDynamic || (!mesh->isStatic && mesh->shouldDraw);
+	}
+	staticOnly = !hasDynamic;
+
+	if (hasDynamic)
+	{
+		// start from the cache
+		if (GLEW_ARB_copy_image)
+		{
+			glCopyImageSubData(staticMap, GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, shadowMap, GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, resolution, resolution, numCascades);
+		}
+		else
+		{
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, copyFbo);
+			for (int i = 0; i < numCascades; i++)
+			{
+				glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticMap, 0, i);
+				attach(shadowMap, i);
+				glBlitFramebuffer(0, 0, resolution, resolution, 0, 0, resolution, resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+			}
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, previousReadFramebuffer);
+		}
+
+		for (int i = 0; i < numCascades; i++)
+		{
+			Cascade& c = cascades[i];
+			attach(shadowMap, i);
+
+			meshShader->shader->use();
+			meshShader->setView(c.view);
+			meshShader->setProjection(c.projection);
+			meshShader->UpdateShader(glm::mat4(1.0f));
+			for (auto& mesh : meshes)
+			{
+				if (!mesh->isStatic && mesh->shouldDraw && overlaps(c, mesh->getWorldBounds()))
+				{
+					mesh->draw(c.view, meshShader);
+					c.numDynamic++;
+				}
+			}
+
+			// no bounds for skinned models yet, they go in every cascade
+			if (!animatedModels.empty())
+			{
+				animShader->shader->use();
+				animShader->setView(c.view);
+				animShader->setProjection(c.projection);
+				animShader->UpdateShader(glm::mat4(1.0f));
+				for (auto& anim : animatedModels)
+				{
+					anim->drawDepth(animShader);
+					c.numDynamic++;
+				}
+			}
+		}
+	}
+
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	glDisable(GL_DEPTH_CLAMP);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousFramebuffer);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void CascadedShadowMap::bindTexture()
+{
+	glActiveTexture(GL_TEXTURE0 + SHADOW_MAP_UNIT);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, staticOnly ? staticMap : shadowMap);
+	glBindSampler(SHADOW_MAP_UNIT, 0);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void CascadedShadowMap::setUniforms(Shader* shader)
+{
+	glm::vec4 splits = glm::vec4(0.0f);
+	glm::vec4 normalBias = glm::vec4(0.0f);
+	for (int i = 0; i < numCascades; i++)
+	{
+		shader->setMat4("cascadeMatrices[" + std::to_string(i) + "]", cascades[i].projection * cascades[i].view);
+		splits[i] = cascades[i].split;
+		// a texel and a half along the normal hides most acne without visible peter panning
+		normalBias[i] = cascades[i].texelSize * 1.5f;
+	}
+	shader->setInt("numCascades", numCascades);
+	shader->setVec4("cascadeSplits", splits);
+	shader->setVec4("cascadeNormalBias", normalBias);
+}
+
+size_t CascadedShadowMap::GetMemoryUsage()
+{
+	// two 32 bit depth arrays
+	return (size_t)allocatedResolution * allocatedResolution * MAX_CASCADES * 4 * 2;
+}
+
+void CascadedShadowMap::ui()
+{
+	ImGui::SliderInt("Cascades", &numCascades, 1, MAX_CASCADES);
+	ImGui::SliderFloat("Split Lambda", &splitLambda, 0.0f, 1.0f);
+	ImGui::SliderFloat("Shadow Distance", &maxDistance, 10.0f, 500.0f);
+	const char* resolutions[] = { "1024", "2048", "4096" };
+	int current = resolution >= 4096 ? 2 : (resolution >= 2048 ? 1 : 0);
+	if (ImGui::Combo("Shadow Resolution", &current, resolutions, 3))
+	{
+		resolution = 1024 << current;
+	}
+	ImGui::Text("%.1f MB, %u cascades redrawn last frame", GetMemoryUsage() / (1024.0f * 1024.0f), numCacheUpdates);
+	for (int i = 0; i < numCascades; i++)
+	{
+		ImGui::Text("Cascade %d: to %.1f, %u static %u dynamic casters", i, cascades[i].split, cascades[i].numStatic, cascades[i].numDynamic);
+	}
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "Common.h"
+#include "components/ShaderComponent.h"
+#include "gfx/Mesh.h"
+
+class MeshComponent;
+class AnimatedModelComponent;
+
+static const unsigned int MAX_CASCADES = 4;
+// texture unit the shadow map is sampled from, after the MaterialSlots
+static const unsigned int SHADOW_MAP_UNIT = 5;
+
+// cascaded shadow maps for the directional light. static meshes are rendered in to a cached copy of each
+// cascade that is only redrawn when the cascade moves, the light turns or the static set changes. cascades are
+// snapped to a coarse grid in light space (and grown to cover the snap) so they only move every few metres.
+// each frame the cache is copied out and just the dynamic casters are drawn on top of it.
+class CascadedShadowMap
+{
+public:
+	CascadedShadowMap();
+	~CascadedShadowMap();
+
+	// fits the cascades to the camera and brings the map up to date, leaves the framebuffer and viewport as they were
+	void render(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& lightDirection,
+		const std::vector<std::shared_ptr<MeshComponent>>& meshes, const std::vector<std::shared_ptr<AnimatedModelComponent>>& animatedModels);
+	// redraw the static casters of every cascade on the next render
+	void invalidate();
+
+	// on SHADOW_MAP_UNIT
+	void bindTexture();
+	// cascade matrices and splits, for a shader in use
+	void setUniforms(Shader* shader);
+
+	int numCascades;
+	// 0 splits the distance evenly, 1 logarithmically
+	float splitLambda;
+	// shadows end here, or at the camera's far plane if that's closer
+	float maxDistance;
+	int resolution;
+
+	size_t GetMemoryUsage();
+	void ui();
+
+private:
+	struct Cascade
+	{
+		glm::mat4 view;
+		glm::mat4 projection;
+		// view space distance the cascade ends at
+		float split;
+		// half the width of the ortho box, and how far it reaches from the light
+		float halfSize;
+		float depthRange;
+		// world size of one texel
+		float texelSize;
+		// the static cache was rendered with these matrices
+		bool valid;
+		unsigned int numStatic, numDynamic;
+	};
+
+	void allocate();
+	void fit(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& lightDirection);
+	// against the cascade's box in light space, anything between the light and the box still casts
+	bool overlaps(const Cascade& c, const Bounds& b);
+	void attach(unsigned int texture, unsigned int layer);
+
+	Cascade cascades[MAX_CASCADES];
+	unsigned int staticMap, shadowMap;
+	unsigned int fbo, copyFbo;
+	int allocatedResolution;
+	// nothing dynamic was drawn, so the cache is sampled directly
+	bool staticOnly;
+	unsigned int numCacheUpdates;
+
+	std::shared_ptr<ShaderComponent> meshShader;
+	std::shared_ptr<ShaderComponent> animShader;
+};
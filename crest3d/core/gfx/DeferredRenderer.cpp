@@ -0,0 +1,178 @@
+#include "DeferredRenderer.h"
+#include "components/lighting/DirectionalLightComponent.h"
+#include "gfx/CascadedShadowMap.h"
+#include "Debug.h"
+
+static const int TILE_SIZE = 16;
+
+DeferredRenderer::DeferredRenderer()
+{
+	fbo = 0;
+	albedoAO = normal = material = depth = lit = 0;
+	allocatedWidth = allocatedHeight = 0;
+	previousFramebuffer = 0;
+	viewport[0] = viewport[1] = viewport[2] = viewport[3] = 0;
+	numLights = 0;
+
+	lightingShader = Shader::Compute("res/shaders/deferred_lighting.comp");
+	compositeShader = std::make_shared<Shader>("res/shaders/framebuffer.vert", "res/shaders/deferred_composite.frag");
+	compositeShader->use();
+	compositeShader->setInt("depthTexture", 1);
+	glUseProgram(0);
+}
+
+DeferredRenderer::~DeferredRenderer()
+{
+	unsigned int textures[5] = { albedoAO, normal, material, depth, lit };
+	glDeleteTextures(5, textures);
+	glDeleteFramebuffers(1, &fbo);
+}
+
+bool DeferredRenderer::IsSupported()
+{
+	return GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object && GLEW_ARB_shader_image_load_store;
+}
+
+static unsigned int MakeTarget(int internalFormat, int format, int type, int width, int height)
+{
+	unsigned int t;
+	glGenTextures(1, &t);
+	glBindTexture(GL_TEXTURE_2D, t);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	return t;
+}
+
+void DeferredRenderer::resize(int width, int height)
+{
+	if (width <= allocatedWidth && height <= allocatedHeight)
+	{
+		return;
+	}
+	allocatedWidth = std::max(width, allocatedWidth);
+	allocatedHeight = std::max(height, allocatedHeight);
+
+	if (fbo != 0)
+	{
+		unsigned int textures[5] = { albedoAO, normal, material, depth, lit };
+		glDeleteTextures(5, textures);
+		glDeleteFramebuffers(1, &fbo);
+	}
+
+	albedoAO = MakeTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, allocatedWidth, allocatedHeight);
+	normal = MakeTarget(GL_RG16F, GL_RG, GL_HALF_FLOAT, allocatedWidth, allocatedHeight);
+	material = MakeTarget(GL_RG8, GL_RG, GL_UNSIGNED_BYTE, allocatedWidth, allocatedHeight);
+	depth = MakeTarget(GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT, allocatedWidth, allocatedHeight);
+	// written by the compute pass, already tonemapped so 8 bits is enough
+	lit = MakeTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, allocatedWidth, allocatedHeight);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoAO, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normal, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, material, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+	unsigned int attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+	glDrawBuffers(3, attachments);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		Debug::Error<DeferredRenderer>("G-buffer is incomplete");
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	std::stringstream s;
+	s << "Resized g-buffer to " << allocatedWidth << "x" << allocatedHeight;
+	Debug::Log<DeferredRenderer>(s.str().c_str());
+}
+
+void DeferredRenderer::beginGeometry()
+{
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+	resize(viewport[2], viewport[3]);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glViewport(0, 0, viewport[2], viewport[3]);
+	// per attachment, so the target's clear colour is left alone
+	const float zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	const float one = 1.0f;
+	for (int i = 0; i < 3; i++)
+	{
+		glClearBufferfv(GL_COLOR, i, zero);
+	}
+	glClearBufferfv(GL_DEPTH, 0, &one);
+}
+
+void DeferredRenderer::endGeometry()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void DeferredRenderer::light(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPosition,
+	const std::shared_ptr<DirectionalLightComponent>& dirLight, unsigned int numPointLights, CascadedShadowMap* shadows)
+{
+	numLights = numPointLights;
+	int width = viewport[2];
+	int height = viewport[3];
+
+	lightingShader->use();
+	lightingShader->setInt("numLights", (int)numLights);
+	glUniform2i(glGetUniformLocation(lightingShader->id, "size"), width, height);
+	lightingShader->setMat4("view", view);
+	lightingShader->setMat4("invProjection", glm::inverse(projection));
+	lightingShader->setMat4("invViewProjection", glm::inverse(projection * view));
+	lightingShader->setVec3("viewPosition", viewPosition);
+	lightingShader->setVec3("dirLight.direction", dirLight != nullptr ? dirLight->direction : glm::vec3(0.0f, -1.0f, 0.0f));
+	lightingShader->setVec3("dirLight.ambient", dirLight != nullptr ? dirLight->ambient : glm::vec3(0.0f));
+	lightingShader->setVec3("dirLight.diffuse", dirLight != nullptr ? dirLight->diffuse : glm::vec3(0.0f));
+	if (shadows != nullptr)
+	{
+		shadows->setUniforms(lightingShader.get());
+		shadows->bindTexture();
+	}
+	else
+	{
+		lightingShader->setInt("numCascades", 0);
+	}
+
+	unsigned int inputs[4] = { albedoAO, normal, material, depth };
+	for (unsigned int i = 0; i < 4; i++)
+	{
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_2D, inputs[i]);
+	}
+	glBindImageTexture(0, lit, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+	lightingShader->dispatch((width + TILE_SIZE - 1) / TILE_SIZE, (height + TILE_SIZE - 1) / TILE_SIZE);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+	// composite over whatever the target already has (the skybox), with the g-buffer depth
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, depth);
+	compositeShader->use();
+	glUniform2i(glGetUniformLocation(compositeShader->id, "viewportOrigin"), viewport[0], viewport[1]);
+	glDepthFunc(GL_ALWAYS);
+	quad.Draw(*compositeShader, "litTexture", lit);
+	glDepthFunc(GL_LESS);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+size_t DeferredRenderer::GetMemoryUsage()
+{
+	// rgba8 + rg16f + rg8 + depth32f + rgba8 lit
+	return (size_t)allocatedWidth * allocatedHeight * (4 + 4 + 2 + 4 + 4);
+}
+
+void DeferredRenderer::ui()
+{
+	ImGui::Text("G-buffer %dx%d (%.1f MB)", allocatedWidth, allocatedHeight, GetMemoryUsage() / (1024.0f * 1024.0f));
+	int tilesX = (viewport[2] + TILE_SIZE - 1) / TILE_SIZE;
+	int tilesY = (viewport[3] + TILE_SIZE - 1) / TILE_SIZE;
+	ImGui::Text("Point lights: %u, tiles: %dx%d", numLights, tilesX, tilesY);
+}
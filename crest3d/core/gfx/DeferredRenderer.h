@@ -0,0 +1,49 @@
+#pragma once
+#include "Common.h"
+#include "gfx/Shader.h"
+#include "primitives/Quad.h"
+
+class DirectionalLightComponent;
+class CascadedShadowMap;
+
+// deferred shading for scenes with lots of point lights. opaque meshes write a compact g-buffer
+// (albedo + ao, octahedral normal, metallic + roughness, depth), then a compute pass lights it in 16x16 tiles,
+// each tile only evaluating the lights whose range touches it. needs compute shaders (GL 4.3).
+class DeferredRenderer
+{
+public:
+	DeferredRenderer();
+	~DeferredRenderer();
+
+	static bool IsSupported();
+
+	// binds the g-buffer sized to the current viewport and clears it. draw with the SHADER_GBUFFER variants
+	void beginGeometry();
+	// back to the framebuffer that was bound before beginGeometry
+	void endGeometry();
+	// lights the g-buffer and composites the result, with depth, in to the bound framebuffer.
+	// point lights come from the buffer the LightAssignment left bound, shadows can be null
+	void light(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPosition,
+		const std::shared_ptr<DirectionalLightComponent>& dirLight, unsigned int numPointLights, CascadedShadowMap* shadows);
+
+	// g-buffer and lit image
+	size_t GetMemoryUsage();
+	void ui();
+
+private:
+	// only ever grows, a smaller viewport renders in to the corner
+	void resize(int width, int height);
+
+	unsigned int fbo;
+	unsigned int albedoAO, normal, material, depth, lit;
+	int allocatedWidth, allocatedHeight;
+	// viewport at beginGeometry, the g-buffer covers this much of the target
+	int viewport[4];
+	int previousFramebuffer;
+
+	unsigned int numLights;
+
+	std::shared_ptr<Shader> lightingShader;
+	std::shared_ptr<Shader> compositeShader;
+	screenQuad quad;
+};
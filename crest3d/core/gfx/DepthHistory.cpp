@@ -0,0 +1,110 @@
+#include "DepthHistory.h"
+#include "gfx/FrameBuffer.h"
+#include "Debug.h"
+
+DepthHistory::DepthHistory()
+{
+	fbo = depth = 0;
+	allocatedWidth = allocatedHeight = 0;
+	allocatedDepthFormat = 0;
+	recorded = false;
+	viewProjection = glm::mat4(1.0f);
+	depthParams = glm::vec2(0.0f);
+	uvScale = glm::vec2(1.0f);
+	cameraPosition = glm::vec3(0.0f);
+}
+
+DepthHistory::~DepthHistory()
+{
+	glDeleteTextures(1, &depth);
+	glDeleteFramebuffers(1, &fbo);
+}
+
+void DepthHistory::resize(int width, int height, int depthFormat)
+{
+	if (width <= allocatedWidth && height <= allocatedHeight && depthFormat == allocatedDepthFormat)
+	{
+		return;
+	}
+	allocatedWidth = std::max(width, allocatedWidth);
+	allocatedHeight = std::max(height, allocatedHeight);
+	allocatedDepthFormat = depthFormat;
+
+	if (fbo != 0)
+	{
+		glDeleteTextures(1, &depth);
+		glDeleteFramebuffers(1, &fbo);
+	}
+
+	// the blit needs the source's format, stencil and all. sampling a depth stencil texture reads the depth
+	bool hasStencil = FrameBuffer::HasStencil(depthFormat);
+	glGenTextures(1, &depth);
+	glBindTexture(GL_TEXTURE_2D, depth);
+	glTexStorage2D(GL_TEXTURE_2D, 1, depthFormat, allocatedWidth, allocatedHeight);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, hasStencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		Debug::Error<DepthHistory>("Depth history is incomplete");
+	}
+}
+
+void DepthHistory::record(const glm::mat4& view, const glm::mat4& projection)
+{
+	int viewport[4];
+	int previousFramebuffer;
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+	resize(viewport[2], viewport[3], FrameBuffer::GetDepthFormat(previousFramebuffer));
+
+	// a multisampled source is resolved by the blit
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, previousFramebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+	GLbitfield mask = GL_DEPTH_BUFFER_BIT;
+	if (FrameBuffer::HasStencil(allocatedDepthFormat))
+	{
+		mask |= GL_STENCIL_BUFFER_BIT;
+	}
+	glBlitFramebuffer(viewport[0], viewport[1], viewport[0] + viewport[2], viewport[1] + viewport[3],
+		0, 0, viewport[2], viewport[3], mask, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+
+	viewProjection = projection * view;
+	depthParams = glm::vec2(projection[2][2], projection[3][2]);
+	uvScale = glm::vec2((float)viewport[2] / allocatedWidth, (float)viewport[3] / allocatedHeight);
+	cameraPosition = glm::vec3(glm::inverse(view)[3]);
+	recorded = true;
+}
+
+void DepthHistory::bind(Shader* shader)
+{
+	shader->setInt("hasPreviousDepth", recorded ? 1 : 0);
+	shader->setInt("previousDepth", DEPTH_HISTORY_UNIT);
+	glActiveTexture(GL_TEXTURE0 + DEPTH_HISTORY_UNIT);
+	glBindTexture(GL_TEXTURE_2D, depth);
+	glActiveTexture(GL_TEXTURE0);
+	if (!recorded)
+	{
+		return;
+	}
+	shader->setMat4("previousViewProjection", viewProjection);
+	shader->setMat4("previousInverseViewProjection", glm::inverse(viewProjection));
+	shader->setVec2("previousDepthParams", depthParams);
+	shader->setVec2("previousUVScale", uvScale);
+	shader->setVec3("previousCameraPosition", cameraPosition);
+}
+
+size_t DepthHistory::GetMemoryUsage()
+{
+	size_t depthBytes = allocatedDepthFormat == GL_DEPTH32F_STENCIL8 ? 8 : 4;
+	return (size_t)allocatedWidth * allocatedHeight * depthBytes;
+}
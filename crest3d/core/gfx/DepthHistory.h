@@ -0,0 +1,43 @@
+#pragma once
+#include "Common.h"
+#include "gfx/Shader.h"
+
+// texture unit the previous depth is bound to, clear of the material units and the shadow map
+static const unsigned int DEPTH_HISTORY_UNIT = 6;
+
+// the scene's opaque depth and the camera it was drawn with, copied before particles draw so they never end
+// up in it. particles fade out where they meet it the same frame, and collide with it next frame, reprojected
+// through the old camera so it holds up while the camera moves. the scene's
+// FrameBuffer only resolves its depth texture at the end of the pass, after the depth has been cleared for
+// debug drawing, so the opaque depth is copied out here instead
+class DepthHistory
+{
+public:
+	DepthHistory();
+	~DepthHistory();
+
+	// copies the bound framebuffer's depth over the current viewport, once the scene's depth is complete.
+	// view and projection are what it was drawn with, and what it's read back with next frame
+	void record(const glm::mat4& view, const glm::mat4& projection);
+
+	// false until a frame has been recorded
+	inline bool IsValid() { return recorded; }
+	// binds the depth to DEPTH_HISTORY_UNIT and sets the previous* uniforms, hasPreviousDepth says whether to use them
+	void bind(Shader* shader);
+	size_t GetMemoryUsage();
+
+private:
+	// grows like the g-buffer, and is remade if the source's depth format changes
+	void resize(int width, int height, int depthFormat);
+
+	unsigned int fbo, depth;
+	int allocatedWidth, allocatedHeight, allocatedDepthFormat;
+	bool recorded;
+
+	glm::mat4 viewProjection;
+	// projection[2][2] and [3][2], turn a depth buffer value back in to view distance
+	glm::vec2 depthParams;
+	// the part of the texture that was recorded
+	glm::vec2 uvScale;
+	glm::vec3 cameraPosition;
+};
@@ -0,0 +1,60 @@
+#include "DynamicResolution.h"
+#include "Debug.h"
+
+DynamicResolution::DynamicResolution()
+{
+	enabled = false;
+	targetFrameTime = 16.0f;
+	minScale = 0.5f;
+	maxScale = 1.0f;
+	scale = 1.0f;
+	gpuTime = 0.0f;
+	framesSinceChange = 0;
+}
+
+void DynamicResolution::update(float gpuFrameTime)
+{
+	if (gpuFrameTime < 0.0f)
+	{
+		return;
+	}
+	gpuTime = gpuTime == 0.0f ? gpuFrameTime : glm::mix(gpuTime, gpuFrameTime, 0.1f);
+
+	if (!enabled)
+	{
+		return;
+	}
+
+	framesSinceChange++;
+
+	// gpu cost scales roughly with pixel count, so move the scale by the square root of the ratio.
+	// drop quickly on a spike but only climb back once we have been under budget for a while.
+	// timings arrive a few frames late, so always wait for those to reflect the last change
+	float ratio = targetFrameTime / std::max(gpuTime, 0.01f);
+	float desired = glm::clamp(scale * std::sqrt(ratio), minScale, maxScale);
+
+	if (gpuTime > targetFrameTime && desired < scale && framesSinceChange > 4)
+	{
+		scale = std::max(desired, scale - 0.1f);
+		framesSinceChange = 0;
+	}
+	else if (gpuTime < targetFrameTime * 0.85f && desired > scale && framesSinceChange > 30)
+	{
+		scale = std::min(desired, scale + 0.05f);
+		framesSinceChange = 0;
+	}
+	scale = glm::clamp(scale, minScale, maxScale);
+}
+
+void DynamicResolution::ui()
+{
+	ImGui::Checkbox("Dynamic Resolution", &enabled);
+	ImGui::SliderFloat("GPU Budget (ms)", &targetFrameTime, 1.0f, 50.0f);
+	ImGui::SliderFloat("Min Scale", &minScale, 0.1f, 1.0f);
+	ImGui::SliderFloat("Max Scale", &maxScale, 0.1f, 1.0f);
+	if (minScale > maxScale)
+	{
+		minScale = maxScale;
+	}
+	ImGui::Text("Render scale: %.2f (GPU %.2f ms)", GetScale(), gpuTime);
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "Common.h"
+
+// adjusts the internal render scale of the scene to hold a gpu frame time budget.
+// gpu time is fed in from the Profiler, which reads its timestamps a few frames late so we never stall on them.
+class DynamicResolution
+{
+public:
+	DynamicResolution();
+	~DynamicResolution() {};
+
+	// pick the scale for the next frame from the latest gpu time of the budgeted work, in ms.
+	// negative times (not measured yet) are ignored
+	void update(float gpuFrameTime);
+
+	inline float GetScale() { return enabled ? scale : maxScale; }
+	inline float GetGPUTime() { return gpuTime; }
+
+	void ui();
+
+	bool enabled;
+	float targetFrameTime; // ms
+	float minScale, maxScale;
+
+private:
+	float scale;
+	float gpuTime; // smoothed, ms
+	int framesSinceChange;
+};
@@ -3,10 +3,12 @@
 
 void FrameBuffer::initialise(float SCREEN_WIDTH, float SCREEN_HEIGHT, bool multiSample)
 {
+	release();
 	isMultiSample = multiSample;
-	glViewport(0, 0, screenWidth, screenHeight);
 	screenWidth = SCREEN_WIDTH;
 	screenHeight = SCREEN_HEIGHT;
+	glViewport(0, 0, screenWidth, screenHeight);
+	isInitialised = true;
 
 	if (isMultiSample)
 	{
@@ -47,7 +49,6 @@ void FrameBuffer::initialise(float SCREEN_WIDTH, float SCREEN_HEIGHT, bool multi
 		glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
 		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, msFramebufferTexture, 0);
 
-		unsigned int rbo;
 		glGenRenderbuffers(1, &rbo);
 		glBindRenderbuffer(GL_RENDERBUFFER, rbo);
 		glRenderbufferStorageMultisample(GL_RENDERBUFFER, 4, GL_DEPTH24_STENCIL8, screenWidth, screenHeight);
@@ -88,6 +89,44 @@ void FrameBuffer::initialise(float SCREEN_WIDTH, float SCREEN_HEIGHT, bool multi
 	}
 }
 
+void FrameBuffer::release()
+{
+	if (!isInitialised)
+	{
+		return;
+	}
+
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteTextures(1, &framebufferTexture);
+	glDeleteTextures(1, &depthTexture);
+
+	if (isMultiSample)
+	{
+		glDeleteFramebuffers(1, &msFbo);
+		glDeleteTextures(1, &msFramebufferTexture);
+		glDeleteRenderbuffers(1, &rbo);
+	}
+	isInitialised = false;
+}
+
+size_t FrameBuffer::GetMemoryUsage()
+{
+	if (!isInitialised)
+	{
+		return 0;
+	}
+
+	size_t pixels = (size_t)screenWidth * (size_t)screenHeight;
+	// RGBA32F colour + 32 bit depth
+	size_t bytes = pixels * (16 + 4);
+	if (isMultiSample)
+	{
+		// 4x RGB8 (padded to 4 bytes) + 4x DEPTH24_STENCIL8
+		bytes += pixels * 4 * (4 + 4);
+	}
+	return bytes;
+}
+
 void FrameBuffer::changeScreenSize(float newWidth, float newHeight)
 {
 	screenWidth = newWidth;
@@ -96,6 +135,11 @@ void FrameBuffer::changeScreenSize(float newWidth, float newHeight)
 	initialise(screenWidth, screenHeight, isMultiSample);
 }
 
+void FrameBuffer::SetRenderScale(float scale)
+{
+	renderScale = glm::clamp(scale, 0.1f, 1.0f);
+}
+
 void FrameBuffer::initForDrawing()
 {
 	if (isMultiSample)
@@ -116,7 +160,10 @@ void FrameBuffer::finishDrawing()
 	{
 		glBindFramebuffer(GL_READ_FRAMEBUFFER, msFbo);
 		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
-		glBlitFramebuffer(0, 0, screenWidth, screenHeight, 0, 0, screenWidth, screenHeight, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		// only resolve the region that was drawn to
+		int w = GetRenderWidth();
+		int h = GetRenderHeight();
+		glBlitFramebuffer(0, 0, w, h, 0, 0, w, h, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
 	}
 
 	glBindFramebuffer(GL_FRAMEBUFFER, 0); // back to default
@@ -134,4 +181,26 @@ void FrameBuffer::BindDepthTexture(Shader shader)
 	glActiveTexture(GL_TEXTURE8);
 	shader.setInt("depthTexture", 8);
 	glBindTexture(GL_TEXTURE_2D, depthTexture);
-}
\ No newline at end of file
+}
+
+int FrameBuffer::GetDepthFormat(int framebuffer)
+{
+	// the default framebuffer names its buffers differently
+	GLenum depthAttachment = framebuffer == 0 ? GL_DEPTH : GL_DEPTH_ATTACHMENT;
+	GLenum stencilAttachment = framebuffer == 0 ? GL_STENCIL : GL_STENCIL_ATTACHMENT;
+	int depthBits = 0, stencilBits = 0, type = GL_UNSIGNED_NORMALIZED;
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, depthAttachment, GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &depthBits);
+	glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, depthAttachment, GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE, &type);
+	glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, stencilAttachment, GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &stencilBits);
+
+	if (stencilBits > 0)
+	{
+		return type == GL_FLOAT ? GL_DEPTH32F_STENCIL8 : GL_DEPTH24_STENCIL8;
+	}
+	if (type == GL_FLOAT)
+	{
+		return GL_DEPTH_COMPONENT32F;
+	}
+	return depthBits >= 32 ? GL_DEPTH_COMPONENT32 : (depthBits >= 24 ? GL_DEPTH_COMPONENT24 : GL_DEPTH_COMPONENT16);
+}
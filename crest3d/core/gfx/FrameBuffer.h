@@ -3,11 +3,13 @@
 class FrameBuffer
 {
 public:
-	FrameBuffer() {}
+	FrameBuffer() : renderScale(1.0f), isInitialised(false) {}
 
-	~FrameBuffer() {}
+	~FrameBuffer() { release(); }
 
 	void initialise(float SCREEN_WIDTH, float, bool multiSample);
+	// free every gl object owned by this framebuffer
+	void release();
 
 	void changeScreenSize(float newWidth, float newHeight);
 
@@ -18,16 +20,35 @@ public:
 	inline int GetDepthTexture() { return depthTexture; }
 	inline int GetFBO() { return fbo; }
 	inline int GetRBO() { return rbo; }
+	inline bool IsMultiSample() { return isMultiSample; }
+	inline float GetWidth() { return screenWidth; }
+	inline float GetHeight() { return screenHeight; }
+	// drawing is confined to the bottom left renderScale portion of the attachments,
+	// readers should multiply their uvs by GetUVScale()
+	void SetRenderScale(float scale);
+	inline float GetRenderScale() { return renderScale; }
+	inline int GetRenderWidth() { return std::max(1, (int)(screenWidth * renderScale)); }
+	inline int GetRenderHeight() { return std::max(1, (int)(screenHeight * renderScale)); }
+	inline glm::vec2 GetUVScale() { return glm::vec2(GetRenderWidth() / screenWidth, GetRenderHeight() / screenHeight); }
+	// approximate gpu memory held by the attachments, in bytes
+	size_t GetMemoryUsage();
 
 	// Shader color = GL Texture Slot 7
 	void BindColorTexture(Shader shader);
 	// Shader depth = GL Texture Slot 8
 	void BindDepthTexture(Shader shader);
 
+	// the internal format of a framebuffer's depth (0 for the default one), blitting depth needs the
+	// destination's to match
+	static int GetDepthFormat(int framebuffer);
+	static inline bool HasStencil(int depthFormat) { return depthFormat == GL_DEPTH24_STENCIL8 || depthFormat == GL_DEPTH32F_STENCIL8; }
+
 private:
 	float screenWidth, screenHeight;
+	float renderScale;
 	unsigned int fbo, rbo, msFbo;
 	unsigned int framebufferTexture, msFramebufferTexture, depthTexture;
 
 	bool isMultiSample;
+	bool isInitialised;
 };
\ No newline at end of file
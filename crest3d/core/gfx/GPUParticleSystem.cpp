@@ -0,0 +1,212 @@
+#include "GPUParticleSystem.h"
+#include "gfx/ParticleSystem.h"
+#include "Entity.h"
+#include "Debug.h"
+
+// matches particles.comp
+static const unsigned int GROUP_SIZE = 64;
+static const unsigned int PARTICLE_STRIDE = 48;
+static const unsigned int COLOUR_OFFSET = 32;
+static const unsigned int DRAW_COMMAND_SIZE = 16;
+static const unsigned int DISPATCH_ARGS_OFFSET = 2 * DRAW_COMMAND_SIZE;
+// 0 is the point lights'
+static const unsigned int PARTICLES_IN_BINDING = 1;
+static const unsigned int PARTICLES_OUT_BINDING = 2;
+static const unsigned int CONTROL_BINDING = 3;
+
+GPUParticleSystem::GPUParticleSystem(unsigned int _capacity)
+{
+	capacity = 0;
+	stateBuffers[0] = stateBuffers[1] = 0;
+	current = 0;
+	frame = 0;
+	seed = 0;
+
+	argsShader = Shader::Compute("res/shaders/particles.comp", { "ARGS" });
+	updateShader = Shader::Compute("res/shaders/particles.comp", { "UPDATE" });
+	spawnShader = Shader::Compute("res/shaders/particles.comp", { "SPAWN" });
+
+	resize(std::max(_capacity, ParticleSystem::MIN_CAPACITY));
+	glGenBuffers(1, &controlBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, controlBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, DISPATCH_ARGS_OFFSET + 3 * sizeof(unsigned int), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	reset();
+
+	glGenVertexArrays(1, &vertex_array_id);
+	glBindVertexArray(vertex_array_id);
+	glGenBuffers(1, &billboard_vertex_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, billboard_vertex_buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(ParticleSystem::g_vertex_buffer_data), ParticleSystem::g_vertex_buffer_data, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribDivisor(1, 1);
+	glEnableVertexAttribArray(2);
+	glVertexAttribDivisor(2, 1);
+	glBindVertexArray(0);
+}
+
+GPUParticleSystem::~GPUParticleSystem()
+{
+	glDeleteBuffers(2, stateBuffers);
+	glDeleteBuffers(1, &controlBuffer);
+	glDeleteBuffers(1, &billboard_vertex_buffer);
+	glDeleteVertexArrays(1, &vertex_array_id);
+}
+
+bool GPUParticleSystem::IsSupported()
+{
+	return GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object && GLEW_ARB_draw_indirect;
+}
+
+void GPUParticleSystem::reset()
+{
+	// both draws are the billboard's 4 vertices with no instances, nothing to dispatch yet
+	unsigned int control[11] = {
+		4, 0, 0, 0,
+		4, 0, 0, 0,
+		0, 1, 1,
+	};
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, controlBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(control), control);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	current = 0;
+}
+
+void GPUParticleSystem::fit(unsigned int wanted)
+{
+	wanted = std::min(std::max(wanted, ParticleSystem::MIN_CAPACITY), ParticleSystem::MAX_PARTICLES);
+	if (wanted > capacity)
+	{
+		resize(std::min(std::max(wanted, capacity * 2), ParticleSystem::MAX_PARTICLES));
+	}
+	else if (wanted <= capacity / 4)
+	{
+		resize(std::max(wanted * 2, ParticleSystem::MIN_CAPACITY));
+	}
+}
+
+void GPUParticleSystem::resize(unsigned int newCapacity)
+{
+	unsigned int buffers[2];
+	glGenBuffers(2, buffers);
+	for (int i = 0; i < 2; i++)
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[i]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)newCapacity * PARTICLE_STRIDE, nullptr, GL_DYNAMIC_DRAW);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// only the latest state is read again. past a smaller capacity is dropped, the next update clamps
+	// the alive count to it
+	if (stateBuffers[current] != 0)
+	{
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		glBindBuffer(GL_COPY_READ_BUFFER, stateBuffers[current]);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[current]);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr)std::min(capacity, newCapacity) * PARTICLE_STRIDE);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		glDeleteBuffers(2, stateBuffers);
+	}
+	stateBuffers[0] = buffers[0];
+	stateBuffers[1] = buffers[1];
+	capacity = newCapacity;
+}
+
+void GPUParticleSystem::update(float deltaTime, glm::vec3 origin, float sizeScale, ParticleEmitter& emitter, DepthHistory* depthHistory,
+	float spawnScale, float spawnCapScale)
+{
+	unsigned int newParticles = emitter.emit(deltaTime, spawnScale, spawnCapScale);
+	unsigned int in = current;
+	unsigned int out = 1 - current;
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PARTICLES_IN_BINDING, stateBuffers[in]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PARTICLES_OUT_BINDING, stateBuffers[out]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CONTROL_BINDING, controlBuffer);
+
+	// sizes the update from however many survived last frame, without asking
+	argsShader->use();
+	argsShader->setInt("inIndex", in);
+	argsShader->setInt("capacityCount", capacity);
+	argsShader->dispatch(1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+	updateShader->use();
+	updateShader->setInt("inIndex", in);
+	updateShader->setInt("capacityCount", capacity);
+	updateShader->setFloat("deltaTime", deltaTime);
+	updateShader->setFloat("gravity", emitter.gravity);
+	bool collide = emitter.collision != PARTICLE_COLLISION_NONE && depthHistory != nullptr;
+	updateShader->setInt("collision", collide ? emitter.collision : PARTICLE_COLLISION_NONE);
+	if (collide)
+	{
+		updateShader->setFloat("restitution", emitter.restitution);
+		updateShader->setFloat("collisionThickness", emitter.collisionThickness);
+		depthHistory->bind(updateShader.get());
+	}
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, controlBuffer);
+	updateShader->dispatchIndirect(DISPATCH_ARGS_OFFSET);
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+
+	// appends through the same counter as the update, so the two can overlap
+	if (newParticles > 0)
+	{
+		spawnShader->use();
+		spawnShader->setInt("inIndex", in);
+		spawnShader->setInt("capacityCount", capacity);
+		spawnShader->setInt("spawnCount", newParticles);
+		spawnShader->setInt("seed", (int)(seed + frame * 0x9E3779B9u));
+		spawnShader->setVec3("origin", origin);
+		spawnShader->setFloat("sizeScale", sizeScale);
+		spawnShader->setInt("shape", emitter.shape);
+		spawnShader->setVec3("shapeSize", emitter.shapeSize);
+		spawnShader->setVec2("lifetime", glm::vec2(emitter.lifetimeMin, emitter.lifetimeMax));
+		spawnShader->setVec3("direction", emitter.direction);
+		spawnShader->setVec2("speed", glm::vec2(emitter.speedMin, emitter.speedMax));
+		spawnShader->setFloat("spread", emitter.spread);
+		spawnShader->setVec2("size", glm::vec2(emitter.sizeMin, emitter.sizeMax));
+		spawnShader->setVec4("colourMin", emitter.colourMin);
+		spawnShader->setVec4("colourMax", emitter.colourMax);
+		spawnShader->dispatch((newParticles + GROUP_SIZE - 1) / GROUP_SIZE);
+	}
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+	glUseProgram(0);
+
+	current = out;
+	frame++;
+}
+
+void GPUParticleSystem::render(std::shared_ptr<CameraComponent> cam, std::shared_ptr<Shader> shader, unsigned int texture)
+{
+	shader->use();
+	glActiveTexture(GL_TEXTURE0);
+	shader->setInt("mat.m_Diffuse", 0);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	shader->setMat4("viewProj", cam->GetViewProjectionMatrix());
+	shader->setVec3("camRightWS", cam->attachedEntity->transform->right);
+	shader->setVec3("camUpWS", cam->attachedEntity->transform->up);
+
+	// the state buffer is the instance data, position and size then the packed colour
+	glBindVertexArray(vertex_array_id);
+	glBindBuffer(GL_ARRAY_BUFFER, stateBuffers[current]);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, PARTICLE_STRIDE, (void*)0);
+	glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, PARTICLE_STRIDE, (void*)(size_t)COLOUR_OFFSET);
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, controlBuffer);
+	glDrawArraysIndirect(GL_TRIANGLE_STRIP, (void*)(size_t)(current * DRAW_COMMAND_SIZE));
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	glBindVertexArray(0);
+}
+
+size_t GPUParticleSystem::GetMemoryUsage()
+{
+	return 2 * (size_t)capacity * PARTICLE_STRIDE;
+}
+
+void GPUParticleSystem::ui()
+{
+	ImGui::Text("GPU simulated, capacity %u", capacity);
+	ImGui::Text("State buffers: %.2f MB", GetMemoryUsage() / (1024.0f * 1024.0f));
+}
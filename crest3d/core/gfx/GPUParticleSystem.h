@@ -0,0 +1,57 @@
+#pragma once
+#include "Common.h"
+#include "gfx/Shader.h"
+#include "components/CameraComponent.h"
+#include "gfx/ParticleEmitter.h"
+#include "gfx/DepthHistory.h"
+
+// the compute shader version of ParticleSystem. particle state lives in two storage buffers that
+// take turns being read and written, spawning, integration and compaction all happen in particles.comp,
+// and the draw takes its instance count straight from a buffer the compute passes wrote, so the cpu
+// never knows how many particles there are. nothing is depth sorted, and the emitter's over life curves
+// are cpu only. needs compute shaders (GL 4.3).
+class GPUParticleSystem
+{
+public:
+	// the state buffers start at capacity, see fit
+	GPUParticleSystem(unsigned int capacity);
+	~GPUParticleSystem();
+
+	static bool IsSupported();
+
+	// runs this frame's passes, spawning what the emitter asks for. the particles are ready to draw when it returns.
+	// the scales are passed on to ParticleEmitter::emit. particles collide with depthHistory if the emitter
+	// wants them to, it can be null
+	void update(float deltaTime, glm::vec3 origin, float sizeScale, ParticleEmitter& emitter, DepthHistory* depthHistory,
+		float spawnScale = 1.0f, float spawnCapScale = 1.0f);
+	// same shader as ParticleSystem::render, the caller sets the blending
+	void render(std::shared_ptr<CameraComponent> cam, std::shared_ptr<Shader> shader, unsigned int texture);
+	// kills every particle
+	void reset();
+	// grows the state buffers to hold wanted particles, doubling at least, or shrinks them once wanted
+	// fits in a quarter. the cpu can't see how many are alive, so wanted is an estimate. call before update
+	void fit(unsigned int wanted);
+
+	unsigned int GetCapacity() { return capacity; }
+	size_t GetMemoryUsage();
+	void ui();
+
+	unsigned int seed;
+
+private:
+	// new state buffers, with the latest state copied across
+	void resize(unsigned int newCapacity);
+
+	unsigned int capacity;
+	// particle state, ping-ponged. current holds the latest
+	unsigned int stateBuffers[2];
+	unsigned int current;
+	// a draw command per state buffer then the update's dispatch size, see particles.comp
+	unsigned int controlBuffer;
+	unsigned int vertex_array_id, billboard_vertex_buffer;
+	unsigned long long frame;
+
+	std::shared_ptr<Shader> argsShader;
+	std::shared_ptr<Shader> updateShader;
+	std::shared_ptr<Shader> spawnShader;
+};
@@ -0,0 +1,208 @@
+#include "LightAssignment.h"
+#include "components/MeshComponent.h"
+#include "components/lighting/PointLightComponent.h"
+#include "Debug.h"
+
+// a box covering more cells than this goes in the oversized list
+static const int MAX_CELLS_PER_ITEM = 64;
+
+void SpatialGrid::clear(float _cellSize)
+{
+	oversized.clear();
+	// every key means a different place at another size
+	if (_cellSize != cellSize)
+	{
+		cellSize = _cellSize;
+		cells.clear();
+		return;
+	}
+	// keeps the buckets filled last frame, most frames fill the same cells again. ones that stayed empty are
+	// dropped, so things moving through the scene don't leave a trail of cells behind
+	for (auto it = cells.begin(); it != cells.end();)
+	{
+		if (it->second.empty())
+		{
+			it = cells.erase(it);
+			continue;
+		}
+		it->second.clear();
+		++it;
+	}
+}
+
+unsigned long long SpatialGrid::Key(int x, int y, int z)
+{
+	// 21 bits an axis, plenty for a scene
+	return ((unsigned long long)(x & 0x1FFFFF) << 42) | ((unsigned long long)(y & 0x1FFFFF) << 21) | (unsigned long long)(z & 0x1FFFFF);
+}
+
+void SpatialGrid::insert(unsigned int item, const Bounds& b)
+{
+	glm::ivec3 lo = glm::ivec3(glm::floor(b.min / cellSize));
+	glm::ivec3 hi = glm::ivec3(glm::floor(b.max / cellSize));
+	glm::ivec3 span = hi - lo + 1;
+	if ((long long)span.x * span.y * span.z > MAX_CELLS_PER_ITEM)
+	{
+		oversized.emplace_back(item);
+		return;
+	}
+	for (int x = lo.x; x <= hi.x; x++)
+	{
+		for (int y = lo.y; y <= hi.y; y++)
+		{
+			for (int z = lo.z; z <= hi.z; z++)
+			{
+				cells[Key(x, y, z)].emplace_back(item);
+			}
+		}
+	}
+}
+
+void SpatialGrid::query(const Bounds& b, std::vector<unsigned int>& out) const
+{
+	out.insert(out.end(), oversized.begin(), oversized.end());
+	glm::ivec3 lo = glm::ivec3(glm::floor(b.min / cellSize));
+	glm::ivec3 hi = glm::ivec3(glm::floor(b.max / cellSize));
+	for (int x = lo.x; x <= hi.x; x++)
+	{
+		for (int y = lo.y; y <= hi.y; y++)
+		{
+			for (int z = lo.z; z <= hi.z; z++)
+			{
+				auto it = cells.find(Key(x, y, z));
+				if (it != cells.end())
+				{
+					out.insert(out.end(), it->second.begin(), it->second.end());
+				}
+			}
+		}
+	}
+}
+
+LightAssignment::LightAssignment()
+{
+	maxLights = 0;
+	totalAssigned = 0;
+	buffer = 0;
+	bufferCapacity = 0;
+}
+
+LightAssignment::~LightAssignment()
+{
+	if (buffer != 0)
+	{
+		glDeleteBuffers(1, &buffer);
+	}
+}
+
+void LightAssignment::update(const std::vector<std::shared_ptr<MeshComponent>>& meshes, const std::vector<std::shared_ptr<PointLightComponent>>& lights)
+{
+	gpuLights.clear();
+	float averageRange = 0.0f;
+	for (auto& pl : lights)
+	{
+		GPULight l;
+		l.positionRadius = glm::vec4(pl->attachedEntity->transform->position, pl->distance);
+		l.colour = glm::vec4(pl->diffuse, pl->intensity);
+		gpuLights.emplace_back(l);
+		averageRange += pl->distance;
+	}
+	upload();
+
+	drawableLights.resize(meshes.size());
+	for (auto& l : drawableLights)
+	{
+		l.clear();
+	}
+	maxLights = 0;
+	totalAssigned = 0;
+	if (gpuLights.empty() || meshes.empty())
+	{
+		return;
+	}
+
+	// cells about a light across, so a light only visits a handful of them. rounded up to a power of two so
+	// lights changing range don't change the cell size, and throw the grid away, every frame
+	averageRange /= gpuLights.size();
+	grid.clear(exp2f(ceilf(log2f(std::max(averageRange * 2.0f, 1.0f)))));
+	bounds.resize(meshes.size());
+	for (unsigned int i = 0; i < meshes.size(); i++)
+	{
+		bounds[i] = meshes[i]->getWorldBounds();
+		grid.insert(i, bounds[i]);
+	}
+
+	tested.assign(meshes.size(), -1);
+	for (int l = 0; l < (int)gpuLights.size(); l++)
+	{
+		glm::vec3 centre = glm::vec3(gpuLights[l].positionRadius);
+		float radius = gpuLights[l].positionRadius.w;
+		Bounds sphereBounds;
+		sphereBounds.min = centre - glm::vec3(radius);
+		sphereBounds.max = centre + glm::vec3(radius);
+
+		candidates.clear();
+		grid.query(sphereBounds, candidates);
+		for (unsigned int d : candidates)
+		{
+			if (tested[d] == l)
+			{
+				continue;
+			}
+			tested[d] = l;
+			// sphere against box, through the closest point on the box
+			glm::vec3 closest = glm::clamp(centre, bounds[d].min, bounds[d].max);
+			if (glm::length2(closest - centre) <= radius * radius)
+			{
+				drawableLights[d].emplace_back(l);
+			}
+		}
+	}
+
+	for (unsigned int d = 0; d < drawableLights.size(); d++)
+	{
+		std::vector<int>& list = drawableLights[d];
+		if (list.size() > MAX_DRAWABLE_LIGHTS)
+		{
+			// keep the lights reaching furthest in to the box, relative to their range
+			auto reach = [&](int l)
+			{
+				glm::vec3 p = glm::vec3(gpuLights[l].positionRadius);
+				return glm::length(glm::clamp(p, bounds[d].min, bounds[d].max) - p) / gpuLights[l].positionRadius.w;
+			};
+			std::partial_sort(list.begin(), list.begin() + MAX_DRAWABLE_LIGHTS, list.end(), [&](int a, int b) { return reach(a) < reach(b); });
+			list.resize(MAX_DRAWABLE_LIGHTS);
+		}
+		maxLights = std::max(maxLights, (unsigned int)list.size());
+		totalAssigned += list.size();
+	}
+}
+
+void LightAssignment::upload()
+{
+	if (buffer == 0)
+	{
+		glGenBuffers(1, &buffer);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	// never empty, a zero sized buffer can't be bound
+	size_t bytes = std::max<size_t>(gpuLights.size(), 1) * sizeof(GPULight);
+	if (bytes > bufferCapacity)
+	{
+		bufferCapacity = bytes;
+		glBufferData(GL_SHADER_STORAGE_BUFFER, bufferCapacity, nullptr, GL_DYNAMIC_DRAW);
+	}
+	if (!gpuLights.empty())
+	{
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, gpuLights.size() * sizeof(GPULight), gpuLights.data());
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, POINT_LIGHT_BINDING, buffer);
+}
+
+void LightAssignment::ui()
+{
+	float average = drawableLights.empty() ? 0.0f : (float)totalAssigned / drawableLights.size();
+	ImGui::Text("Point lights: %u, grid cells: %u", GetNumLights(), (unsigned int)grid.GetNumCells());
+	ImGui::Text("Lights per draw: %.1f average, %u max", average, maxLights);
+}
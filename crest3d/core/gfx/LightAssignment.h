@@ -0,0 +1,77 @@
+#pragma once
+#include "Common.h"
+#include "gfx/Mesh.h"
+#include <unordered_map>
+
+class MeshComponent;
+class PointLightComponent;
+
+// storage buffer binding the point lights are read from, see pbr.frag and deferred_lighting.comp
+static const unsigned int POINT_LIGHT_BINDING = 0;
+// longest light list a draw gets, the largest ShaderVariants light bucket
+static const unsigned int MAX_DRAWABLE_LIGHTS = 32;
+
+// uniform grid hashed on the cell coordinates, so only occupied cells cost anything
+class SpatialGrid
+{
+public:
+	void clear(float cellSize);
+	void insert(unsigned int item, const Bounds& b);
+	// every item in a cell the box overlaps, may hold duplicates
+	void query(const Bounds& b, std::vector<unsigned int>& out) const;
+
+	inline size_t GetNumCells() { return cells.size(); }
+
+private:
+	static unsigned long long Key(int x, int y, int z);
+
+	float cellSize = 1.0f;
+	std::unordered_map<unsigned long long, std::vector<unsigned int>> cells;
+	// boxes spanning too many cells, handed to every query instead
+	std::vector<unsigned int> oversized;
+};
+
+// works out which point lights can reach each drawable. PointLightComponent::distance is the light's range
+// (the shaders fade it to zero there), so its sphere is tested against the bounds of the drawables around it
+// and each draw only loops over the lights in its own list. every light is uploaded once a frame to a
+// storage buffer and a draw just sets its indices.
+class LightAssignment
+{
+public:
+	LightAssignment();
+	~LightAssignment();
+
+	// rebuilds the lists and uploads the lights, leaving them bound at POINT_LIGHT_BINDING
+	void update(const std::vector<std::shared_ptr<MeshComponent>>& meshes, const std::vector<std::shared_ptr<PointLightComponent>>& lights);
+
+	// indices in to the light buffer, by position in the meshes given to update
+	inline const std::vector<int>& GetLights(unsigned int drawable) { return drawableLights[drawable]; }
+	// longest list this frame, what the shader variants need to be built for
+	inline unsigned int GetMaxLights() { return maxLights; }
+	inline unsigned int GetNumLights() { return (unsigned int)gpuLights.size(); }
+
+	void ui();
+
+private:
+	struct GPULight
+	{
+		// xyz position, w range
+		glm::vec4 positionRadius;
+		glm::vec4 colour;
+	};
+
+	void upload();
+
+	SpatialGrid grid;
+	std::vector<Bounds> bounds;
+	std::vector<std::vector<int>> drawableLights;
+	// last light that tested each drawable, so duplicates from the grid are skipped
+	std::vector<int> tested;
+	std::vector<unsigned int> candidates;
+	unsigned int maxLights;
+	size_t totalAssigned;
+
+	std::vector<GPULight> gpuLights;
+	unsigned int buffer;
+	size_t bufferCapacity;
+};
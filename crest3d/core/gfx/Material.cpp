@@ -0,0 +1,311 @@
+#include "Material.h"
+#include "ShaderVariants.h"
+#include "AssetManager.h"
+#include "SamplerCache.h"
+#include "Debug.h"
+
+int Material::SlotForType(TextureType t)
+{
+	switch (t)
+	{
+	case TextureType::diffuse: return MATERIAL_DIFFUSE;
+	case TextureType::normal: return MATERIAL_NORMAL;
+	case TextureType::ao: return MATERIAL_AO;
+	case TextureType::roughness: return MATERIAL_ROUGHNESS;
+	case TextureType::metallic: return MATERIAL_METALLIC;
+	default: return -1;
+	}
+}
+
+PropertyId Material::METALLIC = PropertySchema::Intern("metallicValue");
+PropertyId Material::ROUGHNESS = PropertySchema::Intern("roughnessValue");
+PropertyId Material::AO = PropertySchema::Intern("aoValue");
+PropertyId Material::LAYER[MATERIAL_NUM_SLOTS] = {
+	PropertySchema::Intern("diffuseLayer"),
+	PropertySchema::Intern("normalLayer"),
+	PropertySchema::Intern("aoLayer"),
+	PropertySchema::Intern("roughnessLayer"),
+	PropertySchema::Intern("metallicLayer")
+};
+
+const std::shared_ptr<const PropertySchema>& Material::GetSchema()
+{
+	static std::shared_ptr<const PropertySchema> schema = []()
+	{
+		std::shared_ptr<PropertySchema> s = std::make_shared<PropertySchema>();
+		s->add("metallicValue", PROPERTY_FLOAT);
+		s->add("roughnessValue", PROPERTY_FLOAT);
+		s->add("aoValue", PROPERTY_FLOAT);
+		for (unsigned int i = 0; i < MATERIAL_NUM_SLOTS; i++)
+		{
+			s->add(PropertySchema::NameOf(LAYER[i]), PROPERTY_INT);
+		}
+		return s;
+	}();
+	return schema;
+}
+
+Material::Material() : parameters(GetSchema())
+{
+	parameters.SetProperty(METALLIC, 0.0f);
+	parameters.SetProperty(ROUGHNESS, 0.7f);
+	parameters.SetProperty(AO, 0.7f);
+}
+
+void Material::bind()
+{
+	bindTextures();
+	bindParameters();
+}
+
+void Material::bindTextures()
+{
+	if (GLEW_ARB_multi_bind)
+	{
+		glBindTextures(0, MATERIAL_NUM_SLOTS, textures);
+		glBindSamplers(0, MATERIAL_NUM_SLOTS, samplers);
+	}
+	else
+	{
+		for (unsigned int i = 0; i < MATERIAL_NUM_SLOTS; i++)
+		{
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(target, textures[i]);
+			glBindSampler(i, samplers[i]);
+		}
+	}
+}
+
+void Material::bindParameters()
+{
+	// only re-uploaded when a parameter changed
+	parameterBuffer.upload(parameters);
+	parameterBuffer.bind(PROPERTY_BLOCK_MATERIAL);
+}
+
+MaterialLibrary::MaterialLibrary(ShaderVariants* _variants, AssetManager* _assets)
+{
+	variants = _variants;
+	assets = _assets;
+	numPointLights = 0;
+	shadows = false;
+	variantsEnabled = variants->enabled;
+	useTextureArrays = true;
+	numPackedMaps = 0;
+	reset();
+}
+
+std::shared_ptr<Material> MaterialLibrary::get(const std::vector<Texture>& textures)
+{
+	std::vector<unsigned int> key;
+	for (auto& t : textures)
+	{
+		key.emplace_back(t.t_Id);
+	}
+	std::sort(key.begin(), key.end());
+
+	auto it = materialsByTextures.find(key);
+	if (it != materialsByTextures.end())
+	{
+		return materials[it->second];
+	}
+
+	std::shared_ptr<Material> m = create(textures, true);
+	materialsByTextures[key] = m->id;
+	return m;
+}
+
+std::shared_ptr<Material> MaterialLibrary::GetDefault()
+{
+	// never packed, the skinned shaders only have the 2d path
+	if (defaultMaterial == nullptr)
+	{
+		defaultMaterial = create(std::vector<Texture>(), false);
+	}
+	return defaultMaterial;
+}
+
+std::shared_ptr<Material> MaterialLibrary::create(const std::vector<Texture>& textures, bool packable)
+{
+	std::shared_ptr<Material> m = std::make_shared<Material>();
+	m->id = materials.size();
+	m->packable = packable;
+	m->features = ShaderVariants::FeaturesFromTextures(textures);
+
+	// defaults first, so the variant never reads an unbound unit even if it samples a map it doesn't need
+	m->maps[MATERIAL_DIFFUSE] = assets->defaultDiffuse->asset->t_Id;
+	m->maps[MATERIAL_NORMAL] = assets->defaultNormal->asset->t_Id;
+	m->maps[MATERIAL_AO] = assets->defaultAO->asset->t_Id;
+	m->maps[MATERIAL_ROUGHNESS] = assets->defaultRoughness->asset->t_Id;
+	m->maps[MATERIAL_METALLIC] = assets->defaultMetallic->asset->t_Id;
+	for (auto& t : textures)
+	{
+		int slot = Material::SlotForType(t.t_Type);
+		if (slot >= 0)
+		{
+			m->maps[slot] = t.t_Id;
+		}
+	}
+	for (unsigned int i = 0; i < MATERIAL_NUM_SLOTS; i++)
+	{
+		m->samplers[i] = SamplerCache::MaterialSampler();
+	}
+	// plain maps until the next packTextures
+	applyTextureArrays(*m);
+
+	materials.emplace_back(m);
+	return m;
+}
+
+void MaterialLibrary::update(unsigned int _numPointLights, bool _shadows)
+{
+	bool changed = ShaderVariants::LightBucket(_numPointLights) != ShaderVariants::LightBucket(numPointLights)
+		|| variants->enabled != variantsEnabled || _shadows != shadows;
+	numPointLights = _numPointLights;
+	shadows = _shadows;
+	variantsEnabled = variants->enabled;
+	if (!changed)
+	{
+		return;
+	}
+	for (auto& m : materials)
+	{
+		resolveShader(*m);
+	}
+}
+
+void MaterialLibrary::packTextures()
+{
+	std::vector<unsigned int> maps;
+	for (auto& m : materials)
+	{
+		maps.insert(maps.end(), m->maps, m->maps + MATERIAL_NUM_SLOTS);
+	}
+	std::sort(maps.begin(), maps.end());
+	maps.erase(std::unique(maps.begin(), maps.end()), maps.end());
+	if (maps.size() == numPackedMaps)
+	{
+		return;
+	}
+
+	textureArrays.pack(maps);
+	numPackedMaps = maps.size();
+	for (auto& m : materials)
+	{
+		applyTextureArrays(*m);
+	}
+	reset();
+}
+
+void MaterialLibrary::applyTextureArrays(Material& m)
+{
+	TextureLayer layers[MATERIAL_NUM_SLOTS];
+	bool packed = useTextureArrays && m.packable;
+	for (unsigned int i = 0; i < MATERIAL_NUM_SLOTS && packed; i++)
+	{
+		packed = textureArrays.find(m.maps[i], layers[i]);
+	}
+
+	// a variant samples either all arrays or all 2d textures, so one unpacked map keeps the whole material on 2d
+	for (unsigned int i = 0; i < MATERIAL_NUM_SLOTS; i++)
+	{
+		m.textures[i] = packed ? layers[i].array : m.maps[i];
+		m.parameters.SetProperty(Material::LAYER[i], packed ? layers[i].layer : 0u);
+	}
+	m.target = packed ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+	m.features = packed ? (m.features | SHADER_TEXTURE_ARRAYS) : (m.features & ~SHADER_TEXTURE_ARRAYS);
+	resolveShader(m);
+}
+
+void MaterialLibrary::bind(const std::shared_ptr<Material>& material)
+{
+	if (material->id == boundMaterial)
+	{
+		return;
+	}
+	if (!texturesBound || memcmp(boundTextures, material->textures, sizeof(boundTextures)) != 0
+		|| memcmp(boundSamplers, material->samplers, sizeof(boundSamplers)) != 0)
+	{
+		material->bindTextures();
+		memcpy(boundTextures, material->textures, sizeof(boundTextures));
+		memcpy(boundSamplers, material->samplers, sizeof(boundSamplers));
+		texturesBound = true;
+		numTextureBinds++;
+	}
+	material->bindParameters();
+	boundMaterial = material->id;
+}
+
+void MaterialLibrary::unbind()
+{
+	// sampler objects override texture parameters, leaving them bound would change how everything drawn after samples
+	for (unsigned int i = 0; i < MATERIAL_NUM_SLOTS; i++)
+	{
+		glBindSampler(i, 0);
+	}
+	boundMaterial = UINT_MAX;
+	texturesBound = false;
+}
+
+void MaterialLibrary::refreshSamplers()
+{
+	unsigned int sampler = SamplerCache::MaterialSampler();
+	for (auto& m : materials)
+	{
+		for (unsigned int i = 0; i < MATERIAL_NUM_SLOTS; i++)
+		{
+			m->samplers[i] = sampler;
+		}
+	}
+	reset();
+}
+
+void MaterialLibrary::resolveShader(Material& m)
+{
+	m.shader = variants->get(m.features | (shadows ? SHADER_SHADOWS : 0), numPointLights);
+	m.gbufferShader = nullptr;
+}
+
+const std::shared_ptr<ShaderComponent>& MaterialLibrary::GetGBufferShader(Material& m)
+{
+	// lights and shadows are applied afterwards, so there's only ever the one bucket
+	if (m.gbufferShader == nullptr)
+	{
+		m.gbufferShader = variants->get(m.features | SHADER_GBUFFER, 0);
+	}
+	return m.gbufferShader;
+}
+
+void MaterialLibrary::ui()
+{
+	if (SamplerCache::ui())
+	{
+		refreshSamplers();
+	}
+	if (ImGui::Checkbox("Texture Arrays", &useTextureArrays))
+	{
+		for (auto& m : materials)
+		{
+			applyTextureArrays(*m);
+		}
+	}
+	ImGui::SameLine();
+	ImGui::Text("(%u arrays, %.1f MB)", (unsigned int)textureArrays.GetNumArrays(), textureArrays.GetMemoryUsage() / (1024.0f * 1024.0f));
+	ImGui::Text("Texture binds last frame: %u", numTextureBinds);
+	if (ImGui::TreeNode("Materials", "Materials: %u", (unsigned int)materials.size()))
+	{
+		for (auto& m : materials)
+		{
+			ImGui::PushID(m->id);
+			float metallic = m->parameters.GetProperty<float>(Material::METALLIC);
+			float roughness = m->parameters.GetProperty<float>(Material::ROUGHNESS);
+			float ao = m->parameters.GetProperty<float>(Material::AO);
+			ImGui::Text("Material %u", m->id);
+			if (ImGui::SliderFloat("Metallic", &metallic, 0.0f, 1.0f)) { m->parameters.SetProperty(Material::METALLIC, metallic); }
+			if (ImGui::SliderFloat("Roughness", &roughness, 0.0f, 1.0f)) { m->parameters.SetProperty(Material::ROUGHNESS, roughness); }
+			if (ImGui::SliderFloat("AO", &ao, 0.0f, 1.0f)) { m->parameters.SetProperty(Material::AO, ao); }
+			ImGui::PopID();
+		}
+		ImGui::TreePop();
+	}
+}
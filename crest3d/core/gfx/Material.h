@@ -1,13 +1,121 @@
 #pragma once
+#include "Common.h"
+#include "components/ShaderComponent.h"
+#include "RenderGroup.h"
+#include "TextureArrays.h"
 
-#include "Shader.h"
+class ShaderVariants;
+class AssetManager;
 
+// every material shader samples its maps from the same units, so the sampler uniforms are set once per program
+// and a draw only has to bind textures. see Shader::fillMappings
+enum MaterialSlot : unsigned int
+{
+	MATERIAL_DIFFUSE = 0,
+	MATERIAL_NORMAL = 1,
+	MATERIAL_AO = 2,
+	MATERIAL_ROUGHNESS = 3,
+	MATERIAL_METALLIC = 4,
+	MATERIAL_NUM_SLOTS = 5
+};
+
+// everything needed to draw with a set of textures, resolved once when the material is built.
+// binding a material is two array binds and a uniform buffer, no lookups.
 class Material {
 public:
-	Material() {};
+	Material();
 	~Material() {};
 
-	std::shared_ptr<Shader> shader;
-	std::map<std::string, std::shared_ptr<Texture>> maps;
+	unsigned int id = 0;
+	unsigned int features = 0;
+	std::shared_ptr<ShaderComponent> shader;
+	// g-buffer variant for the deferred path, resolved the first time it's asked for
+	std::shared_ptr<ShaderComponent> gbufferShader;
+
+	// the 2d texture of each slot, indexed by MaterialSlot. missing maps point at the asset manager's defaults
+	unsigned int maps[MATERIAL_NUM_SLOTS] = {};
+	// binding table, either the maps or the texture arrays they were packed in to
+	unsigned int textures[MATERIAL_NUM_SLOTS] = {};
+	unsigned int samplers[MATERIAL_NUM_SLOTS] = {};
+	unsigned int target = GL_TEXTURE_2D;
+	// false keeps the material on 2d textures even when texture arrays are on
+	bool packable = true;
+	// constants used when the matching map is missing and the array layer of each map,
+	// laid out as MaterialBlock in the pbr shaders
+	PropertyGroup parameters;
+
+	// textures, samplers and the parameter block
+	void bind();
+	void bindTextures();
+	void bindParameters();
+
+	static int SlotForType(TextureType t);
+	static const std::shared_ptr<const PropertySchema>& GetSchema();
+	static PropertyId METALLIC, ROUGHNESS, AO;
+	static PropertyId LAYER[MATERIAL_NUM_SLOTS];
+
+private:
+	PropertyBuffer parameterBuffer;
+};
+
+// owns every material, deduplicated by their texture set so meshes sharing maps share a material.
+// materials are looked up by id when drawing.
+class MaterialLibrary
+{
+public:
+	MaterialLibrary(ShaderVariants* variants, AssetManager* assets);
+
+	// built the first time a texture set is seen
+	std::shared_ptr<Material> get(const std::vector<Texture>& textures);
+	inline std::shared_ptr<Material> GetMaterial(unsigned int id) { return materials[id]; }
+	inline size_t GetNumMaterials() { return materials.size(); }
+	// default textures and parameters, for drawables that don't have a material of their own
+	std::shared_ptr<Material> GetDefault();
+
+	// re-resolves the shader variant of every material when the light bucket, shadows or the variants toggle changes
+	void update(unsigned int numPointLights, bool shadows = false);
+
+	// the variant writing this material to the g-buffer
+	const std::shared_ptr<ShaderComponent>& GetGBufferShader(Material& m);
+
+	// pack every material's maps in to texture arrays, only does work when new textures showed up since the last call
+	void packTextures();
+
+	// skips rebinding the same material back to back, and the textures when they match what's bound
+	// (materials packed in to the same arrays). call reset when anything else may have touched the units
+	void bind(const std::shared_ptr<Material>& material);
+	inline void reset() { boundMaterial = UINT_MAX; texturesBound = false; numTextureBinds = 0; }
+	// put the units back to plain texture sampling once the materials are drawn
+	void unbind();
+	// pick up a changed SamplerCache::anisotropy
+	void refreshSamplers();
+
+	// materials sample from texture arrays when all their maps were packed
+	bool useTextureArrays;
+
+	void ui();
+
+private:
+	std::shared_ptr<Material> create(const std::vector<Texture>& textures, bool packable);
+	void resolveShader(Material& m);
+	// point the binding table at the arrays or the plain maps
+	void applyTextureArrays(Material& m);
+
+	ShaderVariants* variants;
+	AssetManager* assets;
+	unsigned int numPointLights;
+	bool shadows;
+	bool variantsEnabled;
+	unsigned int boundMaterial;
+	bool texturesBound;
+	unsigned int boundTextures[MATERIAL_NUM_SLOTS];
+	unsigned int boundSamplers[MATERIAL_NUM_SLOTS];
+	unsigned int numTextureBinds;
+
+	TextureArrays textureArrays;
+	size_t numPackedMaps;
 
-};
\ No newline at end of file
+	std::vector<std::shared_ptr<Material>> materials;
+	std::map<std::vector<unsigned int>, unsigned int> materialsByTextures;
+	std::shared_ptr<Material> defaultMaterial;
+};
@@ -67,81 +67,51 @@ Mesh::Mesh(std::vector<float> vertexPositions, std::vector<unsigned> indices)
 	}
 	this->vertices = newVerts;
 
+	calcMeshBounds();
 	setupMesh();
 }
 
 void Mesh::Draw(Shader shader)
 {
-	int diffuseCount = 0;
-	int specularCount = 0;
-	int reflectionCount = 0;
-	int normalCount = 0;
-
-	for (unsigned int i = 0; i < textures.size(); i++)
-	{
-		glActiveTexture(GL_TEXTURE0 + i);
-		unsigned int uniformLocation = shader.textureIdMappings[textures[i].t_Type];
-		shader.setIntID(uniformLocation, i);
-		glBindTexture(GL_TEXTURE_2D, textures[i].t_Id);
-	}
-
-	glBindVertexArray(vao);
-	glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-	for (int i = 0; i < textures.size(); i++)
-	{
-		glActiveTexture(GL_TEXTURE0 + i);
-		glBindTexture(GL_TEXTURE_2D, 0);
-	}
-	glBindVertexArray(0);
+	bindTextures(&shader);
+	DrawGeometry();
 }
 
 void Mesh::Draw(std::shared_ptr<Shader> shader)
 {
-	int diffuseCount = 0;
-	int specularCount = 0;
-	int reflectionCount = 0;
-	int normalCount = 0;
-
-	for (unsigned int i = 0; i < textures.size(); i++)
-	{
-		glActiveTexture(GL_TEXTURE0 + i);
-		unsigned int uniformLocation = shader->textureIdMappings[textures[i].t_Type];
-		shader->setIntID(uniformLocation, i);
-		glBindTexture(GL_TEXTURE_2D, textures[i].t_Id);
-	}
-
-	glBindVertexArray(vao);
-	glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-	for (int i = 0; i < textures.size(); i++)
-	{
-		glActiveTexture(GL_TEXTURE0 + i);
-		glBindTexture(GL_TEXTURE_2D, 0);
-	}
-	glBindVertexArray(0);
+	bindTextures(shader.get());
+	DrawGeometry();
 }
 
 void Mesh::Draw(Shader* shader)
 {
-	int diffuseCount = 0;
-	int specularCount = 0;
-	int reflectionCount = 0;
-	int normalCount = 0;
+	bindTextures(shader);
+	DrawGeometry();
+}
 
-	for (unsigned int i = 0; i < textures.size(); i++)
+void Mesh::bindTextures(Shader* shader)
+{
+	// material maps go to their fixed units so they don't clobber each other (or the defaults bound by the scene),
+	// anything else goes after them
+	unsigned int extraUnit = MATERIAL_NUM_SLOTS;
+	for (auto& t : textures)
 	{
-		glActiveTexture(GL_TEXTURE0 + i);
-		unsigned int uniformLocation = shader->textureIdMappings[textures[i].t_Type];
-		shader->setIntID(uniformLocation, i);
-		glBindTexture(GL_TEXTURE_2D, textures[i].t_Id);
+		int slot = Material::SlotForType(t.t_Type);
+		unsigned int unit = slot;
+		if (slot < 0)
+		{
+			unit = extraUnit++;
+			shader->setIntID(shader->textureIdMappings[t.t_Type], unit);
+		}
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D, t.t_Id);
 	}
+}
 
+void Mesh::DrawGeometry()
+{
 	glBindVertexArray(vao);
 	glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-	for (int i = 0; i < textures.size(); i++)
-	{
-		glActiveTexture(GL_TEXTURE0 + i);
-		glBindTexture(GL_TEXTURE_2D, 0);
-	}
 	glBindVertexArray(0);
 }
 
@@ -214,6 +184,18 @@ void Mesh::calcMeshBounds()
 	xBound = currentMaxX;
 	yBound = currentMaxY;
 	zBound = currentMaxZ;
+
+	boundsMin = glm::vec3(0.0f);
+	boundsMax = glm::vec3(0.0f);
+	if (!vertices.empty())
+	{
+		boundsMin = boundsMax = vertices[0].position;
+		for (auto& v : vertices)
+		{
+			boundsMin = glm::min(boundsMin, v.position);
+			boundsMax = glm::max(boundsMax, v.position);
+		}
+	}
 }
 
 void Mesh::generateConvexHull()
@@ -10,6 +10,13 @@ struct Vertex {
 	glm::vec3 tangent;
 };
 
+// axis aligned box
+struct Bounds
+{
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
 struct Face
 {
 	std::vector<int> indices;
@@ -25,6 +32,8 @@ public:
 	std::vector<Face> faces;
 	std::vector<float> physicsPoints;
 	std::vector<int> physicsIndices;
+	// built from the textures by the MaterialLibrary the first time the mesh is drawn by a scene
+	std::shared_ptr<Material> material;
 
 	Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures)
 	{
@@ -32,7 +41,7 @@ public:
 		this->indices = indices;
 		this->textures = textures;
 
-		//calcMeshBounds();
+		calcMeshBounds();
 		setupMesh();
 		physicsPoints = getVertexValues();
 		physicsIndices = getIndexValues();
@@ -46,7 +55,7 @@ public:
 		this->textures = textures;
 		this->faces = faces;
 
-		//calcMeshBounds();
+		calcMeshBounds();
 		setupMesh();
 		generateConvexHull();
 	};
@@ -55,14 +64,19 @@ public:
 	void Draw(Shader shader);
 	void Draw(std::shared_ptr<Shader> shader);
 	void Draw(Shader* shader);
+	// just the vao, textures come from the bound material
+	void DrawGeometry();
 	void TestDraw(Shader shader);
 	void calcMeshBounds();
 	//physics position;
 
 	unsigned int vao, vbo, ibo;
 	void setupMesh();
+	void bindTextures(Shader* shader);
 	float getCullSphereRadius();
 	float xBound, yBound, zBound;
+	// local space box around the vertices, from calcMeshBounds
+	glm::vec3 boundsMin, boundsMax;
 
 	std::vector<glm::vec3> getVertexPositions();
 	std::vector<float> getVertexValues();
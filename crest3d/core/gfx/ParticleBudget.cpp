@@ -0,0 +1,134 @@
+#include "ParticleBudget.h"
+#include "components/ParticleSystemComponent.h"
+#include "components/CameraComponent.h"
+#include "Entity.h"
+
+ParticleBudget::ParticleBudget()
+{
+	budget = 1000000;
+	minCoverage = 0.001f;
+	totalDemand = totalAllocated = totalAlive = 0;
+	visibleEmitters = culledEmitters = 0;
+}
+
+void ParticleBudget::update(const std::vector<std::shared_ptr<ParticleSystemComponent>>& systems, const std::shared_ptr<CameraComponent>& camera)
+{
+	shares.clear();
+	totalDemand = totalAllocated = totalAlive = 0;
+	visibleEmitters = culledEmitters = 0;
+	if (camera == nullptr)
+	{
+		return;
+	}
+	camera->MakeFrustum();
+	glm::vec3 cameraPosition = camera->attachedEntity->transform->position;
+	float tanHalfFov = tanf(glm::radians(camera->fov) * 0.5f);
+
+	unsatisfied.clear();
+	float totalWeight = 0.0f;
+	for (unsigned int i = 0; i < systems.size(); i++)
+	{
+		ParticleSystemComponent* ps = systems[i].get();
+		ParticleBudgetShare& share = ps->budgetShare;
+		ParticleEmitter& emitter = ps->particleSystem->emitter;
+		glm::vec3 position = ps->attachedEntity->transform->position;
+		float reach = emitter.GetReach();
+
+		share.distance = glm::length(position - cameraPosition);
+		share.visible = camera->checkSphere(position, reach);
+		share.demand = (unsigned int)std::min(emitter.GetSteadyCount(), (float)ParticleSystem::MAX_PARTICLES);
+		share.allocation = 0;
+		if (!share.visible)
+		{
+			// keeps last frame's scale, the particles it has are left as they are until it's back
+			share.weight = 0.0f;
+			culledEmitters++;
+			continue;
+		}
+		// inside the reach the emitter fills the screen
+		float projected = reach / std::max(share.distance * tanHalfFov, 0.0001f);
+		share.coverage = std::min(projected * projected, 1.0f);
+		share.weight = std::max(ps->priority, 0.0f) * std::max(share.coverage, minCoverage);
+		totalWeight += share.weight;
+		totalDemand += share.demand;
+		unsatisfied.emplace_back(i);
+		visibleEmitters++;
+	}
+
+	// water filling: everyone wanting no more than their share of what's left is given it in full, which
+	// raises everyone else's share. at most one pass per emitter, normally one or two
+	unsigned int remaining = budget;
+	bool filled = true;
+	while (filled && !unsatisfied.empty() && totalWeight > 0.0f)
+	{
+		filled = false;
+		float perWeight = remaining / totalWeight;
+		for (unsigned int u = 0; u < unsatisfied.size();)
+		{
+			ParticleBudgetShare& share = systems[unsatisfied[u]]->budgetShare;
+			if (share.demand <= share.weight * perWeight)
+			{
+				share.allocation = share.demand;
+				remaining -= share.demand;
+				totalWeight -= share.weight;
+				unsatisfied[u] = unsatisfied.back();
+				unsatisfied.pop_back();
+				filled = true;
+				continue;
+			}
+			u++;
+		}
+	}
+	// the rest split what's left by weight
+	for (unsigned int i : unsatisfied)
+	{
+		ParticleBudgetShare& share = systems[i]->budgetShare;
+		share.allocation = totalWeight > 0.0f ? (unsigned int)(remaining * (share.weight / totalWeight)) : 0;
+	}
+
+	for (auto& ps : systems)
+	{
+		ParticleBudgetShare& share = ps->budgetShare;
+		if (!share.visible)
+		{
+			continue;
+		}
+		share.spawnScale = share.demand > 0 ? std::min((float)share.allocation / share.demand, 1.0f) : 1.0f;
+		ps->particleSystem->spawnScale = share.spawnScale;
+		ps->particleSystem->particleLimit = share.allocation;
+		totalAllocated += share.allocation;
+		// the gpu never says how many it has, it's assumed to be full
+		totalAlive += ps->gpuSimulation ? share.allocation : ps->particleSystem->particleCount;
+	}
+	for (auto& ps : systems)
+	{
+		shares.emplace_back(ps->attachedEntity->name, ps->budgetShare);
+	}
+}
+
+void ParticleBudget::ui()
+{
+	int b = (int)budget;
+	if (ImGui::DragInt("Particle Budget", &b, 1000.0f, 0, 10000000))
+	{
+		budget = (unsigned int)std::max(b, 0);
+	}
+	float utilisation = budget > 0 ? 100.0f * totalAlive / budget : 0.0f;
+	ImGui::Text("Particles: %u alive of %u (%.1f%%), %u allocated, %u wanted", totalAlive, budget, utilisation, totalAllocated, totalDemand);
+	ImGui::Text("Emitters: %u visible, %u culled", visibleEmitters, culledEmitters);
+	if (ImGui::TreeNode("Emitter Budgets"))
+	{
+		for (auto& s : shares)
+		{
+			const ParticleBudgetShare& share = s.second;
+			if (!share.visible)
+			{
+				ImGui::Text("%s: culled", s.first.c_str());
+				continue;
+			}
+			ImGui::Text("%s: %u / %u (x%.2f), %.0fm, %.1f%% screen", s.first.c_str(),
+				share.allocation, share.demand, share.spawnScale, share.distance, share.coverage * 100.0f);
+		}
+		ImGui::TreePop();
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "Common.h"
+
+class ParticleSystemComponent;
+class CameraComponent;
+
+// what the ParticleBudget gave one emitter this frame
+struct ParticleBudgetShare
+{
+	// off screen emitters aren't simulated or drawn
+	bool visible = true;
+	float distance = 0.0f;
+	// fraction of the screen the emitter's reach covers, capped at 1
+	float coverage = 1.0f;
+	float weight = 0.0f;
+	// particles it would keep alive at its full rate, and how many it gets
+	unsigned int demand = 0;
+	unsigned int allocation = 0;
+	// allocation / demand, what its spawn rate is multiplied by
+	float spawnScale = 1.0f;
+};
+
+// shares one particle count between every emitter in the scene, so the cost of particles is bounded however
+// many there are. visible emitters get a weight from their priority and screen coverage (which falls off with
+// distance), then the budget is split by weight, any emitter needing less than its share passing the rest on.
+// an emitter's spawn rate is scaled down to fit what it got, and its pool is capped there
+class ParticleBudget
+{
+public:
+	ParticleBudget();
+
+	// before the emitters update, the camera's frustum is rebuilt here
+	void update(const std::vector<std::shared_ptr<ParticleSystemComponent>>& systems, const std::shared_ptr<CameraComponent>& camera);
+	void ui();
+
+	unsigned int budget;
+	// the least coverage an emitter is weighted by, so a far one still gets something
+	float minCoverage;
+
+private:
+	// for the report, by emitter
+	std::vector<std::pair<std::string, ParticleBudgetShare>> shares;
+	unsigned int totalDemand, totalAllocated, totalAlive;
+	unsigned int visibleEmitters, culledEmitters;
+	std::vector<unsigned int> unsatisfied;
+};
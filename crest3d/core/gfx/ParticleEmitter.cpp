@@ -0,0 +1,292 @@
+#include "ParticleEmitter.h"
+#include "serialization/Serializer.hpp"
+#include "Debug.h"
+
+ParticleEmitter::ParticleEmitter()
+{
+	spawnRate.setConstant(10000.0f);
+	duration = 1.0f;
+	// a 60hz frame's worth
+	maxSpawnPerFrame = 160;
+
+	shape = PARTICLE_SHAPE_POINT;
+	shapeSize = glm::vec3(1.0f);
+
+	lifetimeMin = lifetimeMax = 5.0f;
+	direction = glm::vec3(0.0f, 1.0f, 0.0f);
+	speedMin = speedMax = 10.0f;
+	spread = 1.5f;
+	gravity = -3.81f;
+	sizeMin = 0.1f;
+	sizeMax = 0.6f;
+	colourMin = glm::vec4(0.0f);
+	colourMax = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f / 3.0f);
+
+	collision = PARTICLE_COLLISION_NONE;
+	restitution = 0.5f;
+	collisionThickness = 1.0f;
+	softDistance = 0.5f;
+	blend = PARTICLE_BLEND_ADDITIVE;
+
+	time = 0.0f;
+	spawnAccumulator = 0.0f;
+}
+
+unsigned int ParticleEmitter::emit(float deltaTime, float rateScale, float capScale)
+{
+	time += deltaTime;
+	if (duration > 0.0f)
+	{
+		time = fmodf(time, duration);
+	}
+	spawnAccumulator += spawnRate.evaluate(duration > 0.0f ? time / duration : 0.0f) * rateScale * deltaTime;
+	unsigned int count = (unsigned int)std::max(spawnAccumulator, 0.0f);
+	spawnAccumulator -= count;
+	// whatever the cap cuts is gone, not owed to the next frame
+	return std::min(count, (unsigned int)(maxSpawnPerFrame * capScale));
+}
+
+float ParticleEmitter::GetSteadyCount()
+{
+	return std::max(spawnRate.average(), 0.0f) * (lifetimeMin + lifetimeMax) * 0.5f;
+}
+
+float ParticleEmitter::GetReach()
+{
+	float shapeReach = shape == PARTICLE_SHAPE_POINT ? 0.0f : glm::length(shapeSize);
+	// the fastest particle for its whole life, and the fall it picks up on the way. the simulation
+	// applies half of gravity each step
+	return shapeReach + (speedMax + spread * 1.7320508f) * lifetimeMax + 0.25f * fabsf(gravity) * lifetimeMax * lifetimeMax;
+}
+
+static tinyxml2::XMLElement* SerializeCurve(const ParticleCurve<float>& curve, std::string name, tinyxml2::XMLDocument* doc)
+{
+	auto curveElement = doc->NewElement("Curve");
+	curveElement->SetAttribute("name", name.c_str());
+	for (auto& key : curve.keys)
+	{
+		auto keyElement = doc->NewElement("Key");
+		keyElement->SetAttribute("t", key.first);
+		keyElement->SetAttribute("value", key.second);
+		curveElement->LinkEndChild(keyElement);
+	}
+	return curveElement;
+}
+
+static tinyxml2::XMLElement* SerializeCurve(const ParticleCurve<glm::vec4>& curve, std::string name, tinyxml2::XMLDocument* doc)
+{
+	auto curveElement = doc->NewElement("Curve");
+	curveElement->SetAttribute("name", name.c_str());
+	for (auto& key : curve.keys)
+	{
+		auto keyElement = doc->NewElement("Key");
+		keyElement->SetAttribute("t", key.first);
+		keyElement->SetAttribute("x", key.second.x);
+		keyElement->SetAttribute("y", key.second.y);
+		keyElement->SetAttribute("z", key.second.z);
+		keyElement->SetAttribute("w", key.second.w);
+		curveElement->LinkEndChild(keyElement);
+	}
+	return curveElement;
+}
+
+static void DeserializeCurve(tinyxml2::XMLElement* e, ParticleCurve<float>& curve)
+{
+	std::vector<std::pair<float, float>> keys;
+	for (auto k = e->FirstChildElement("Key"); k != nullptr; k = k->NextSiblingElement("Key"))
+	{
+		keys.emplace_back(k->FloatAttribute("t"), k->FloatAttribute("value"));
+	}
+	if (!keys.empty())
+	{
+		curve.setKeys(keys);
+	}
+}
+
+static void DeserializeCurve(tinyxml2::XMLElement* e, ParticleCurve<glm::vec4>& curve)
+{
+	std::vector<std::pair<float, glm::vec4>> keys;
+	for (auto k = e->FirstChildElement("Key"); k != nullptr; k = k->NextSiblingElement("Key"))
+	{
+		keys.emplace_back(k->FloatAttribute("t"), Serializer::DeserializeVec4(k));
+	}
+	if (!keys.empty())
+	{
+		curve.setKeys(keys);
+	}
+}
+
+tinyxml2::XMLElement* ParticleEmitter::serialize(tinyxml2::XMLDocument* doc)
+{
+	auto peElement = doc->NewElement("ParticleEmitter");
+	peElement->LinkEndChild(SerializeCurve(spawnRate, "spawnRate", doc));
+	peElement->LinkEndChild(Serializer::SerializeFloat(duration, "duration", doc));
+	peElement->LinkEndChild(Serializer::SerializeUnsignedInt(maxSpawnPerFrame, "maxSpawnPerFrame", doc));
+	peElement->LinkEndChild(Serializer::SerializeUnsignedInt(shape, "shape", doc));
+	peElement->LinkEndChild(Serializer::SerializeVec3(shapeSize, "shapeSize", doc));
+	peElement->LinkEndChild(Serializer::SerializeFloat(lifetimeMin, "lifetimeMin", doc));
+	peElement->LinkEndChild(Serializer::SerializeFloat(lifetimeMax, "lifetimeMax", doc));
+	peElement->LinkEndChild(Serializer::SerializeVec3(direction, "direction", doc));
+	peElement->LinkEndChild(Serializer::SerializeFloat(speedMin, "speedMin", doc));
+	peElement->LinkEndChild(Serializer::SerializeFloat(speedMax, "speedMax", doc));
+	peElement->LinkEndChild(Serializer::SerializeFloat(spread, "spread", doc));
+	peElement->LinkEndChild(Serializer::SerializeFloat(gravity, "gravity", doc));
+	peElement->LinkEndChild(Serializer::SerializeFloat(sizeMin, "sizeMin", doc));
+	peElement->LinkEndChild(Serializer::SerializeFloat(sizeMax, "sizeMax", doc));
+	peElement->LinkEndChild(Serializer::SerializeVec4(colourMin, "colourMin", doc));
+	peElement->LinkEndChild(Serializer::SerializeVec4(colourMax, "colourMax", doc));
+	peElement->LinkEndChild(SerializeCurve(speedOverLife, "speedOverLife", doc));
+	peElement->LinkEndChild(SerializeCurve(sizeOverLife, "sizeOverLife", doc));
+	peElement->LinkEndChild(SerializeCurve(colourOverLife, "colourOverLife", doc));
+	peElement->LinkEndChild(Serializer::SerializeUnsignedInt(collision, "collision", doc));
+	peElement->LinkEndChild(Serializer::SerializeFloat(restitution, "restitution", doc));
+	peElement->LinkEndChild(Serializer::SerializeFloat(collisionThickness, "collisionThickness", doc));
+	peElement->LinkEndChild(Serializer::SerializeFloat(softDistance, "softDistance", doc));
+	peElement->LinkEndChild(Serializer::SerializeUnsignedInt(blend, "blend", doc));
+	return peElement;
+}
+
+void ParticleEmitter::deserialize(tinyxml2::XMLElement* e)
+{
+	auto readFloat = [e](const char* name, float& value)
+	{
+		auto element = Serializer::FindElementInComponent(e, "Float", name);
+		if (element != nullptr)
+		{
+			value = Serializer::DeserializeFloat(element->Attribute("value"));
+		}
+	};
+	auto readUnsignedInt = [e](const char* name, unsigned int& value)
+	{
+		auto element = Serializer::FindElementInComponent(e, "UnsignedInt", name);
+		if (element != nullptr)
+		{
+			value = Serializer::DeserializeUnsignedInt(element->Attribute("value"));
+		}
+	};
+	auto readVec3 = [e](const char* name, glm::vec3& value)
+	{
+		auto element = Serializer::FindElementInComponent(e, "Vector3", name);
+		if (element != nullptr)
+		{
+			value = Serializer::DeserializeVec3(element);
+		}
+	};
+	auto readVec4 = [e](const char* name, glm::vec4& value)
+	{
+		auto element = Serializer::FindElementInComponent(e, "Vector4", name);
+		if (element != nullptr)
+		{
+			value = Serializer::DeserializeVec4(element);
+		}
+	};
+	auto readCurve = [e](const char* name, auto& curve)
+	{
+		auto element = Serializer::FindElementInComponent(e, "Curve", name);
+		if (element != nullptr)
+		{
+			DeserializeCurve(element, curve);
+		}
+	};
+
+	unsigned int shapeValue = shape;
+	unsigned int collisionValue = collision;
+	unsigned int blendValue = blend;
+	readCurve("spawnRate", spawnRate);
+	readFloat("duration", duration);
+	readUnsignedInt("maxSpawnPerFrame", maxSpawnPerFrame);
+	readUnsignedInt("shape", shapeValue);
+	shape = (ParticleEmitterShape)std::min(shapeValue, (unsigned int)PARTICLE_SHAPE_BOX);
+	readVec3("shapeSize", shapeSize);
+	readFloat("lifetimeMin", lifetimeMin);
+	readFloat("lifetimeMax", lifetimeMax);
+	readVec3("direction", direction);
+	readFloat("speedMin", speedMin);
+	readFloat("speedMax", speedMax);
+	readFloat("spread", spread);
+	readFloat("gravity", gravity);
+	readFloat("sizeMin", sizeMin);
+	readFloat("sizeMax", sizeMax);
+	readVec4("colourMin", colourMin);
+	readVec4("colourMax", colourMax);
+	readCurve("speedOverLife", speedOverLife);
+	readCurve("sizeOverLife", sizeOverLife);
+	readCurve("colourOverLife", colourOverLife);
+	readUnsignedInt("collision", collisionValue);
+	collision = (ParticleCollision)std::min(collisionValue, (unsigned int)PARTICLE_COLLISION_KILL);
+	readFloat("restitution", restitution);
+	readFloat("collisionThickness", collisionThickness);
+	readFloat("softDistance", softDistance);
+	readUnsignedInt("blend", blendValue);
+	blend = (ParticleBlend)std::min(blendValue, (unsigned int)PARTICLE_BLEND_ALPHA);
+
+	// a particle has to live for some time, or the life curves divide by zero
+	lifetimeMin = std::max(lifetimeMin, 0.001f);
+	lifetimeMax = std::max(lifetimeMax, lifetimeMin);
+	if (glm::length(direction) > 0.0f)
+	{
+		direction = glm::normalize(direction);
+	}
+}
+
+bool ParticleEmitter::load(const char* path)
+{
+	tinyxml2::XMLDocument doc;
+	if (doc.LoadFile(path) != tinyxml2::XML_SUCCESS)
+	{
+		Debug::Warn<ParticleEmitter>(("Couldn't load " + std::string(path)).c_str());
+		return false;
+	}
+	auto e = doc.FirstChildElement("ParticleEmitter");
+	if (e == nullptr)
+	{
+		Debug::Warn<ParticleEmitter>((std::string(path) + " has no ParticleEmitter").c_str());
+		return false;
+	}
+	deserialize(e);
+	return true;
+}
+
+void ParticleEmitter::ui()
+{
+	const char* shapes[] = { "Point", "Sphere", "Box" };
+	int s = shape;
+	if (ImGui::Combo("Shape", &s, shapes, 3))
+	{
+		shape = (ParticleEmitterShape)s;
+	}
+	if (shape != PARTICLE_SHAPE_POINT)
+	{
+		ImGui::DragFloat3("Shape Size", &shapeSize.x, 0.05f, 0.0f, 100.0f);
+	}
+	ImGui::DragFloat2("Lifetime", &lifetimeMin, 0.05f, 0.001f, 60.0f);
+	ImGui::DragFloat3("Direction", &direction.x, 0.01f, -1.0f, 1.0f);
+	ImGui::DragFloat2("Speed", &speedMin, 0.1f, 0.0f, 100.0f);
+	ImGui::DragFloat("Spread", &spread, 0.05f, 0.0f, 50.0f);
+	ImGui::DragFloat("Gravity", &gravity, 0.05f, -50.0f, 50.0f);
+	ImGui::DragFloat2("Size", &sizeMin, 0.01f, 0.0f, 10.0f);
+	ImGui::ColorEdit4("Colour Min", &colourMin.x);
+	ImGui::ColorEdit4("Colour Max", &colourMax.x);
+	const char* collisions[] = { "None", "Bounce", "Kill" };
+	int c = collision;
+	if (ImGui::Combo("Collision (GPU)", &c, collisions, 3))
+	{
+		collision = (ParticleCollision)c;
+	}
+	if (collision == PARTICLE_COLLISION_BOUNCE)
+	{
+		ImGui::DragFloat("Restitution", &restitution, 0.01f, 0.0f, 1.0f);
+	}
+	if (collision != PARTICLE_COLLISION_NONE)
+	{
+		ImGui::DragFloat("Collision Thickness", &collisionThickness, 0.05f, 0.01f, 100.0f);
+	}
+	ImGui::DragFloat("Soft Distance", &softDistance, 0.01f, 0.0f, 10.0f);
+	const char* blends[] = { "Additive", "Alpha" };
+	int b = blend;
+	if (ImGui::Combo("Blend", &b, blends, 2))
+	{
+		blend = (ParticleBlend)b;
+	}
+	lifetimeMax = std::max(lifetimeMax, lifetimeMin);
+}
@@ -0,0 +1,156 @@
+#pragma once
+#include "Common.h"
+
+// a value over time in [0, 1], piecewise linear between keys. baked in to a table so evaluating it
+// is a clamp and a lerp, with no searching or branching per particle
+template <typename T>
+struct ParticleCurve
+{
+	static constexpr int SAMPLES = 32;
+
+	ParticleCurve(T value = T(1.0f)) { setConstant(value); }
+	void setConstant(T value) { setKeys({ { 0.0f, value } }); }
+	// (time, value) in any order, at least one
+	void setKeys(std::vector<std::pair<float, T>> _keys)
+	{
+		keys = _keys;
+		std::sort(keys.begin(), keys.end(), [](const std::pair<float, T>& a, const std::pair<float, T>& b) { return a.first < b.first; });
+		bake();
+	}
+
+	inline T evaluate(float t) const
+	{
+		float x = std::min(std::max(t, 0.0f), 1.0f) * (SAMPLES - 1);
+		int i = (int)x;
+		return table[i] + (table[i + 1] - table[i]) * (x - i);
+	}
+	// the same everywhere, so callers can take it out of their loops
+	inline bool IsConstant() const { return constant; }
+	inline T average() const
+	{
+		T sum = table[0];
+		for (int s = 1; s < SAMPLES; s++)
+		{
+			sum += table[s];
+		}
+		return sum * (1.0f / SAMPLES);
+	}
+
+	std::vector<std::pair<float, T>> keys;
+
+private:
+	void bake()
+	{
+		unsigned int k = 0;
+		for (int s = 0; s < SAMPLES; s++)
+		{
+			float t = s / (float)(SAMPLES - 1);
+			while (k + 1 < keys.size() && keys[k + 1].first <= t)
+			{
+				k++;
+			}
+			if (k + 1 >= keys.size() || t <= keys[k].first)
+			{
+				table[s] = keys[k].second;
+				continue;
+			}
+			float f = (t - keys[k].first) / std::max(keys[k + 1].first - keys[k].first, 1e-6f);
+			table[s] = keys[k].second + (keys[k + 1].second - keys[k].second) * f;
+		}
+		// a spare sample so i + 1 never needs clamping
+		table[SAMPLES] = table[SAMPLES - 1];
+		constant = true;
+		for (auto& key : keys)
+		{
+			constant = constant && key.second == keys[0].second;
+		}
+	}
+
+	T table[SAMPLES + 1];
+	bool constant;
+};
+
+// where new particles appear around the emitter
+enum ParticleEmitterShape
+{
+	PARTICLE_SHAPE_POINT,
+	// anywhere inside a sphere of shapeSize.x
+	PARTICLE_SHAPE_SPHERE,
+	// anywhere inside a box of half extents shapeSize
+	PARTICLE_SHAPE_BOX,
+};
+
+// what a particle does when it reaches the scene's depth buffer, see DepthHistory. gpu simulation only
+enum ParticleCollision
+{
+	PARTICLE_COLLISION_NONE,
+	// reflected off the surface, losing 1 - restitution of its speed in to it
+	PARTICLE_COLLISION_BOUNCE,
+	PARTICLE_COLLISION_KILL,
+};
+
+// how particles are laid over the scene, see Scene::renderBehaviour
+enum ParticleBlend
+{
+	// summed, so the order never matters. the fountain
+	PARTICLE_BLEND_ADDITIVE,
+	// over what's behind by alpha, depth sorted or through the TransparencyRenderer
+	PARTICLE_BLEND_ALPHA,
+};
+
+// everything a particle system spawns and simulates with, loaded from xml so effects can change
+// without a rebuild. the defaults are the fountain the system always made
+struct ParticleEmitter
+{
+	ParticleEmitter();
+
+	// spawns for the next deltaTime. keeps the fraction left over, so low rates still emit.
+	// rateScale thins the spawn rate out, capScale lets a catch up step go past maxSpawnPerFrame
+	unsigned int emit(float deltaTime, float rateScale = 1.0f, float capScale = 1.0f);
+	// particles alive once the emitter has been running a while at full rate
+	float GetSteadyCount();
+	// how far from the emitter a particle can get, for culling
+	float GetReach();
+
+	// a ParticleEmitter element, missing values keep what they were
+	void deserialize(tinyxml2::XMLElement* e);
+	tinyxml2::XMLElement* serialize(tinyxml2::XMLDocument* doc);
+	// false if the file has no ParticleEmitter
+	bool load(const char* path);
+	void ui();
+
+	// spawns a second, over a loop of duration seconds
+	ParticleCurve<float> spawnRate;
+	float duration;
+	// a hitch spawns this many at most rather than a burst
+	unsigned int maxSpawnPerFrame;
+
+	ParticleEmitterShape shape;
+	glm::vec3 shapeSize;
+
+	float lifetimeMin, lifetimeMax;
+	// particles leave along direction at a speed in the range, plus up to spread in any direction
+	glm::vec3 direction;
+	float speedMin, speedMax, spread;
+	float gravity;
+	// times the emitter's scale
+	float sizeMin, sizeMax;
+	// each channel is picked in its range on its own
+	glm::vec4 colourMin, colourMax;
+
+	// over a particle's life, multiplying what it spawned with
+	ParticleCurve<float> speedOverLife;
+	ParticleCurve<float> sizeOverLife;
+	ParticleCurve<glm::vec4> colourOverLife;
+
+	// against last frame's depth buffer, so only what the camera saw last frame is there to hit
+	ParticleCollision collision;
+	float restitution;
+	// how far behind the depth buffer a particle still counts as inside what it hit, rather than behind it
+	float collisionThickness;
+	// fades particles out over this distance in front of the depth buffer, 0 for hard edges
+	float softDistance;
+	ParticleBlend blend;
+
+	float time, spawnAccumulator;
+};
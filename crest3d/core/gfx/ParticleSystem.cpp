@@ -1,21 +1,92 @@
 #include "ParticleSystem.h"
 #include "Model.h"
 #include "components/CameraComponent.h"
+#include <chrono>
+#include <cfloat>
 
-ParticleSystem::ParticleSystem()
+// the kernels take four particles at a time with SSE, a scalar loop picks up the rest
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define PARTICLES_SSE
+#include <emmintrin.h>
+#endif
+
+ParticleRandom::ParticleRandom(unsigned long long seed, unsigned long long stream)
+{
+	state = 0;
+	increment = (stream << 1) | 1;
+	next();
+	state += seed;
+	next();
+}
+
+unsigned int ParticleRandom::next()
 {
-	g_particule_position_size_data = new GLfloat[MAX_PARTICLES * 4];
-	g_particule_color_data = new GLubyte[MAX_PARTICLES * 4];
-	lastUsedParticle = 0;
-	for(unsigned int i = 0; i < MAX_PARTICLES; i++)
-	{
-		particles.emplace_back(Particle());
-		particles[i].life = -1.0f;
-		particles[i].cameradistance = -1.0f;
+	unsigned long long old = state;
+	state = old * 6364136223846793005ULL + increment;
+	unsigned int xorshifted = (unsigned int)(((old >> 18) ^ old) >> 27);
+	unsigned int rot = (unsigned int)(old >> 59);
+	return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+}
+
+void ParticlePool::allocate(unsigned int capacity)
+{
+	for (auto* a : { &positionX, &positionY, &positionZ, &velocityX, &velocityY, &velocityZ, &life, &invLifetime, &size, &cameraDistance })
+	{
+		a->resize(capacity);
+		a->shrink_to_fit();
 	}
-	sortCounter = 0;
+	colour.resize(capacity);
+	colour.shrink_to_fit();
+}
 
+void ParticlePool::move(unsigned int from, unsigned int to)
+{
+	positionX[to] = positionX[from];
+	positionY[to] = positionY[from];
+	positionZ[to] = positionZ[from];
+	velocityX[to] = velocityX[from];
+	velocityY[to] = velocityY[from];
+	velocityZ[to] = velocityZ[from];
+	life[to] = life[from];
+	invLifetime[to] = invLifetime[from];
+	size[to] = size[from];
+	cameraDistance[to] = cameraDistance[from];
+	colour[to] = colour[from];
+}
+
+ParticleSystem::ParticleSystem()
+{
+	capacity = MIN_CAPACITY;
+	g_particule_position_size_data = new GLfloat[capacity * 4];
+	g_particule_color_data = new GLubyte[capacity * 4];
+	particles.allocate(capacity);
+	particleCount = 0;
+	peakCount = 0;
+	windowUpdates = 0;
+	avg_cam_distance = 0.0f;
+	depthSort = true;
+	orderIndependent = false;
+	sorted = buffersFilled = false;
+	seed = 0x853c49e6;
+	frame = 0;
+	sortMin = 0.0f;
+	sortMax = 1.0f;
+	sortTime = 0.0f;
+	skippedSortPasses = 0;
+	updateTime = 0.0f;
+	updatedParticles = 0;
+	overflow = PARTICLE_OVERFLOW_DROP;
+	spawnScale = 1.0f;
+	particleLimit = stepLimit = MAX_PARTICLES;
+	droppedParticles = 0;
+	recycledParticles = 0;
+}
 
+ParticleSystem::~ParticleSystem()
+{
+	waitForUpdate();
+	delete[] g_particule_position_size_data;
+	delete[] g_particule_color_data;
 }
 
 void ParticleSystem::init()
@@ -31,13 +102,13 @@ void ParticleSystem::init()
 	GLCall(glGenBuffers(1, &particles_position_buffer));
 	GLCall(glBindBuffer(GL_ARRAY_BUFFER, particles_position_buffer));
 	// Initialize with empty (NULL) buffer : it will be updated later, each frame.
-	GLCall(glBufferData(GL_ARRAY_BUFFER, MAX_PARTICLES * 4 * sizeof(GLfloat), NULL, GL_STREAM_DRAW));
+	GLCall(glBufferData(GL_ARRAY_BUFFER, capacity * 4 * sizeof(GLfloat), NULL, GL_STREAM_DRAW));
 
 	// The VBO containing the colors of the particles
 	GLCall(glGenBuffers(1, &particles_colour_buffer));
 	GLCall(glBindBuffer(GL_ARRAY_BUFFER, particles_colour_buffer));
 	// Initialize with empty (NULL) buffer : it will be updated later, each frame.
-	GLCall(glBufferData(GL_ARRAY_BUFFER, MAX_PARTICLES * 4 * sizeof(GLubyte), NULL, GL_STREAM_DRAW));
+	GLCall(glBufferData(GL_ARRAY_BUFFER, capacity * 4 * sizeof(GLubyte), NULL, GL_STREAM_DRAW));
 
 	GLCall(glBindVertexArray(0));
 
@@ -55,116 +126,487 @@ void ParticleSystem::reset()
 }
 
 
-void ParticleSystem::update(float deltaTime, std::shared_ptr<CameraComponent> cam)
+void ParticleSystem::update(float deltaTime, std::shared_ptr<CameraComponent> cam, float spawnCapScale)
 {
-	glm::vec3 CameraPosition = cam->attachedEntity->transform->position;
-
-	float numSpawn = 10000;
-	int newparticles = (int)(deltaTime * numSpawn);
-	if (newparticles > (int)(0.016f * numSpawn))
-		newparticles = (int)(0.016f * numSpawn);
+	// last frame's job is normally long done by now, render waited on it
+	waitForUpdate();
+
+	unsigned int newparticles = emitter.emit(deltaTime, spawnScale, spawnCapScale);
+
+	// everything the job needs is copied, the entity can move on while it runs
+	stepEmitter = emitter;
+	stepLimit = std::min(particleLimit, MAX_PARTICLES);
+	glm::vec3 cameraPosition = cam->attachedEntity->transform->position;
+	glm::vec3 origin = position;
+	float sizeScale = glm::length(scale);
+	buffersFilled = false;
+	JobSystem::Run(updateJob, [this, deltaTime, cameraPosition, origin, sizeScale, newparticles]()
+	{
+		step(deltaTime, cameraPosition, origin, sizeScale, newparticles);
+	});
+}
 
-	for (int i = 0; i < newparticles; i++) {
-		int particleIndex = FindUnusedParticle();
-		particles[particleIndex].life = 5.0f; // This particle will live 5 seconds.
-		particles[particleIndex].position = position;
+void ParticleSystem::step(float deltaTime, glm::vec3 cameraPosition, glm::vec3 origin, float sizeScale, unsigned int newParticles)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	JobCounter chunks;
 
-		float spread = 1.5f;
-		glm::vec3 maindir = glm::vec3(0.0f, 10.0f, 0.0f);
-		// Very bad way to generate a random direction; 
-		// See for instance http://stackoverflow.com/questions/5408276/python-uniform-spherical-distribution instead,
-		// combined with some user-controlled parameters (main direction, spread, etc)
-		glm::vec3 randomdir = glm::vec3(
-			(rand() % 2000 - 1000.0f) / 1000.0f,
-			(rand() % 2000 - 1000.0f) / 1000.0f,
-			(rand() % 2000 - 1000.0f) / 1000.0f
-		);
+	droppedParticles = 0;
+	recycledParticles = 0;
+	// the budget shrank since last frame
+	if (particleCount > stepLimit)
+	{
+		recycleOldest(particleCount - stepLimit);
+	}
+	unsigned int first = reserve(newParticles);
+	peakCount = std::max(peakCount, particleCount);
+	JobSystem::ParallelFor(chunks, newParticles, SPAWN_CHUNK, [&](unsigned int begin, unsigned int end, unsigned int chunk)
+	{
+		// a stream per chunk and a fresh seed per frame
+		ParticleRandom random(seed + frame * 0x9E3779B97F4A7C15ULL, chunk);
+		spawn(first + begin, first + end, origin, sizeScale, random);
+	});
+	JobSystem::Wait(chunks);
+
+	updatedParticles = particleCount;
+	unsigned int numChunks = (particleCount + SIMULATE_CHUNK - 1) / SIMULATE_CHUNK;
+	chunkAlive.resize(numChunks);
+	JobSystem::ParallelFor(chunks, particleCount, SIMULATE_CHUNK, [&](unsigned int begin, unsigned int end, unsigned int chunk)
+	{
+		simulate(begin, end, deltaTime, cameraPosition);
+		chunkAlive[chunk] = compact(begin, end) - begin;
+	});
+	JobSystem::Wait(chunks);
+	mergeChunks(numChunks);
 
-		particles[particleIndex].speed = maindir + randomdir * spread;
+	shrinkToPeak();
 
+	sorted = false;
+	if (depthSort && !orderIndependent)
+	{
+		SortParticles();
+	}
+	frame++;
+	updateTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
 
-		// Very bad way to generate a random color
-		particles[particleIndex].r = rand() % 256;
-		particles[particleIndex].g = rand() % 256;
-		particles[particleIndex].b = rand() % 256;
-		particles[particleIndex].a = (rand() % 256) / 3;
+void ParticleSystem::waitForUpdate()
+{
+	JobSystem::Wait(updateJob);
+}
 
-		particles[particleIndex].size = ((rand() % 1000) / 2000.0f + 0.1f) * glm::length(scale);
+void ParticleSystem::resize(unsigned int newCapacity)
+{
+	capacity = newCapacity;
+	particles.allocate(capacity);
+	// refilled every frame, nothing to keep
+	delete[] g_particule_position_size_data;
+	delete[] g_particule_color_data;
+	g_particule_position_size_data = new GLfloat[capacity * 4];
+	g_particule_color_data = new GLubyte[capacity * 4];
+	buffersFilled = false;
+}
 
+void ParticleSystem::shrinkToPeak()
+{
+	if (++windowUpdates < SHRINK_WINDOW)
+	{
+		return;
+	}
+	// a quarter full at most, so a pool that just grew doesn't shrink straight back
+	if (peakCount <= capacity / 4 && capacity > MIN_CAPACITY)
+	{
+		resize(std::max(peakCount * 2, MIN_CAPACITY));
+		for (auto* scratch : { &sortOrder, &sortOrderScratch, &recycleOrder })
+		{
+			scratch->clear();
+			scratch->shrink_to_fit();
+		}
+		sortKeys.clear();
+		sortKeys.shrink_to_fit();
+		sortKeysScratch.clear();
+		sortKeysScratch.shrink_to_fit();
 	}
+	peakCount = particleCount;
+	windowUpdates = 0;
+}
 
-	
-	unsigned int ParticlesCount = 0;
-	avg_cam_distance = 0.0f;
-	for (int i = 0; i < MAX_PARTICLES; i++) {
+size_t ParticleSystem::GetMemoryUsage()
+{
+	size_t pool = capacity * (10 * sizeof(float) + sizeof(unsigned int));
+	size_t upload = capacity * (4 * sizeof(GLfloat) + 4 * sizeof(GLubyte));
+	size_t scratch = sortKeys.capacity() * 2 * sizeof(unsigned short) + sortOrder.capacity() * 2 * sizeof(unsigned int) + recycleOrder.capacity() * sizeof(unsigned int);
+	return pool + upload + scratch;
+}
 
-		Particle& p = particles[i]; // shortcut
+unsigned int ParticleSystem::reserve(unsigned int& count)
+{
+	unsigned int space = particleCount < stepLimit ? stepLimit - particleCount : 0;
+	if (count > space)
+	{
+		if (overflow == PARTICLE_OVERFLOW_RECYCLE_OLDEST)
+		{
+			// never more than the pool, the rest would just recycle each other
+			count = std::min(count, stepLimit);
+			recycleOldest(count - space);
+		}
+		else
+		{
+			droppedParticles += count - space;
+			count = space;
+		}
+	}
+	if (particleCount + count > capacity)
+	{
+		resize(std::min(std::max(particleCount + count, capacity * 2), MAX_PARTICLES));
+	}
+	unsigned int first = particleCount;
+	particleCount += count;
+	return first;
+}
 
-		if (p.life > 0.0f) {
+// offset from the emitter for one new particle, picked at compile time so the spawn loop has no branches
+template <ParticleEmitterShape SHAPE>
+static inline glm::vec3 ShapeOffset(const glm::vec3& size, ParticleRandom& random)
+{
+	if constexpr (SHAPE == PARTICLE_SHAPE_SPHERE)
+	{
+		// a uniform direction, pushed out by the cube root so the volume fills evenly
+		float z = random.signedUniform();
+		float angle = random.uniform() * glm::two_pi<float>();
+		float r = sqrtf(1.0f - z * z);
+		return glm::vec3(r * cosf(angle), r * sinf(angle), z) * (cbrtf(random.uniform()) * size.x);
+	}
+	else if constexpr (SHAPE == PARTICLE_SHAPE_BOX)
+	{
+		return glm::vec3(random.signedUniform(), random.signedUniform(), random.signedUniform()) * size;
+	}
+	else
+	{
+		return glm::vec3(0.0f);
+	}
+}
 
-			// Decrease life
-			p.life -= deltaTime;
-			if (p.life > 0.0f) {
+template <ParticleEmitterShape SHAPE>
+static void SpawnShape(ParticlePool& particles, unsigned int begin, unsigned int end, const ParticleEmitter& e, const glm::vec3& origin, float sizeScale, ParticleRandom& random)
+{
+	glm::vec4 colourRange = (e.colourMax - e.colourMin) * (1.0f / 255.0f);
+	for (unsigned int i = begin; i < end; i++)
+	{
+		float lifetime = e.lifetimeMin + (e.lifetimeMax - e.lifetimeMin) * random.uniform();
+		particles.life[i] = lifetime;
+		particles.invLifetime[i] = 1.0f / lifetime;
+
+		glm::vec3 p = origin + ShapeOffset<SHAPE>(e.shapeSize, random);
+		particles.positionX[i] = p.x;
+		particles.positionY[i] = p.y;
+		particles.positionZ[i] = p.z;
+
+		float speed = e.speedMin + (e.speedMax - e.speedMin) * random.uniform();
+		glm::vec3 randomdir = glm::vec3(random.signedUniform(), random.signedUniform(), random.signedUniform());
+		glm::vec3 velocity = e.direction * speed + randomdir * e.spread;
+		particles.velocityX[i] = velocity.x;
+		particles.velocityY[i] = velocity.y;
+		particles.velocityZ[i] = velocity.z;
+
+		// one draw gives a byte to pick each channel in its range with
+		unsigned int bits = random.next();
+		glm::vec4 c = (e.colourMin + colourRange * glm::vec4(bits & 0xFF, (bits >> 8) & 0xFF, (bits >> 16) & 0xFF, bits >> 24)) * 255.0f + 0.5f;
+		c = glm::clamp(c, 0.0f, 255.0f);
+		particles.colour[i] = (unsigned int)c.r | ((unsigned int)c.g << 8) | ((unsigned int)c.b << 16) | ((unsigned int)c.a << 24);
+
+		particles.size[i] = (e.sizeMin + (e.sizeMax - e.sizeMin) * random.uniform()) * sizeScale;
+		particles.cameraDistance[i] = 0.0f;
+	}
+}
 
-				// Simulate simple physics : gravity only, no collisions
-				p.speed += glm::vec3(0.0f, -3.81f, 0.0f) * (float)deltaTime * 0.5f;
-				p.position += p.speed * (float)deltaTime;
-				p.cameradistance = glm::length2(p.position - CameraPosition);
-				//ParticlesContainer[i].pos += glm::vec3(0.0f,10.0f, 0.0f) * (float)delta;
+void ParticleSystem::spawn(unsigned int begin, unsigned int end, const glm::vec3& origin, float sizeScale, ParticleRandom& random)
+{
+	switch (stepEmitter.shape)
+	{
+	case PARTICLE_SHAPE_SPHERE:
+		SpawnShape<PARTICLE_SHAPE_SPHERE>(particles, begin, end, stepEmitter, origin, sizeScale, random);
+		break;
+	case PARTICLE_SHAPE_BOX:
+		SpawnShape<PARTICLE_SHAPE_BOX>(particles, begin, end, stepEmitter, origin, sizeScale, random);
+		break;
+	default:
+		SpawnShape<PARTICLE_SHAPE_POINT>(particles, begin, end, stepEmitter, origin, sizeScale, random);
+		break;
+	}
+}
 
-				// Fill the GPU buffer
-				g_particule_position_size_data[4 * ParticlesCount + 0] = p.position.x;
-				g_particule_position_size_data[4 * ParticlesCount + 1] = p.position.y;
-				g_particule_position_size_data[4 * ParticlesCount + 2] = p.position.z;
+void ParticleSystem::simulate(unsigned int begin, unsigned int end, float deltaTime, const glm::vec3& cameraPosition)
+{
+	float* px = particles.positionX.data();
+	float* py = particles.positionY.data();
+	float* pz = particles.positionZ.data();
+	float* vy = particles.velocityY.data();
+	const float* vx = particles.velocityX.data();
+	const float* vz = particles.velocityZ.data();
+	float* life = particles.life.data();
+	const float* invLifetime = particles.invLifetime.data();
+	float* distance = particles.cameraDistance.data();
+	float gravity = stepEmitter.gravity * deltaTime * 0.5f;
+	// the speed curve scales how far a particle moves, not its velocity. a flat curve is just a longer step
+	const ParticleCurve<float>& speedOverLife = stepEmitter.speedOverLife;
+	bool constantSpeed = speedOverLife.IsConstant();
+	float constantStep = deltaTime * speedOverLife.evaluate(0.0f);
+	auto step = [&](unsigned int p) { return deltaTime * speedOverLife.evaluate(1.0f - life[p] * invLifetime[p]); };
+
+	unsigned int i = begin;
+#ifdef PARTICLES_SSE
+	__m128 dt = _mm_set1_ps(deltaTime);
+	__m128 flatStep = _mm_set1_ps(constantStep);
+	__m128 g = _mm_set1_ps(gravity);
+	__m128 camX = _mm_set1_ps(cameraPosition.x);
+	__m128 camY = _mm_set1_ps(cameraPosition.y);
+	__m128 camZ = _mm_set1_ps(cameraPosition.z);
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 s = constantSpeed ? flatStep : _mm_setr_ps(step(i), step(i + 1), step(i + 2), step(i + 3));
+		__m128 velY = _mm_add_ps(_mm_loadu_ps(vy + i), g);
+		_mm_storeu_ps(vy + i, velY);
+		__m128 x = _mm_add_ps(_mm_loadu_ps(px + i), _mm_mul_ps(_mm_loadu_ps(vx + i), s));
+		__m128 y = _mm_add_ps(_mm_loadu_ps(py + i), _mm_mul_ps(velY, s));
+		__m128 z = _mm_add_ps(_mm_loadu_ps(pz + i), _mm_mul_ps(_mm_loadu_ps(vz + i), s));
+		_mm_storeu_ps(px + i, x);
+		_mm_storeu_ps(py + i, y);
+		_mm_storeu_ps(pz + i, z);
+		_mm_storeu_ps(life + i, _mm_sub_ps(_mm_loadu_ps(life + i), dt));
+
+		__m128 dx = _mm_sub_ps(x, camX);
+		__m128 dy = _mm_sub_ps(y, camY);
+		__m128 dz = _mm_sub_ps(z, camZ);
+		_mm_storeu_ps(distance + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+	}
+#endif
+	for (; i < end; i++)
+	{
+		float s = constantSpeed ? constantStep : step(i);
+		vy[i] += gravity;
+		px[i] += vx[i] * s;
+		py[i] += vy[i] * s;
+		pz[i] += vz[i] * s;
+		life[i] -= deltaTime;
+		distance[i] = glm::length2(glm::vec3(px[i], py[i], pz[i]) - cameraPosition);
+	}
+}
 
-				g_particule_position_size_data[4 * ParticlesCount + 3] = p.size;
+unsigned int ParticleSystem::compact(unsigned int begin, unsigned int end)
+{
+	const float* life = particles.life.data();
+	unsigned int i = begin;
+	// only a dead particle costs a move, alive ones are just stepped over
+	while (i < end)
+	{
+#ifdef PARTICLES_SSE
+		if (i + 4 <= end && _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(life + i), _mm_setzero_ps())) == 0xF)
+		{
+			i += 4;
+			continue;
+		}
+#endif
+		if (life[i] > 0.0f)
+		{
+			i++;
+			continue;
+		}
+		// the swapped in particle may be dead as well, so i is checked again
+		end--;
+		if (i != end)
+		{
+			particles.move(end, i);
+		}
+	}
+	return end;
+}
 
-				g_particule_color_data[4 * ParticlesCount + 0] = p.r;
-				g_particule_color_data[4 * ParticlesCount + 1] = p.g;
-				g_particule_color_data[4 * ParticlesCount + 2] = p.b;
-				g_particule_color_data[4 * ParticlesCount + 3] = p.a;
+void ParticleSystem::mergeChunks(unsigned int numChunks)
+{
+	unsigned int total = 0;
+	for (unsigned int c = 0; c < numChunks; c++)
+	{
+		total += chunkAlive[c];
+	}
 
+	// every gap below total is filled from a survivor at or past it, there are exactly as many of each.
+	// costs a move per gap rather than shifting whole chunks down
+	int source = (int)numChunks - 1;
+	unsigned int sourceEnd = source >= 0 ? source * SIMULATE_CHUNK + chunkAlive[source] : 0;
+	for (unsigned int c = 0; c < numChunks; c++)
+	{
+		unsigned int chunkBegin = c * SIMULATE_CHUNK;
+		if (chunkBegin >= total)
+		{
+			break;
+		}
+		unsigned int gapEnd = std::min(std::min(chunkBegin + SIMULATE_CHUNK, particleCount), total);
+		for (unsigned int gap = chunkBegin + chunkAlive[c]; gap < gapEnd; gap++)
+		{
+			while (sourceEnd <= std::max(source * SIMULATE_CHUNK, total))
+			{
+				source--;
+				sourceEnd = source * SIMULATE_CHUNK + chunkAlive[source];
 			}
-			else {
-				// Particles that just died will be put at the end of the buffer in SortParticles();
-				p.cameradistance = -1.0f;
-			}
-
-			ParticlesCount++;
-			avg_cam_distance += (p.cameradistance / MAX_PARTICLES);
+			particles.move(--sourceEnd, gap);
 		}
 	}
+	particleCount = total;
+}
 
-	particleCount = ParticlesCount;
+void ParticleSystem::recycleOldest(unsigned int count)
+{
+	// only runs on frames that overflow, everything else stays O(spawned)
+	count = std::min(count, particleCount);
+	recycleOrder.resize(particleCount);
+	for (unsigned int i = 0; i < particleCount; i++)
+	{
+		recycleOrder[i] = i;
+	}
+	const float* life = particles.life.data();
+	std::nth_element(recycleOrder.begin(), recycleOrder.begin() + count, recycleOrder.end(), [life](unsigned int a, unsigned int b) { return life[a] < life[b]; });
+	for (unsigned int i = 0; i < count; i++)
+	{
+		particles.life[recycleOrder[i]] = 0.0f;
+	}
+	particleCount = compact(0, particleCount);
+	recycledParticles += count;
+}
 
-	if ((sortCounter + 1) >= 4)
+float ParticleSystem::fillBuffers(unsigned int begin, unsigned int end, const unsigned int* order)
+{
+	const float* px = particles.positionX.data();
+	const float* py = particles.positionY.data();
+	const float* pz = particles.positionZ.data();
+	const float* size = particles.size.data();
+	const float* distance = particles.cameraDistance.data();
+	const unsigned int* colour = particles.colour.data();
+	const float* life = particles.life.data();
+	const float* invLifetime = particles.invLifetime.data();
+	GLfloat* out = g_particule_position_size_data;
+	unsigned int* outColour = (unsigned int*)g_particule_color_data;
+
+	// the over life curves only change what's drawn, the pool keeps what each particle spawned with
+	const ParticleCurve<float>& sizeOverLife = stepEmitter.sizeOverLife;
+	const ParticleCurve<glm::vec4>& colourOverLife = stepEmitter.colourOverLife;
+	bool constantSize = sizeOverLife.IsConstant();
+	float constantSizeScale = sizeOverLife.evaluate(0.0f);
+	auto age = [&](unsigned int p) { return 1.0f - life[p] * invLifetime[p]; };
+	auto sizeScale = [&](unsigned int p) { return constantSize ? constantSizeScale : sizeOverLife.evaluate(age(p)); };
+
+	float totalDistance = 0.0f;
+	unsigned int i = begin;
+#ifdef PARTICLES_SSE
+	__m128 sum = _mm_setzero_ps();
+	__m128 flatSize = _mm_set1_ps(constantSizeScale);
+	for (; i + 4 <= end; i += 4)
 	{
-		SortParticles();
-		sortCounter = 0;
+		// four xs, ys, zs and sizes in to four xyzs
+		__m128 x, y, z, s;
+		if (order != nullptr)
+		{
+			const unsigned int* o = order + i;
+			x = _mm_setr_ps(px[o[0]], px[o[1]], px[o[2]], px[o[3]]);
+			y = _mm_setr_ps(py[o[0]], py[o[1]], py[o[2]], py[o[3]]);
+			z = _mm_setr_ps(pz[o[0]], pz[o[1]], pz[o[2]], pz[o[3]]);
+			s = _mm_setr_ps(size[o[0]], size[o[1]], size[o[2]], size[o[3]]);
+			s = _mm_mul_ps(s, constantSize ? flatSize : _mm_setr_ps(sizeScale(o[0]), sizeScale(o[1]), sizeScale(o[2]), sizeScale(o[3])));
+		}
+		else
+		{
+			x = _mm_loadu_ps(px + i);
+			y = _mm_loadu_ps(py + i);
+			z = _mm_loadu_ps(pz + i);
+			s = _mm_loadu_ps(size + i);
+			s = _mm_mul_ps(s, constantSize ? flatSize : _mm_setr_ps(sizeScale(i), sizeScale(i + 1), sizeScale(i + 2), sizeScale(i + 3)));
+		}
+		_MM_TRANSPOSE4_PS(x, y, z, s);
+		_mm_storeu_ps(out + 4 * i + 0, x);
+		_mm_storeu_ps(out + 4 * i + 4, y);
+		_mm_storeu_ps(out + 4 * i + 8, z);
+		_mm_storeu_ps(out + 4 * i + 12, s);
+		sum = _mm_add_ps(sum, _mm_loadu_ps(distance + i));
+	}
+	float lanes[4];
+	_mm_storeu_ps(lanes, sum);
+	totalDistance = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+	for (; i < end; i++)
+	{
+		unsigned int p = order != nullptr ? order[i] : i;
+		out[4 * i + 0] = px[p];
+		out[4 * i + 1] = py[p];
+		out[4 * i + 2] = pz[p];
+		out[4 * i + 3] = size[p] * sizeScale(p);
+		totalDistance += distance[i];
+	}
+	if (!colourOverLife.IsConstant() || colourOverLife.evaluate(0.0f) != glm::vec4(1.0f))
+	{
+		for (i = begin; i < end; i++)
+		{
+			unsigned int p = order != nullptr ? order[i] : i;
+			unsigned int c = colour[p];
+			glm::vec4 tint = colourOverLife.evaluate(age(p));
+			glm::vec4 v = glm::clamp(glm::vec4(c & 0xFF, (c >> 8) & 0xFF, (c >> 16) & 0xFF, c >> 24) * tint + 0.5f, 0.0f, 255.0f);
+			outColour[i] = (unsigned int)v.r | ((unsigned int)v.g << 8) | ((unsigned int)v.b << 16) | ((unsigned int)v.a << 24);
+		}
+	}
+	else if (order != nullptr)
+	{
+		for (i = begin; i < end; i++)
+		{
+			outColour[i] = colour[order[i]];
+		}
 	}
 	else
 	{
-		sortCounter += 1;
+		memcpy(outColour + begin, colour + begin, (end - begin) * sizeof(unsigned int));
 	}
-	
+	return totalDistance;
+}
+
+void ParticleSystem::prepareBuffers()
+{
+	if (buffersFilled)
+	{
+		return;
+	}
+	waitForUpdate();
 
+	// each chunk writes its own slice of the upload arrays
+	const unsigned int* order = sorted ? sortOrder.data() : nullptr;
+	chunkDistance.assign((particleCount + SIMULATE_CHUNK - 1) / SIMULATE_CHUNK, 0.0f);
+	JobCounter chunks;
+	JobSystem::ParallelFor(chunks, particleCount, SIMULATE_CHUNK, [&](unsigned int begin, unsigned int end, unsigned int chunk)
+	{
+		chunkDistance[chunk] = fillBuffers(begin, end, order);
+	});
+	JobSystem::Wait(chunks);
+	float totalDistance = 0.0f;
+	for (float d : chunkDistance)
+	{
+		totalDistance += d;
+	}
+	avg_cam_distance = particleCount > 0 ? totalDistance / particleCount : 0.0f;
+	buffersFilled = true;
 }
 
 void ParticleSystem::render(float deltaTime, std::shared_ptr<CameraComponent> cam, std::shared_ptr<Shader> shader)
 {
+	prepareBuffers();
 	// Update the buffers that OpenGL uses for rendering.
 // There are much more sophisticated means to stream data from the CPU to the GPU,
 // but this is outside the scope of this tutorial.
 // http://www.opengl.org/wiki/Buffer_Object_Streaming
 // 
-	GLCall(glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_ONE));
 	GLCall(glBindVertexArray(vertex_array_id));
 	GLCall(glBindBuffer(GL_ARRAY_BUFFER, particles_position_buffer));
-	GLCall(glBufferData(GL_ARRAY_BUFFER, MAX_PARTICLES * 4 * sizeof(GLfloat), NULL, GL_STREAM_DRAW)); // Buffer orphaning, a common way to improve streaming perf. See above link for details.
+	GLCall(glBufferData(GL_ARRAY_BUFFER, capacity * 4 * sizeof(GLfloat), NULL, GL_STREAM_DRAW)); // Buffer orphaning, a common way to improve streaming perf. See above link for details.
 	GLCall(glBufferSubData(GL_ARRAY_BUFFER, 0, particleCount * sizeof(GLfloat) * 4, g_particule_position_size_data));
 
 	GLCall(glBindBuffer(GL_ARRAY_BUFFER, particles_colour_buffer));
-	GLCall(glBufferData(GL_ARRAY_BUFFER, MAX_PARTICLES * 4 * sizeof(GLubyte), NULL, GL_STREAM_DRAW)); // Buffer orphaning, a common way to improve streaming perf. See above link for details.
+	GLCall(glBufferData(GL_ARRAY_BUFFER, capacity * 4 * sizeof(GLubyte), NULL, GL_STREAM_DRAW)); // Buffer orphaning, a common way to improve streaming perf. See above link for details.
 	GLCall(glBufferSubData(GL_ARRAY_BUFFER, 0, particleCount * sizeof(GLubyte) * 4, g_particule_color_data));
 
 	shader->use();
@@ -235,67 +677,106 @@ void ParticleSystem::render(float deltaTime, std::shared_ptr<CameraComponent> ca
 	GLCall(glDisableVertexAttribArray(1));
 	GLCall(glDisableVertexAttribArray(2));
 	GLCall(glBindVertexArray(0));
-	GLCall(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
 }
 
 
 
-unsigned int ParticleSystem::FindUnusedParticle()
+void ParticleSystem::ui()
 {
-	for(unsigned int i = lastUsedParticle; i < MAX_PARTICLES; i++)
+	ImGui::Text("Alive: %u / %u, budget %u", particleCount, capacity, stepLimit);
+	ImGui::Text("Memory: %.1f KB", GetMemoryUsage() / 1024.0f);
+	ImGui::Text("Update: %.3f ms, %.0f particles/ms", updateTime, updateTime > 0.0f ? updatedParticles / updateTime : 0.0f);
+	const char* policies[] = { "Drop", "Recycle Oldest" };
+	int policy = overflow;
+	if (ImGui::Combo("When Full", &policy, policies, 2))
 	{
-		if(particles[i].life <= 0.0f)
-		{
-			lastUsedParticle = i;
-			return i;
-		}
+		overflow = (ParticleOverflow)policy;
 	}
-
-	for(unsigned int i =0; i < lastUsedParticle; i++)
+	ImGui::Text("Dropped: %u, recycled: %u", droppedParticles, recycledParticles);
+	if (orderIndependent)
 	{
-		if(particles[i].life <= 0.0f)
-		{
-			lastUsedParticle = i;
-			return i;
-		}
+		ImGui::Text("Not sorted, additive or drawn order independent");
+		return;
+	}
+	ImGui::Checkbox("Depth Sort", &depthSort);
+	if (depthSort)
+	{
+		ImGui::Text("Sort: %.3f ms, %u of 2 passes skipped", sortTime, skippedSortPasses);
 	}
-
-	return 0;
 }
 
 void ParticleSystem::GenerateParticles(unsigned int _togenerate)
 {
-	for (int i = 0; i < _togenerate; i++) {
-		int particleIndex = FindUnusedParticle();
-		particles[particleIndex].life = 5.0f; // This particle will live 5 seconds.
-		particles[particleIndex].position = glm::vec3(0, 0, -20.0f);
-
-		float spread = 1.5f;
-		glm::vec3 maindir = glm::vec3(0.0f, 10.0f, 0.0f);
-		// Very bad way to generate a random direction; 
-		// See for instance http://stackoverflow.com/questions/5408276/python-uniform-spherical-distribution instead,
-		// combined with some user-controlled parameters (main direction, spread, etc)
-		glm::vec3 randomdir = glm::vec3(
-			(rand() % 2000 - 1000.0f) / 1000.0f,
-			(rand() % 2000 - 1000.0f) / 1000.0f,
-			(rand() % 2000 - 1000.0f) / 1000.0f
-		);
-
-		particles[particleIndex].speed = maindir + randomdir * spread;
-
-
-		// Very bad way to generate a random color
-		particles[particleIndex].r = rand() % 256;
-		particles[particleIndex].g = rand() % 256;
-		particles[particleIndex].b = rand() % 256;
-		particles[particleIndex].a = (rand() % 256) / 3;
-
-		particles[particleIndex].size = (rand() % 1000) / 2000.0f + 0.1f;
-
-	}
+	waitForUpdate();
+	stepEmitter = emitter;
+	unsigned int first = reserve(_togenerate);
+	ParticleRandom random(seed + frame * 0x9E3779B97F4A7C15ULL, 0xFFFF);
+	spawn(first, first + _togenerate, glm::vec3(0, 0, -20.0f), 1.0f, random);
+	buffersFilled = false;
 }
 
 void ParticleSystem::SortParticles()
 {
-	std::sort(&particles[0], &particles[MAX_PARTICLES]);
+	radixSort();
+	sorted = true;
+}
+
+void ParticleSystem::radixSort()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	unsigned int n = particleCount;
+	sortKeys.resize(n);
+	sortKeysScratch.resize(n);
+	sortOrder.resize(n);
+	sortOrderScratch.resize(n);
+
+	// 16 bit keys spread over last sort's range, far first. anything outside it this time is clamped
+	// to the ends for a frame, then the range catches up
+	const float* distance = particles.cameraDistance.data();
+	float scale = sortMax > sortMin ? 65535.0f / (sortMax - sortMin) : 0.0f;
+	float newMin = FLT_MAX, newMax = 0.0f;
+	for (unsigned int i = 0; i < n; i++)
+	{
+		float d = distance[i];
+		newMin = std::min(newMin, d);
+		newMax = std::max(newMax, d);
+		float q = glm::clamp((sortMax - d) * scale, 0.0f, 65535.0f);
+		sortKeys[i] = (unsigned short)q;
+		sortOrder[i] = i;
+	}
+	sortMin = n > 0 ? newMin : 0.0f;
+	sortMax = n > 0 ? newMax : 1.0f;
+
+	// two stable 8 bit passes over (key, index). a pass where every key has the same digit is skipped,
+	// which is common for the high byte when the particles sit in a narrow band of depth
+	skippedSortPasses = 0;
+	for (unsigned int shift = 0; shift < 16; shift += 8)
+	{
+		unsigned int counts[256] = {};
+		for (unsigned int i = 0; i < n; i++)
+		{
+			counts[(sortKeys[i] >> shift) & 0xFF]++;
+		}
+		if (n == 0 || counts[(sortKeys[0] >> shift) & 0xFF] == n)
+		{
+			skippedSortPasses++;
+			continue;
+		}
+		unsigned int offset = 0;
+		for (unsigned int b = 0; b < 256; b++)
+		{
+			unsigned int c = counts[b];
+			counts[b] = offset;
+			offset += c;
+		}
+		for (unsigned int i = 0; i < n; i++)
+		{
+			unsigned int dest = counts[(sortKeys[i] >> shift) & 0xFF]++;
+			sortKeysScratch[dest] = sortKeys[i];
+			sortOrderScratch[dest] = sortOrder[i];
+		}
+		std::swap(sortKeys, sortKeysScratch);
+		std::swap(sortOrder, sortOrderScratch);
+	}
+	sortTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
 }
@@ -2,28 +2,67 @@
 #include "Common.h"
 #include "Shader.h"
 #include "components/CameraComponent.h"
+#include "JobSystem.h"
+#include "gfx/ParticleEmitter.h"
 
-struct Particle
+// particle state as a structure of arrays. only [0, particleCount) is alive, so the kernels
+// never touch dead slots and can stream through each attribute four particles at a time
+struct ParticlePool
 {
-	glm::vec3 position, speed;
-	unsigned char r, g, b, a;
-	float size, angle, weight;
-	float life;
-	float cameradistance;
-
-	bool operator<(const Particle& that) const {
-		// Sort in reverse order : far particles drawn first.
-		return this->cameradistance > that.cameradistance;
-	}
+	// keeps the first min(capacity, old capacity) particles, and gives memory back when it shrinks
+	void allocate(unsigned int capacity);
+	// copies slot from in to slot to, for compaction and sorting
+	void move(unsigned int from, unsigned int to);
+
+	std::vector<float> positionX, positionY, positionZ;
+	std::vector<float> velocityX, velocityY, velocityZ;
+	std::vector<float> life, size;
+	// 1 / the life it spawned with, for the over life curves
+	std::vector<float> invLifetime;
+	// squared, for sorting
+	std::vector<float> cameraDistance;
+	// rgba8, the same bytes the colour buffer wants
+	std::vector<unsigned int> colour;
+};
+
+// pcg32. cheap enough that every spawn chunk gets a stream of its own, so spawning can be split
+// across threads and still come out the same
+struct ParticleRandom
+{
+	ParticleRandom(unsigned long long seed, unsigned long long stream);
+	unsigned int next();
+	// [0, 1)
+	inline float uniform() { return (next() >> 8) * (1.0f / 16777216.0f); }
+	// [-1, 1)
+	inline float signedUniform() { return uniform() * 2.0f - 1.0f; }
+
+	unsigned long long state, increment;
+};
+
+// what a spawn does when the pool is already full
+enum ParticleOverflow
+{
+	PARTICLE_OVERFLOW_DROP,
+	// kills the particles with the least life left to make room
+	PARTICLE_OVERFLOW_RECYCLE_OLDEST,
 };
 
 class ParticleSystem
 {
 public:
-	static constexpr unsigned int MAX_PARTICLES = 100000;
-	unsigned int lastUsedParticle;
+	// the most any one system can grow to. pools only grow as far as they're used, so a high ceiling
+	// costs nothing until an emitter asks for it, the ParticleBudget is what keeps the total down
+	static constexpr unsigned int MAX_PARTICLES = 1 << 20;
+	// pools start here, and never shrink below it
+	static constexpr unsigned int MIN_CAPACITY = 256;
+	// updates between checks on whether the pool could shrink
+	static constexpr unsigned int SHRINK_WINDOW = 120;
+	// particles a simulation job takes, and a spawn job makes
+	static constexpr unsigned int SIMULATE_CHUNK = 16384;
+	static constexpr unsigned int SPAWN_CHUNK = 4096;
 	unsigned int shaderTextureLoc, shaderCamRightLoc, shaderCamUpLoc, viewProjMatrixLoc;
 	GLuint billboard_vertex_buffer, vertex_array_id;
+	// instance data in the layout the buffers are uploaded from, filled straight from the pool. sized to the pool
 	GLfloat* g_particule_position_size_data;
 	GLubyte* g_particule_color_data;
 	static constexpr GLfloat g_vertex_buffer_data[] = {
@@ -32,34 +71,108 @@ public:
 		 -0.5f,  0.5f, 0.0f,
 		  0.5f,  0.5f, 0.0f,
 	};
-	
+
 	unsigned int particles_position_buffer, particles_colour_buffer;
 
 	ParticleSystem();
-	~ParticleSystem() {};
+	~ParticleSystem();
 
 	void init();
-	void update(float deltaTime, std::shared_ptr<CameraComponent> cam);
+	// starts this frame's simulation as a job and returns, so every emitter's update runs at once.
+	// spawnCapScale is for catch up steps longer than a frame, see ParticleEmitter::emit
+	void update(float deltaTime, std::shared_ptr<CameraComponent> cam, float spawnCapScale = 1.0f);
+	// the caller sets the blending, see Scene::renderBehaviour
 	void render(float deltaTime, std::shared_ptr<CameraComponent> cam, std::shared_ptr<Shader> shader);
+	// waits for the update job and fills the upload arrays in draw order, once per update. render calls it
+	void prepareBuffers();
 	void clear();
 	void reset();
-	
+
 	unsigned int particleCount;
-	std::vector<Particle> particles;
+	ParticlePool particles;
+	// what the pool, the upload arrays and the vertex buffers are sized for. doubles when a spawn needs more,
+	// and halves (or more) once the peak over SHRINK_WINDOW updates fits in a quarter of it
+	inline unsigned int GetCapacity() { return capacity; }
+	// the pool and upload arrays, the vertex buffers take another 20 bytes a particle
+	size_t GetMemoryUsage();
 	unsigned int texture;
-	
-	unsigned int FindUnusedParticle();
+
 	void GenerateParticles(unsigned int _togenerate);
+	// orders the alive particles far to near, part of the update job
 	void SortParticles();
 	std::string path;
 	float avg_cam_distance;
 
-	char sortCounter;
+	// back to front, off when the particles are additive and order doesn't matter
+	bool depthSort;
+	// set by the scene for additive emitters and ones drawn through the TransparencyRenderer, neither needs
+	// an order so the sort is skipped
+	bool orderIndependent;
 
 	unsigned int viewProjId, textureId, camRightId, camUpId;
-	
+
 
 	glm::vec3 position, eulerAngles, scale;
+	// what to spawn and how it moves. read once per update, so it can change between frames
+	ParticleEmitter emitter;
+
+	ParticleOverflow overflow;
+	// set by the ParticleBudget. the spawn rate multiplier, and the most particles kept alive.
+	// anything over the limit is recycled oldest first
+	float spawnScale;
+	unsigned int particleLimit;
+	// spawns that didn't fit last update, and particles killed early to fit them
+	unsigned int droppedParticles, recycledParticles;
 
-	
-};
\ No newline at end of file
+	// cpu time of the last update, and how many particles it simulated
+	float updateTime;
+	unsigned int updatedParticles;
+	// seeds the spawn streams, with the frame count
+	unsigned int seed;
+
+	// time of the last sort, and the radix passes it could skip
+	float sortTime;
+	unsigned int skippedSortPasses;
+	void ui();
+
+private:
+	// the update job: spawn, simulate and compact in chunks, merge the chunks and sort
+	void step(float deltaTime, glm::vec3 cameraPosition, glm::vec3 origin, float sizeScale, unsigned int newParticles);
+	// room for count new particles at the end of the alive range, what happens past the limit is up to overflow.
+	// returns the first new slot
+	unsigned int reserve(unsigned int& count);
+	void spawn(unsigned int begin, unsigned int end, const glm::vec3& origin, float sizeScale, ParticleRandom& random);
+	// frees count slots by killing the particles closest to dying
+	void recycleOldest(unsigned int count);
+	// gravity, velocity, aging and camera distance
+	void simulate(unsigned int begin, unsigned int end, float deltaTime, const glm::vec3& cameraPosition);
+	// swaps the last alive particle of the range in to each dead slot, returns the new end of the range
+	unsigned int compact(unsigned int begin, unsigned int end);
+	// closes the gaps the chunks left behind, moving particles from the back in to them
+	void mergeChunks(unsigned int numChunks);
+	// writes [begin, end) of the upload arrays, through order if it isn't null. returns the summed distance
+	float fillBuffers(unsigned int begin, unsigned int end, const unsigned int* order);
+	void radixSort();
+	void waitForUpdate();
+	// reallocates everything sized by capacity, part of the update job. the vertex buffers follow in render
+	void resize(unsigned int newCapacity);
+	// gives back memory if the pool has been mostly empty for a while
+	void shrinkToPeak();
+
+	JobCounter updateJob;
+	unsigned int capacity;
+	// most particles alive at once since the last shrink check
+	unsigned int peakCount, windowUpdates;
+	// the emitter and limit as they were when the running update started
+	ParticleEmitter stepEmitter;
+	unsigned int stepLimit;
+	unsigned long long frame;
+	bool sorted, buffersFilled;
+	std::vector<unsigned int> chunkAlive;
+	std::vector<float> chunkDistance;
+	// keys are quantized over the distances the last sort saw, which barely move from frame to frame
+	float sortMin, sortMax;
+	std::vector<unsigned short> sortKeys, sortKeysScratch;
+	std::vector<unsigned int> sortOrder, sortOrderScratch;
+	std::vector<unsigned int> recycleOrder;
+};
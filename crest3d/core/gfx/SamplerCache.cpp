@@ -0,0 +1,82 @@
+#include "SamplerCache.h"
+#include "Debug.h"
+
+unsigned int SamplerCache::Get(const SamplerDesc& _desc)
+{
+	SamplerDesc desc = _desc;
+	desc.anisotropy = std::max(1.0f, std::min(desc.anisotropy, GetMaxAnisotropy()));
+
+	auto it = samplers.find(desc);
+	if (it != samplers.end())
+	{
+		return it->second;
+	}
+
+	unsigned int sampler;
+	glGenSamplers(1, &sampler);
+	glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, desc.minFilter);
+	glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, desc.magFilter);
+	glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, desc.wrapS);
+	glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, desc.wrapT);
+	glSamplerParameteri(sampler, GL_TEXTURE_WRAP_R, desc.wrapR);
+	if (desc.anisotropy > 1.0f)
+	{
+		glSamplerParameterf(sampler, GL_TEXTURE_MAX_ANISOTROPY_EXT, desc.anisotropy);
+	}
+	samplers[desc] = sampler;
+	return sampler;
+}
+
+unsigned int SamplerCache::MaterialSampler()
+{
+	SamplerDesc desc;
+	desc.anisotropy = anisotropy;
+	return Get(desc);
+}
+
+unsigned int SamplerCache::ScreenSampler()
+{
+	SamplerDesc desc;
+	desc.minFilter = GL_LINEAR;
+	desc.wrapS = GL_CLAMP_TO_EDGE;
+	desc.wrapT = GL_CLAMP_TO_EDGE;
+	desc.wrapR = GL_CLAMP_TO_EDGE;
+	return Get(desc);
+}
+
+float SamplerCache::GetMaxAnisotropy()
+{
+	if (maxAnisotropy < 0.0f)
+	{
+		maxAnisotropy = 1.0f;
+		if (GLEW_EXT_texture_filter_anisotropic || GLEW_ARB_texture_filter_anisotropic)
+		{
+			glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+		}
+		else
+		{
+			Debug::Warn<SamplerCache>("Anisotropic filtering isn't supported");
+		}
+	}
+	return maxAnisotropy;
+}
+
+void SamplerCache::Clear()
+{
+	for (auto& s : samplers)
+	{
+		glDeleteSamplers(1, &s.second);
+	}
+	samplers.clear();
+}
+
+bool SamplerCache::ui()
+{
+	ImGui::Text("Samplers: %u", (unsigned int)samplers.size());
+	float max = GetMaxAnisotropy();
+	if (max <= 1.0f)
+	{
+		return false;
+	}
+	return ImGui::SliderFloat("Anisotropy", &anisotropy, 1.0f, max, "%.0fx");
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "Common.h"
+#include <tuple>
+
+// filtering and addressing state, shared by every texture sampled through the same SamplerDesc
+struct SamplerDesc
+{
+	int minFilter = GL_LINEAR_MIPMAP_LINEAR;
+	int magFilter = GL_LINEAR;
+	int wrapS = GL_REPEAT;
+	int wrapT = GL_REPEAT;
+	int wrapR = GL_REPEAT;
+	// 1 is off
+	float anisotropy = 1.0f;
+
+	bool operator<(const SamplerDesc& o) const
+	{
+		return std::tie(minFilter, magFilter, wrapS, wrapT, wrapR, anisotropy) < std::tie(o.minFilter, o.magFilter, o.wrapS, o.wrapT, o.wrapR, o.anisotropy);
+	}
+};
+
+// sampler objects deduplicated by their state. bound per unit with glBindSampler they override the texture's own
+// parameters, so textures are configured once at load and nothing touches glTexParameter while drawing.
+class SamplerCache
+{
+public:
+	// created the first time a desc is seen, anisotropy is clamped to what the driver supports
+	static unsigned int Get(const SamplerDesc& desc);
+
+	// trilinear, repeating and using the anisotropy setting below, for material maps
+	static unsigned int MaterialSampler();
+	// linear and clamped without mips, for sampling framebuffers in fullscreen passes
+	static unsigned int ScreenSampler();
+
+	// 1 when anisotropic filtering isn't available
+	static float GetMaxAnisotropy();
+	inline static size_t GetNumSamplers() { return samplers.size(); }
+
+	static void Clear();
+	// returns true when the material anisotropy changed, materials then need to fetch MaterialSampler() again
+	static bool ui();
+
+	// applied to MaterialSampler()
+	inline static float anisotropy = 8.0f;
+
+private:
+	inline static std::map<SamplerDesc, unsigned int> samplers;
+	inline static float maxAnisotropy = -1.0f;
+};
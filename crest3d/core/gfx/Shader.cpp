@@ -1,200 +1,252 @@
 #include "Shader.h"
 #include "serialization/Serializer.hpp"
+#include "ShaderCache.h"
+#include "Material.h"
 
 Shader::Shader(const char* vertexPath, const char* fragPath)
 {
-	std::string vertexCode;
-	std::string fragCode;
-	std::ifstream vertexShaderFile;
-	std::ifstream fragShaderFile;
+	vertexFilepath = vertexPath;
+	fragmentFilepath = fragPath;
+
+	build(ReadSource(vertexPath), "", ReadSource(fragPath));
+}
 
+Shader::Shader(const char* vertexPath, const char* geometryPath, const char* fragPath)
+{
 	vertexFilepath = vertexPath;
+	geometryFilepath = geometryPath;
 	fragmentFilepath = fragPath;
-	
-	vertexShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	fragShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
 
-	try
-	{
-		//load the text files in to a filestream
-		vertexShaderFile.open(vertexPath);
-		fragShaderFile.open(fragPath);
+	build(ReadSource(vertexPath), ReadSource(geometryPath), ReadSource(fragPath));
+}
+
+Shader::Shader(const char* vertexPath, const char* fragPath, const std::vector<std::string>& _defines)
+{
+	vertexFilepath = vertexPath;
+	fragmentFilepath = fragPath;
+	defines = _defines;
 
-		//create a string stream to store the *whole* shader
-		std::stringstream vertexShaderStream, fragShaderStream;
+	build(InjectDefines(ReadSource(vertexPath), defines), "", InjectDefines(ReadSource(fragPath), defines));
+}
 
-		//read the text files in to their streams
-		vertexShaderStream << vertexShaderFile.rdbuf();
-		fragShaderStream << fragShaderFile.rdbuf();
+std::shared_ptr<Shader> Shader::Compute(const char* computePath, const std::vector<std::string>& defines)
+{
+	std::shared_ptr<Shader> shader = std::shared_ptr<Shader>(new Shader());
+	shader->computeFilepath = computePath;
+	shader->defines = defines;
+	shader->buildCompute(InjectDefines(ReadSource(computePath), defines));
+	return shader;
+}
 
-		//get rid of file handles in memory
-		vertexShaderFile.close();
-		fragShaderFile.close();
+std::string Shader::InjectDefines(const std::string& source, const std::vector<std::string>& defines)
+{
+	if (defines.empty())
+	{
+		return source;
+	}
 
-		vertexCode = vertexShaderStream.str();
-		fragCode = fragShaderStream.str();
+	std::string block;
+	for (auto& define : defines)
+	{
+		block += "#define " + define + "\n";
 	}
-	catch (std::ifstream::failure e)
+
+	// #version has to stay the first statement
+	size_t version = source.find("#version");
+	if (version == std::string::npos)
+	{
+		return block + source;
+	}
+	size_t lineEnd = source.find('\n', version);
+	if (lineEnd == std::string::npos)
 	{
-		std::cout << "failed to read shader(s) from file" << std::endl;
+		return source + "\n" + block;
 	}
+	std::string result = source;
+	result.insert(lineEnd + 1, block);
+	return result;
+}
+
+// nested deeper than this is taken to be an include cycle
+static const int MAX_INCLUDE_DEPTH = 8;
 
-	const char* vertexShaderCode = vertexCode.c_str();
-	const char* fragShaderCode = fragCode.c_str();
+static std::string ExpandIncludes(const std::string& source, const std::string& path, std::vector<std::string>* includes, int depth)
+{
+	if (source.find("#include") == std::string::npos)
+	{
+		return source;
+	}
+	std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+	std::stringstream in(source);
+	std::string result, line;
+	while (std::getline(in, line))
+	{
+		size_t start = line.find_first_not_of(" \t");
+		size_t open = line.find('"');
+		size_t close = open != std::string::npos ? line.find('"', open + 1) : std::string::npos;
+		if (start == std::string::npos || line.compare(start, 8, "#include") != 0 || close == std::string::npos)
+		{
+			result += line + "\n";
+			continue;
+		}
+		std::string includePath = directory + line.substr(open + 1, close - open - 1);
+		if (depth >= MAX_INCLUDE_DEPTH)
+		{
+			std::cout << "shader includes nested too deep at " << includePath << " in " << path << std::endl;
+			continue;
+		}
+		if (includes != nullptr)
+		{
+			includes->emplace_back(includePath);
+		}
+		std::ifstream file(includePath);
+		if (!file.is_open())
+		{
+			std::cout << "failed to read shader include " << includePath << " in " << path << std::endl;
+			continue;
+		}
+		std::stringstream stream;
+		stream << file.rdbuf();
+		result += ExpandIncludes(stream.str(), includePath, includes, depth + 1) + "\n";
+	}
+	return result;
+}
 
-	unsigned int vertexId;
-	unsigned int fragId;
+std::string Shader::ReadSource(const char* path, std::vector<std::string>* includes)
+{
+	std::ifstream file;
+	file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+	try
+	{
+		//load the text file in to a filestream, then the *whole* shader in to a string
+		file.open(path);
+		std::stringstream stream;
+		stream << file.rdbuf();
+		file.close();
+		return ExpandIncludes(stream.str(), path, includes, 0);
+	}
+	catch (std::ifstream::failure e)
+	{
+		std::cout << "failed to read shader from file " << path << std::endl;
+	}
+	return "";
+}
 
-	//debug
+unsigned int Shader::CompileStage(GLenum type, const std::string& source)
+{
+	const char* code = source.c_str();
 	int success;
 	char infoLog[512];
 
-	//create and compile vertex shader, check if it was successful
-	vertexId = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertexId, 1, &vertexShaderCode, NULL);
-	glCompileShader(vertexId);
-	glGetShaderiv(vertexId, GL_COMPILE_STATUS, &success);
+	unsigned int stageId = glCreateShader(type);
+	glShaderSource(stageId, 1, &code, NULL);
+	glCompileShader(stageId);
+	glGetShaderiv(stageId, GL_COMPILE_STATUS, &success);
 	if (!success)
 	{
-		glGetShaderInfoLog(vertexId, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-	};
-
-	//...fragment
-	fragId = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragId, 1, &fragShaderCode, NULL);
-	glCompileShader(fragId);
-	glGetShaderiv(fragId, GL_COMPILE_STATUS, &success);
-	if (!success)
+		glGetShaderInfoLog(stageId, 512, NULL, infoLog);
+		const char* stage = type == GL_VERTEX_SHADER ? "VERTEX" : (type == GL_GEOMETRY_SHADER ? "GEOMETRY" : (type == GL_COMPUTE_SHADER ? "COMPUTE" : "FRAGMENT"));
+		std::cout << "ERROR::SHADER::" << stage << "::COMPILATION_FAILED\n" << infoLog << std::endl;
+	}
+	return stageId;
+}
+
+void Shader::build(const std::string& vertexCode, const std::string& geoCode, const std::string& fragCode)
+{
+	// a linked binary from a previous run skips compilation entirely
+	unsigned long long key = ShaderCache::MakeKey(vertexCode, geoCode, fragCode);
+	if (ShaderCache::Load(key, id))
 	{
-		glGetShaderInfoLog(fragId, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
-	};
+		fillMappings();
+		return;
+	}
+
+	ShaderCache::Timer timer;
+	unsigned int vertexId = CompileStage(GL_VERTEX_SHADER, vertexCode);
+	unsigned int fragId = CompileStage(GL_FRAGMENT_SHADER, fragCode);
+	unsigned int geoId = geoCode.empty() ? 0 : CompileStage(GL_GEOMETRY_SHADER, geoCode);
 
 	//Shader program
 	id = glCreateProgram();
 	glAttachShader(id, vertexId);
+	if (geoId != 0)
+	{
+		glAttachShader(id, geoId);
+	}
 	glAttachShader(id, fragId);
+	glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(id);
 	//check if shader program compiled and linked correctly
+	int success;
+	char infoLog[512];
 	glGetProgramiv(id, GL_LINK_STATUS, &success);
 	if (!success) {
 		glGetProgramInfoLog(id, 512, NULL, infoLog);
-		std::cout << vertexPath << std::endl;
+		std::cout << vertexFilepath << std::endl;
 		std::cout << "ERROR::SHADER::PROGRAM::COMPILATION_FAILED\n" << infoLog << std::endl;
 	}
 
 	glDeleteShader(vertexId);
 	glDeleteShader(fragId);
-
-	fillMappings();
-}
-
-Shader::Shader(const char* vertexPath, const char* geometryPath, const char* fragPath)
-{
-	std::string vertexCode;
-	std::string fragCode;
-	std::string geoCode;
-	std::ifstream vertexShaderFile;
-	std::ifstream fragShaderFile;
-	std::ifstream geoShaderFile;
-
-	vertexShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	fragShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	geoShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-
-	try
+	if (geoId != 0)
 	{
-		//load the text files in to a filestream
-		vertexShaderFile.open(vertexPath);
-		fragShaderFile.open(fragPath);
-		geoShaderFile.open(geometryPath);
-
-		//create a string stream to store the *whole* shader
-		std::stringstream vertexShaderStream, fragShaderStream, geoShaderStream;
-
-		//read the text files in to their streams
-		vertexShaderStream << vertexShaderFile.rdbuf();
-		fragShaderStream << fragShaderFile.rdbuf();
-		geoShaderStream << geoShaderFile.rdbuf();
-
-		//get rid of file handles in memory
-		vertexShaderFile.close();
-		fragShaderFile.close();
-		geoShaderFile.close();
-
-		vertexCode = vertexShaderStream.str();
-		fragCode = fragShaderStream.str();
-		geoCode = geoShaderStream.str();
+		glDeleteShader(geoId);
 	}
-	catch (std::ifstream::failure e)
+
+	if (success)
 	{
-		std::cout << "failed to read shader(s) from file" << std::endl;
+		ShaderCache::Store(key, id, timer.elapsed());
 	}
 
-	const char* vertexShaderCode = vertexCode.c_str();
-	const char* fragShaderCode = fragCode.c_str();
-	const char* geoShaderCode = geoCode.c_str();
-
-	unsigned int vertexId;
-	unsigned int fragId;
-	unsigned int geoId;
-
-	//debug
-	int success;
-	char infoLog[512];
+	fillMappings();
+}
 
-	//create and compile vertex shader, check if it was successful
-	vertexId = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertexId, 1, &vertexShaderCode, NULL);
-	glCompileShader(vertexId);
-	glGetShaderiv(vertexId, GL_COMPILE_STATUS, &success);
-	if (!success)
-	{
-		glGetShaderInfoLog(vertexId, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-	};
-
-	//...fragment
-	fragId = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragId, 1, &fragShaderCode, NULL);
-	glCompileShader(fragId);
-	glGetShaderiv(fragId, GL_COMPILE_STATUS, &success);
-	if (!success)
-	{
-		glGetShaderInfoLog(fragId, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
-	};
-
-	//...geometry
-	geoId = glCreateShader(GL_GEOMETRY_SHADER);
-	glShaderSource(geoId, 1, &geoShaderCode, NULL);
-	glCompileShader(geoId);
-	glGetShaderiv(geoId, GL_COMPILE_STATUS, &success);
-	if (!success)
+void Shader::buildCompute(const std::string& computeCode)
+{
+	// tagged so a compute source can never share a key with a graphics program
+	unsigned long long key = ShaderCache::MakeKey("", "compute", computeCode);
+	if (ShaderCache::Load(key, id))
 	{
-		glGetShaderInfoLog(geoId, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::GEOMETRY::COMPILATION_FAILED\n" << infoLog << std::endl;
-	};
+		return;
+	}
 
-	//Shader program
+	ShaderCache::Timer timer;
+	unsigned int computeId = CompileStage(GL_COMPUTE_SHADER, computeCode);
 	id = glCreateProgram();
-	glAttachShader(id, vertexId);
-	glAttachShader(id, geoId);
-	glAttachShader(id, fragId);
+	glAttachShader(id, computeId);
+	glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(id);
-	//check if shader program compiled and linked correctly
+	int success;
+	char infoLog[512];
 	glGetProgramiv(id, GL_LINK_STATUS, &success);
 	if (!success) {
 		glGetProgramInfoLog(id, 512, NULL, infoLog);
-		std::cout << vertexPath << std::endl;
+		std::cout << computeFilepath << std::endl;
 		std::cout << "ERROR::SHADER::PROGRAM::COMPILATION_FAILED\n" << infoLog << std::endl;
 	}
+	glDeleteShader(computeId);
 
-	glDeleteShader(vertexId);
-	glDeleteShader(fragId);
-	glDeleteShader(geoId);
+	if (success)
+	{
+		ShaderCache::Store(key, id, timer.elapsed());
+	}
+}
+
+void Shader::dispatch(unsigned int groupsX, unsigned int groupsY, unsigned int groupsZ)
+{
+	glDispatchCompute(groupsX, groupsY, groupsZ);
+}
+
+void Shader::dispatchIndirect(unsigned int offset)
+{
+	glDispatchComputeIndirect((GLintptr)offset);
+}
 
+void Shader::swapProgram(unsigned int program)
+{
+	glDeleteProgram(id);
+	id = program;
+	textureIdMappings.clear();
 	fillMappings();
 }
 
@@ -226,6 +278,11 @@ void Shader::setVec3(const std::string& name, glm::vec3 value) const
 	glUniform3fv(glGetUniformLocation(id, name.c_str()), 1, glm::value_ptr(value));
 }
 
+void Shader::setVec4(const std::string& name, glm::vec4 value) const
+{
+	glUniform4fv(glGetUniformLocation(id, name.c_str()), 1, glm::value_ptr(value));
+}
+
 void Shader::setMat4(const std::string& name, glm::mat4 value) const
 {
 	glUniformMatrix4fv(glGetUniformLocation(id, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
@@ -322,13 +379,34 @@ std::string Shader::textureTypeToShaderName(TextureType t)
 
 void Shader::fillMappings()
 {
-	for (int TextureTypeInt = 0; TextureTypeInt <= 8; TextureTypeInt++)
+	for (int TextureTypeInt = 0; TextureTypeInt < TextureType::unknown; TextureTypeInt++)
 	{
 		TextureType t = static_cast<TextureType>(TextureTypeInt);
 		std::string shaderString = textureTypeToShaderName(t);
 		unsigned int shaderId = getUniformLocation(shaderString);
 		textureIdMappings.insert(std::pair<TextureType, unsigned int>(t, shaderId));
 	}
+
+	// material maps always live on the same units (see MaterialSlot), set them once here instead of every draw
+	int previous = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+	glUseProgram(id);
+	for (auto& mapping : textureIdMappings)
+	{
+		int slot = Material::SlotForType(mapping.first);
+		if (slot >= 0)
+		{
+			setIntID(mapping.second, slot);
+		}
+	}
+	glUseProgram(previous);
+
+	// property blocks have fixed binding points too, see PropertyBlockBinding
+	unsigned int materialBlock = glGetUniformBlockIndex(id, "MaterialBlock");
+	if (materialBlock != GL_INVALID_INDEX)
+	{
+		glUniformBlockBinding(id, materialBlock, PROPERTY_BLOCK_MATERIAL);
+	}
 }
 
 tinyxml2::XMLElement* Shader::serialize(tinyxml2::XMLDocument* doc)
@@ -32,12 +32,21 @@ public:
 
 	Shader(const char* vertexPath, const char* fragPath);
 	Shader(const char* vertexPath, const char* geometryPath, const char* fragPath);
+	// each define is added as "#define <define>" straight after the #version line of every stage
+	Shader(const char* vertexPath, const char* fragPath, const std::vector<std::string>& defines);
+	// a compute program, needs GL 4.3 (GLEW_ARB_compute_shader)
+	static std::shared_ptr<Shader> Compute(const char* computePath, const std::vector<std::string>& defines = std::vector<std::string>());
+	// compute programs only, the program must be in use
+	void dispatch(unsigned int groupsX, unsigned int groupsY = 1, unsigned int groupsZ = 1);
+	// group counts from the buffer bound to GL_DISPATCH_INDIRECT_BUFFER, offset in bytes
+	void dispatchIndirect(unsigned int offset);
 	void use();
 	void setBool(const std::string& name, bool value) const;
 	void setInt(const std::string& name, int value) const;
 	void setFloat(const std::string& name, float value) const;
 	void setVec2(const std::string& name, glm::vec2 value) const;
 	void setVec3(const std::string& name, glm::vec3 value) const;
+	void setVec4(const std::string& name, glm::vec4 value) const;
 	void setMat4(const std::string& name, glm::mat4 value) const;
 	void setMat4ID(const unsigned int mat4ID, glm::mat4 value) const;
 	void setVec3ID(const unsigned int vec3ID, glm::vec3 value) const;
@@ -56,8 +65,28 @@ public:
 
 	tinyxml2::XMLElement* serialize(tinyxml2::XMLDocument* doc);
 
+	// whole file as a string, empty if it couldn't be read. #include "file" lines are replaced by that file,
+	// relative to the one including it, and the paths pulled in are added to includes
+	static std::string ReadSource(const char* path, std::vector<std::string>* includes = nullptr);
+	static std::string InjectDefines(const std::string& source, const std::vector<std::string>& defines);
+
+	// take ownership of an already linked program, the old one is deleted. cached uniform locations elsewhere go stale
+	void swapProgram(unsigned int program);
+	inline const std::string& GetVertexPath() { return vertexFilepath; }
+	inline const std::string& GetGeometryPath() { return geometryFilepath; }
+	inline const std::string& GetFragmentPath() { return fragmentFilepath; }
+	inline const std::vector<std::string>& GetDefines() { return defines; }
+
+	inline const std::string& GetComputePath() { return computeFilepath; }
+
 private:
+	Shader() {};
+	// compile and link, or load the program binary from the ShaderCache
+	void build(const std::string& vertexCode, const std::string& geoCode, const std::string& fragCode);
+	void buildCompute(const std::string& computeCode);
+	static unsigned int CompileStage(GLenum type, const std::string& source);
 	void fillMappings();
 
-	std::string vertexFilepath, fragmentFilepath;
+	std::string vertexFilepath, geometryFilepath, fragmentFilepath, computeFilepath;
+	std::vector<std::string> defines;
 };
\ No newline at end of file
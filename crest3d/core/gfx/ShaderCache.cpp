@@ -0,0 +1,185 @@
+#include "ShaderCache.h"
+#include "Debug.h"
+
+static const unsigned int CACHE_MAGIC = 0x43525348; // CRSH
+static const unsigned int CACHE_VERSION = 1;
+
+// 64 bit FNV-1a
+static void HashBytes(unsigned long long& hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+}
+
+static void HashString(unsigned long long& hash, const std::string& s)
+{
+	// include the length so ("ab", "c") and ("a", "bc") differ
+	size_t size = s.size();
+	HashBytes(hash, &size, sizeof(size));
+	HashBytes(hash, s.data(), s.size());
+}
+
+static std::string GLString(GLenum name)
+{
+	const GLubyte* s = glGetString(name);
+	return s != nullptr ? std::string((const char*)s) : std::string();
+}
+
+bool ShaderCache::Supported()
+{
+	if (supported < 0)
+	{
+		int formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		supported = formats > 0 ? 1 : 0;
+		if (!supported)
+		{
+			Debug::Warn<ShaderCache>("Driver exposes no program binary formats, shader cache disabled");
+		}
+	}
+	return supported == 1;
+}
+
+unsigned long long ShaderCache::MakeKey(const std::string& vertexCode, const std::string& geoCode, const std::string& fragCode)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	HashString(hash, vertexCode);
+	HashString(hash, geoCode);
+	HashString(hash, fragCode);
+	HashString(hash, GLString(GL_VENDOR));
+	HashString(hash, GLString(GL_RENDERER));
+	HashString(hash, GLString(GL_VERSION));
+	return hash;
+}
+
+std::string ShaderCache::PathFor(unsigned long long key)
+{
+	std::stringstream s;
+	s << directory << "/" << std::hex << key << ".bin";
+	return s.str();
+}
+
+bool ShaderCache::Load(unsigned long long key, unsigned int& program)
+{
+	if (!enabled || !Supported())
+	{
+		return false;
+	}
+
+	Timer timer;
+	std::ifstream in(PathFor(key).c_str(), std::ios::binary);
+	if (!in.good())
+	{
+		return false;
+	}
+
+	unsigned int magic = 0, version = 0, format = 0, length = 0;
+	unsigned long long storedKey = 0;
+	in.read((char*)&magic, sizeof(magic));
+	in.read((char*)&version, sizeof(version));
+	in.read((char*)&storedKey, sizeof(storedKey));
+	in.read((char*)&format, sizeof(format));
+	in.read((char*)&length, sizeof(length));
+	if (!in.good() || magic != CACHE_MAGIC || version != CACHE_VERSION || storedKey != key || length == 0)
+	{
+		return false;
+	}
+
+	std::vector<char> binary(length);
+	in.read(binary.data(), length);
+	if (!in.good())
+	{
+		return false;
+	}
+
+	program = glCreateProgram();
+	glProgramBinary(program, format, binary.data(), length);
+	int success = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		// driver changed its mind about the format, recompile and overwrite
+		glDeleteProgram(program);
+		program = 0;
+		rejected++;
+		return false;
+	}
+
+	hits++;
+	loadTime += timer.elapsed();
+	return true;
+}
+
+void ShaderCache::Store(unsigned long long key, unsigned int program, double programCompileTime)
+{
+	compiled++;
+	compileTime += programCompileTime;
+	if (!enabled || !Supported())
+	{
+		return;
+	}
+
+	int length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+	{
+		return;
+	}
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, nullptr, &format, binary.data());
+
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+	std::ofstream out(PathFor(key).c_str(), std::ios::binary);
+	if (error || !out.good())
+	{
+		std::string m = "Could not write shader cache entry to " + directory;
+		Debug::Warn<ShaderCache>(m.c_str());
+		return;
+	}
+
+	unsigned int magic = CACHE_MAGIC, version = CACHE_VERSION, f = format, l = length;
+	out.write((char*)&magic, sizeof(magic));
+	out.write((char*)&version, sizeof(version));
+	out.write((char*)&key, sizeof(key));
+	out.write((char*)&f, sizeof(f));
+	out.write((char*)&l, sizeof(l));
+	out.write(binary.data(), length);
+}
+
+void ShaderCache::Clear()
+{
+	std::error_code error;
+	std::filesystem::remove_all(directory, error);
+	Debug::Log<ShaderCache>("Cleared shader cache");
+}
+
+void ShaderCache::ReportStats()
+{
+	std::stringstream s;
+	s << "Shader programs: " << hits << " from cache (" << loadTime << " ms), "
+		<< compiled << " compiled (" << compileTime << " ms)";
+	if (rejected > 0)
+	{
+		s << ", " << rejected << " cached binaries rejected by the driver";
+	}
+	s << (compiled == 0 && hits > 0 ? " - warm start" : (hits == 0 ? " - cold start" : ""));
+	Debug::Log<ShaderCache>(s.str().c_str());
+	std::cout << s.str() << std::endl;
+}
+
+void ShaderCache::ui()
+{
+	ImGui::Checkbox("Shader Binary Cache", &enabled);
+	ImGui::Text("Cached: %u (%.1f ms), compiled: %u (%.1f ms)", hits, loadTime, compiled, compileTime);
+	if (ImGui::Button("Clear Shader Cache"))
+	{
+		Clear();
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "Common.h"
+#include <chrono>
+
+// on disk cache of linked program binaries (glGetProgramBinary / glProgramBinary).
+// entries are keyed by a hash of every stage's source plus the driver vendor, renderer and version strings,
+// so a driver update or an edited shader just misses and falls back to compiling.
+class ShaderCache
+{
+public:
+	struct Timer
+	{
+		Timer() { start = std::chrono::high_resolution_clock::now(); }
+		// ms
+		double elapsed() { return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count(); }
+		std::chrono::high_resolution_clock::time_point start;
+	};
+
+	static unsigned long long MakeKey(const std::string& vertexCode, const std::string& geoCode, const std::string& fragCode);
+
+	// creates program and fills it from the cache, false on a miss or if the driver rejects the binary
+	static bool Load(unsigned long long key, unsigned int& program);
+	// compileTime is what the miss cost, for the startup report
+	static void Store(unsigned long long key, unsigned int program, double compileTime);
+
+	// deletes every cached binary, the next startup is a cold one
+	static void Clear();
+
+	// cold vs warm: how many programs came from the cache and what each path cost
+	static void ReportStats();
+	static void ui();
+
+	inline static bool enabled = true;
+	inline static std::string directory = "cache/shaders";
+
+private:
+	static bool Supported();
+	static std::string PathFor(unsigned long long key);
+
+	inline static int supported = -1;
+	inline static unsigned int hits = 0, compiled = 0, rejected = 0;
+	inline static double loadTime = 0.0, compileTime = 0.0;
+};
@@ -1,15 +1,36 @@
 #include "ShaderManager.h"
 
-ShaderManager::ShaderManager()
+ShaderManager::ShaderManager(GLFWwindow* window)
 {
-	defaultShader = std::unique_ptr<ShaderComponent>(new ShaderComponent(NULL, "res/shaders/pbr.vert", "res/shaders/pbr.frag"));
-	defaultAnimShader = std::unique_ptr<ShaderComponent>(new ShaderComponent(NULL, "res/shaders/anim.vert", "res/shaders/anim.frag"));
+	reloader = std::make_unique<ShaderReloader>(window);
+
+	meshVariants = std::make_unique<ShaderVariants>("res/shaders/pbr.vert", "res/shaders/pbr.frag", 0, reloader.get());
+	animVariants = std::make_unique<ShaderVariants>("res/shaders/anim.vert", "res/shaders/anim.frag", 0, reloader.get());
+
+	// the defaults are the full variants, everything sampled and room for every light
+	defaultShader = meshVariants->get(SHADER_ALL_MAPS, 32);
+	defaultAnimShader = animVariants->get(SHADER_ALL_MAPS, 32);
 	defaultParticleShader = std::unique_ptr<ShaderComponent>(new ShaderComponent(NULL, "res/shaders/particle.vert", "res/shaders/particle.frag"));
+	reloader->watch(defaultParticleShader);
+	oitParticleShader = std::make_shared<ShaderComponent>(nullptr, "res/shaders/particle.vert", "res/shaders/particle.frag", std::vector<std::string>{ "WBOIT" });
+	reloader->watch(oitParticleShader);
+	pickingShader = std::make_shared<ShaderComponent>(nullptr, "res/shaders/pbr.vert", "res/shaders/picking.frag");
+	animPickingShader = std::make_shared<ShaderComponent>(nullptr, "res/shaders/anim.vert", "res/shaders/picking.frag");
 }
 
 void ShaderManager::ReloadDefaultShaders()
 {
-	defaultShader = std::unique_ptr<ShaderComponent>(new ShaderComponent(NULL, "res/shaders/pbr.vert", "res/shaders/pbr.frag"));
-	defaultAnimShader = std::unique_ptr<ShaderComponent>(new ShaderComponent(NULL, "res/shaders/anim.vert", "res/shaders/anim.frag"));
-	defaultParticleShader = std::unique_ptr<ShaderComponent>(new ShaderComponent(NULL, "res/shaders/particle.vert", "res/shaders/particle.frag"));
+	reloader->reloadAll();
+}
+
+void ShaderManager::update()
+{
+	reloader->update();
+}
+
+void ShaderManager::ui()
+{
+	meshVariants->ui("Mesh");
+	animVariants->ui("Animated");
+	reloader->ui();
 }
@@ -1,15 +1,31 @@
 #pragma once
 #include "components/ShaderComponent.h"
+#include "ShaderReloader.h"
+#include "ShaderVariants.h"
 class ShaderManager
 {
 public:
-	ShaderManager();
+	ShaderManager(GLFWwindow* window);
 	~ShaderManager() {};
 
+	// rebuilds in the background, the current programs stay in use until the new ones link
 	void ReloadDefaultShaders();
+	// picks up edited shader files and swaps in finished rebuilds
+	void update();
+	std::unique_ptr<ShaderReloader> reloader;
+	void ui();
+
+	// permutations of the pbr and animated shaders, picked per mesh by the scene
+	std::unique_ptr<ShaderVariants> meshVariants;
+	std::unique_ptr<ShaderVariants> animVariants;
 	std::shared_ptr<ShaderComponent> defaultShader;
 	std::shared_ptr<ShaderComponent> defaultAnimShader;
 	std::shared_ptr<ShaderComponent> defaultParticleShader;
+	// writes to the TransparencyRenderer's targets instead
+	std::shared_ptr<ShaderComponent> oitParticleShader;
+	// entity ids for the picking target, see Scene::renderPicking
+	std::shared_ptr<ShaderComponent> pickingShader;
+	std::shared_ptr<ShaderComponent> animPickingShader;
 	
 	// further shaders to be added
 	// skybox, particles, framebuffer, post processing, shadows etc.
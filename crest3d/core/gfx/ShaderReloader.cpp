@@ -0,0 +1,316 @@
+#include "ShaderReloader.h"
+#include "Debug.h"
+
+ShaderReloader::ShaderReloader(GLFWwindow* mainWindow)
+{
+	enabled = true;
+	pollInterval = 0.5f;
+	lastPoll = 0.0;
+	numReloads = 0;
+	numFailures = 0;
+	stopWorker = false;
+	workerWindow = nullptr;
+
+	parallelCompile = GLEW_KHR_parallel_shader_compile;
+	if (parallelCompile)
+	{
+		// let the driver pick how many threads to use
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		Debug::Log<ShaderReloader>("Using KHR_parallel_shader_compile for shader reloads");
+		return;
+	}
+
+	// hidden window just for its context, everything but the framebuffer is shared with mainWindow
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	workerWindow = glfwCreateWindow(1, 1, "shader compiler", NULL, mainWindow);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+	if (workerWindow == NULL)
+	{
+		Debug::Warn<ShaderReloader>("Could not create a shared context, shader reloads will compile on the main thread");
+		return;
+	}
+	worker = std::thread(&ShaderReloader::workerLoop, this);
+	Debug::Log<ShaderReloader>("Using a shared context worker for shader reloads");
+}
+
+ShaderReloader::~ShaderReloader()
+{
+	if (worker.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(workerMutex);
+			stopWorker = true;
+		}
+		workerReady.notify_all();
+		worker.join();
+	}
+	if (workerWindow != nullptr)
+	{
+		glfwDestroyWindow(workerWindow);
+	}
+}
+
+void ShaderReloader::watch(std::shared_ptr<ShaderComponent> component)
+{
+	Watched w;
+	w.component = component;
+	std::shared_ptr<Shader> shader = component->shader;
+	w.paths.emplace_back(shader->GetVertexPath());
+	w.paths.emplace_back(shader->GetGeometryPath());
+	w.paths.emplace_back(shader->GetFragmentPath());
+	// included files are watched after the stages, editing one rebuilds everything that includes it
+	std::vector<std::string> includes;
+	for (int i = 0; i < 3; i++)
+	{
+		if (!w.paths[i].empty())
+		{
+			Shader::ReadSource(w.paths[i].c_str(), &includes);
+		}
+	}
+	for (auto& include : includes)
+	{
+		if (std::find(w.paths.begin(), w.paths.end(), include) == w.paths.end())
+		{
+			w.paths.emplace_back(include);
+		}
+	}
+	for (auto& path : w.paths)
+	{
+		std::error_code error;
+		w.times.emplace_back(path.empty() ? std::filesystem::file_time_type() : std::filesystem::last_write_time(path, error));
+	}
+	watched.emplace_back(w);
+}
+
+void ShaderReloader::reloadAll()
+{
+	for (auto& w : watched)
+	{
+		if (w.build != nullptr)
+		{
+			w.rebuildAfter = true;
+		}
+		else
+		{
+			startBuild(w);
+		}
+	}
+}
+
+void ShaderReloader::update()
+{
+	// finish builds first so a change that arrived mid build starts right away
+	for (auto& w : watched)
+	{
+		if (w.build != nullptr && isBuildDone(*w.build))
+		{
+			finishBuild(w);
+			if (w.rebuildAfter)
+			{
+				w.rebuildAfter = false;
+				startBuild(w);
+			}
+		}
+	}
+
+	double now = glfwGetTime();
+	if (!enabled || now - lastPoll < pollInterval)
+	{
+		return;
+	}
+	lastPoll = now;
+
+	for (auto& w : watched)
+	{
+		bool changed = false;
+		for (size_t i = 0; i < w.paths.size(); i++)
+		{
+			if (w.paths[i].empty())
+			{
+				continue;
+			}
+			std::error_code error;
+			auto time = std::filesystem::last_write_time(w.paths[i], error);
+			// editors often delete then rewrite, skip until the file is back
+			if (!error && time != w.times[i])
+			{
+				w.times[i] = time;
+				changed = true;
+			}
+		}
+
+		if (!changed)
+		{
+			continue;
+		}
+		if (w.build != nullptr)
+		{
+			w.rebuildAfter = true;
+		}
+		else
+		{
+			startBuild(w);
+		}
+	}
+}
+
+void ShaderReloader::CompileAndLink(Build& b, bool checkStatus)
+{
+	const GLenum types[3] = { GL_VERTEX_SHADER, GL_GEOMETRY_SHADER, GL_FRAGMENT_SHADER };
+	b.program = glCreateProgram();
+	for (int i = 0; i < 3; i++)
+	{
+		if (b.sources[i].empty())
+		{
+			continue;
+		}
+		const char* code = b.sources[i].c_str();
+		unsigned int stage = glCreateShader(types[i]);
+		glShaderSource(stage, 1, &code, NULL);
+		glCompileShader(stage);
+		glAttachShader(b.program, stage);
+		b.stages.emplace_back(stage);
+	}
+	glLinkProgram(b.program);
+
+	// querying status here would block until the driver is done, the parallel path polls instead
+	if (checkStatus)
+	{
+		CollectLogs(b);
+	}
+}
+
+void ShaderReloader::CollectLogs(Build& b)
+{
+	int success = 0;
+	char infoLog[1024];
+	glGetProgramiv(b.program, GL_LINK_STATUS, &success);
+	b.success = success != 0;
+	if (!b.success)
+	{
+		for (auto stage : b.stages)
+		{
+			int compiled = 0;
+			glGetShaderiv(stage, GL_COMPILE_STATUS, &compiled);
+			if (!compiled)
+			{
+				glGetShaderInfoLog(stage, sizeof(infoLog), NULL, infoLog);
+				b.log += infoLog;
+			}
+		}
+		glGetProgramInfoLog(b.program, sizeof(infoLog), NULL, infoLog);
+		b.log += infoLog;
+	}
+
+	for (auto stage : b.stages)
+	{
+		glDetachShader(b.program, stage);
+		glDeleteShader(stage);
+	}
+	b.stages.clear();
+}
+
+void ShaderReloader::startBuild(Watched& w)
+{
+	std::shared_ptr<Build> b = std::make_shared<Build>();
+	for (int i = 0; i < 3; i++)
+	{
+		if (!w.paths[i].empty())
+		{
+			b->sources[i] = Shader::InjectDefines(Shader::ReadSource(w.paths[i].c_str()), w.component->shader->GetDefines());
+		}
+	}
+	w.build = b;
+
+	if (parallelCompile)
+	{
+		CompileAndLink(*b, false);
+	}
+	else if (worker.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(workerMutex);
+			workerQueue.emplace_back(b);
+		}
+		workerReady.notify_one();
+	}
+	else
+	{
+		// no way to do it in the background, at least it only happens on a change
+		CompileAndLink(*b, true);
+		b->done = true;
+	}
+}
+
+bool ShaderReloader::isBuildDone(Build& b)
+{
+	if (parallelCompile)
+	{
+		int complete = 0;
+		glGetProgramiv(b.program, GL_COMPLETION_STATUS_KHR, &complete);
+		if (complete && !b.done)
+		{
+			CollectLogs(b);
+			b.done = true;
+		}
+	}
+	return b.done;
+}
+
+void ShaderReloader::finishBuild(Watched& w)
+{
+	std::shared_ptr<Build> b = w.build;
+	w.build = nullptr;
+	const std::string& name = w.paths[2];
+
+	if (!b->success)
+	{
+		numFailures++;
+		glDeleteProgram(b->program);
+		std::string m = "Reload of " + name + " failed, keeping the previous program\n" + b->log;
+		Debug::Error<ShaderReloader>(m.c_str());
+		return;
+	}
+
+	w.component->shader->swapProgram(b->program);
+	w.component->refreshLocations();
+	if (onReloaded)
+	{
+		onReloaded(w.component);
+	}
+	numReloads++;
+	std::string m = "Reloaded " + name;
+	Debug::Log<ShaderReloader>(m.c_str());
+}
+
+void ShaderReloader::workerLoop()
+{
+	glfwMakeContextCurrent(workerWindow);
+	while (true)
+	{
+		std::shared_ptr<Build> b;
+		{
+			std::unique_lock<std::mutex> lock(workerMutex);
+			workerReady.wait(lock, [this] { return stopWorker || !workerQueue.empty(); });
+			if (stopWorker)
+			{
+				break;
+			}
+			b = workerQueue.front();
+			workerQueue.erase(workerQueue.begin());
+		}
+
+		CompileAndLink(*b, true);
+		// the program object is shared, make sure it is complete before the main context uses it
+		glFinish();
+		b->done = true;
+	}
+	glfwMakeContextCurrent(NULL);
+}
+
+void ShaderReloader::ui()
+{
+	ImGui::Checkbox("Watch Shader Files", &enabled);
+	ImGui::Text("Shader reloads: %u, failed: %u (%s)", numReloads, numFailures,
+		parallelCompile ? "parallel compile" : (worker.joinable() ? "shared context" : "main thread"));
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "Common.h"
+#include "components/ShaderComponent.h"
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+
+// watches the source files of registered shaders and rebuilds them without blocking the frame.
+// with GL_KHR_parallel_shader_compile the driver compiles on its own threads and we poll for completion,
+// otherwise a worker thread compiles on a hidden context shared with the main one.
+// the new program is only swapped in once it links, a broken edit keeps the old one running.
+class ShaderReloader
+{
+public:
+	ShaderReloader(GLFWwindow* mainWindow);
+	~ShaderReloader();
+
+	void watch(std::shared_ptr<ShaderComponent> component);
+	// rebuild everything being watched, whether or not it changed
+	void reloadAll();
+
+	// once a frame, checks file times and finishes any builds that are done
+	void update();
+
+	// called after a program has been swapped, for anything caching uniform locations of its own
+	std::function<void(std::shared_ptr<ShaderComponent>)> onReloaded;
+
+	bool enabled;
+	float pollInterval; // seconds between file time checks
+
+	void ui();
+
+private:
+	struct Build
+	{
+		unsigned int program = 0;
+		std::vector<unsigned int> stages;
+		std::atomic<bool> done{ false }; // worker path only
+		bool success = false;
+		std::string log;
+		std::string sources[3];
+	};
+
+	struct Watched
+	{
+		std::shared_ptr<ShaderComponent> component;
+		std::vector<std::string> paths;
+		std::vector<std::filesystem::file_time_type> times;
+		std::shared_ptr<Build> build;
+		bool rebuildAfter = false; // changed again while a build was in flight
+	};
+
+	void startBuild(Watched& w);
+	void finishBuild(Watched& w);
+	bool isBuildDone(Build& b);
+
+	static void CompileAndLink(Build& b, bool checkStatus);
+	static void CollectLogs(Build& b);
+
+	// shared context fallback
+	void workerLoop();
+	GLFWwindow* workerWindow;
+	std::thread worker;
+	std::mutex workerMutex;
+	std::condition_variable workerReady;
+	std::vector<std::shared_ptr<Build>> workerQueue;
+	bool stopWorker;
+
+	std::vector<Watched> watched;
+	bool parallelCompile;
+	double lastPoll;
+	unsigned int numReloads, numFailures;
+};
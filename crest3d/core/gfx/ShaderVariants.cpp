@@ -0,0 +1,104 @@
+#include "ShaderVariants.h"
+#include "ShaderReloader.h"
+#include "Debug.h"
+
+static const unsigned int MAX_LIGHT_BUCKET = 32;
+
+ShaderVariants::ShaderVariants(const std::string& _vertexPath, const std::string& _fragPath, unsigned int _baseFeatures, ShaderReloader* _reloader)
+{
+	vertexPath = _vertexPath;
+	fragPath = _fragPath;
+	baseFeatures = _baseFeatures;
+	reloader = _reloader;
+	enabled = true;
+}
+
+std::shared_ptr<ShaderComponent> ShaderVariants::get(unsigned int features, unsigned int numPointLights)
+{
+	unsigned int bucket = LightBucket(numPointLights);
+	if (!enabled)
+	{
+		// how the maps are bound and what the pass writes still have to match
+		features = SHADER_ALL_MAPS | (features & (SHADER_TEXTURE_ARRAYS | SHADER_GBUFFER | SHADER_SHADOWS));
+		bucket = MAX_LIGHT_BUCKET;
+	}
+	features |= baseFeatures;
+
+	unsigned int key = (features & 0xFFFF) | (bucket << 16);
+	auto it = variants.find(key);
+	if (it != variants.end())
+	{
+		return it->second;
+	}
+
+	// first use, compiled here (or loaded from the ShaderCache)
+	std::vector<std::string> defines = MakeDefines(features, bucket);
+	std::shared_ptr<ShaderComponent> sc = std::make_shared<ShaderComponent>(nullptr, vertexPath.c_str(), fragPath.c_str(), defines);
+	variants[key] = sc;
+	if (reloader != nullptr)
+	{
+		reloader->watch(sc);
+	}
+
+	std::stringstream s;
+	s << "Built variant of " << fragPath << ":";
+	for (auto& d : defines)
+	{
+		s << " " << d;
+	}
+	Debug::Log<ShaderVariants>(s.str().c_str());
+	return sc;
+}
+
+unsigned int ShaderVariants::FeaturesFromTextures(const std::vector<Texture>& textures)
+{
+	unsigned int features = 0;
+	for (auto& t : textures)
+	{
+		switch (t.t_Type)
+		{
+		case TextureType::normal: features |= SHADER_NORMAL_MAP; break;
+		case TextureType::ao: features |= SHADER_AO_MAP; break;
+		case TextureType::metallic: features |= SHADER_METALLIC_MAP; break;
+		case TextureType::roughness: features |= SHADER_ROUGHNESS_MAP; break;
+		default: break;
+		}
+	}
+	return features;
+}
+
+unsigned int ShaderVariants::LightBucket(unsigned int numPointLights)
+{
+	if (numPointLights == 0)
+	{
+		return 0;
+	}
+	unsigned int bucket = 4;
+	while (bucket < numPointLights && bucket < MAX_LIGHT_BUCKET)
+	{
+		bucket *= 2;
+	}
+	return bucket;
+}
+
+std::vector<std::string> ShaderVariants::MakeDefines(unsigned int features, unsigned int lightBucket)
+{
+	std::vector<std::string> defines;
+	if (features & SHADER_NORMAL_MAP) { defines.emplace_back("HAS_NORMAL_MAP"); }
+	if (features & SHADER_AO_MAP) { defines.emplace_back("HAS_AO_MAP"); }
+	if (features & SHADER_METALLIC_MAP) { defines.emplace_back("HAS_METALLIC_MAP"); }
+	if (features & SHADER_ROUGHNESS_MAP) { defines.emplace_back("HAS_ROUGHNESS_MAP"); }
+	if (features & SHADER_TEXTURE_ARRAYS) { defines.emplace_back("TEXTURE_ARRAYS"); }
+	if (features & SHADER_GBUFFER) { defines.emplace_back("GBUFFER"); }
+	if (features & SHADER_SHADOWS) { defines.emplace_back("SHADOWS"); }
+	defines.emplace_back("MAX_POINT_LIGHTS " + std::to_string(lightBucket));
+	return defines;
+}
+
+void ShaderVariants::ui(const char* label)
+{
+	std::string checkbox = std::string(label) + " Shader Variants";
+	ImGui::Checkbox(checkbox.c_str(), &enabled);
+	ImGui::SameLine();
+	ImGui::Text("(%u compiled)", (unsigned int)variants.size());
+}
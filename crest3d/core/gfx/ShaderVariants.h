@@ -0,0 +1,53 @@
+#pragma once
+#include "Common.h"
+#include "components/ShaderComponent.h"
+
+class ShaderReloader;
+
+// feature bits a permutation is specialised on, each maps to a #define in the shader source
+enum ShaderFeature : unsigned int
+{
+	SHADER_NORMAL_MAP = 1 << 0,
+	SHADER_AO_MAP = 1 << 1,
+	SHADER_METALLIC_MAP = 1 << 2,
+	SHADER_ROUGHNESS_MAP = 1 << 3,
+	// material maps are layers of sampler2DArrays, see TextureArrays
+	SHADER_TEXTURE_ARRAYS = 1 << 4,
+	// writes the g-buffer instead of lighting, see DeferredRenderer
+	SHADER_GBUFFER = 1 << 5,
+	// directional light shadows from a CascadedShadowMap
+	SHADER_SHADOWS = 1 << 6,
+
+	SHADER_ALL_MAPS = SHADER_NORMAL_MAP | SHADER_AO_MAP | SHADER_METALLIC_MAP | SHADER_ROUGHNESS_MAP
+};
+
+// compiles permutations of one vertex/fragment pair on demand and keeps them around.
+// a mesh asks for the variant matching the maps it really has, so nothing samples the default textures
+// and the point light loop has a compile time bound.
+class ShaderVariants
+{
+public:
+	// baseFeatures are always on for this family
+	ShaderVariants(const std::string& vertexPath, const std::string& fragPath, unsigned int baseFeatures, ShaderReloader* reloader = nullptr);
+
+	std::shared_ptr<ShaderComponent> get(unsigned int features, unsigned int numPointLights);
+
+	static unsigned int FeaturesFromTextures(const std::vector<Texture>& textures);
+	// smallest of 0, 4, 8, 16, 32 that fits
+	static unsigned int LightBucket(unsigned int numPointLights);
+	static std::vector<std::string> MakeDefines(unsigned int features, unsigned int lightBucket);
+
+	inline size_t GetNumVariants() { return variants.size(); }
+
+	// false always hands out the full variant, to compare against
+	bool enabled;
+
+	void ui(const char* label);
+
+private:
+	std::string vertexPath, fragPath;
+	unsigned int baseFeatures;
+	ShaderReloader* reloader;
+	// features in the low 16 bits, light bucket above
+	std::map<unsigned int, std::shared_ptr<ShaderComponent>> variants;
+};
@@ -0,0 +1,125 @@
+#include "TextureArrays.h"
+#include "Debug.h"
+#include <tuple>
+
+void TextureArrays::pack(const std::vector<unsigned int>& textures)
+{
+	clear();
+
+	// bucket by size and internal format, those have to match within an array
+	std::map<std::tuple<int, int, int>, std::vector<unsigned int>> buckets;
+	for (unsigned int t : textures)
+	{
+		if (t == 0)
+		{
+			continue;
+		}
+		int width = 0, height = 0, format = 0;
+		glBindTexture(GL_TEXTURE_2D, t);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+		if (width == 0 || height == 0)
+		{
+			continue;
+		}
+		std::vector<unsigned int>& bucket = buckets[std::make_tuple(width, height, format)];
+		if (std::find(bucket.begin(), bucket.end(), t) == bucket.end())
+		{
+			bucket.emplace_back(t);
+		}
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	int maxLayers = 256;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+	std::vector<unsigned char> pixels;
+
+	for (auto& bucket : buckets)
+	{
+		int width = std::get<0>(bucket.first);
+		int height = std::get<1>(bucket.first);
+		int format = std::get<2>(bucket.first);
+		const std::vector<unsigned int>& members = bucket.second;
+
+		for (size_t first = 0; first < members.size(); first += maxLayers)
+		{
+			ArrayInfo info;
+			info.width = width;
+			info.height = height;
+			info.format = format;
+			info.numLayers = std::min<size_t>(maxLayers, members.size() - first);
+
+			glGenTextures(1, &info.id);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, info.id);
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, format, width, height, info.numLayers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+			for (unsigned int l = 0; l < info.numLayers; l++)
+			{
+				unsigned int source = members[first + l];
+				if (GLEW_ARB_copy_image)
+				{
+					glCopyImageSubData(source, GL_TEXTURE_2D, 0, 0, 0, 0, info.id, GL_TEXTURE_2D_ARRAY, 0, 0, 0, l, width, height, 1);
+				}
+				else
+				{
+					// round trip through the cpu, only happens once at load
+					pixels.resize((size_t)width * height * 4);
+					glBindTexture(GL_TEXTURE_2D, source);
+					glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+					glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, l, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+				}
+				TextureLayer tl;
+				tl.array = info.id;
+				tl.layer = l;
+				layers[source] = tl;
+			}
+			glBindTexture(GL_TEXTURE_2D, 0);
+
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+			arrays.emplace_back(info);
+		}
+	}
+
+	std::stringstream s;
+	s << "Packed " << layers.size() << " textures in to " << arrays.size() << " texture arrays ("
+		<< (GetMemoryUsage() / (1024 * 1024)) << " MB)";
+	Debug::Log<TextureArrays>(s.str().c_str());
+}
+
+bool TextureArrays::find(unsigned int texture, TextureLayer& out) const
+{
+	auto it = layers.find(texture);
+	if (it == layers.end())
+	{
+		return false;
+	}
+	out = it->second;
+	return true;
+}
+
+void TextureArrays::clear()
+{
+	for (auto& a : arrays)
+	{
+		glDeleteTextures(1, &a.id);
+	}
+	arrays.clear();
+	layers.clear();
+}
+
+size_t TextureArrays::GetMemoryUsage()
+{
+	size_t total = 0;
+	for (auto& a : arrays)
+	{
+		// a full mip chain adds a third
+		total += (size_t)a.width * a.height * a.numLayers * 4 * 4 / 3;
+	}
+	return total;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "Common.h"
+
+// where a packed texture ended up
+struct TextureLayer
+{
+	unsigned int array = 0;
+	unsigned int layer = 0;
+};
+
+// packs 2d textures with the same size and format in to GL_TEXTURE_2D_ARRAY layers, so meshes with
+// different maps can share one set of bound textures and only differ by the layer they sample.
+// the source textures are left alone, the arrays are an extra copy.
+class TextureArrays
+{
+public:
+	TextureArrays() {};
+	~TextureArrays() { clear(); }
+
+	// throws away the current arrays and packs these textures, copying on the gpu where possible
+	void pack(const std::vector<unsigned int>& textures);
+	// false if the texture wasn't packed
+	bool find(unsigned int texture, TextureLayer& out) const;
+	void clear();
+
+	inline size_t GetNumArrays() { return arrays.size(); }
+	inline size_t GetNumPacked() { return layers.size(); }
+	// approximate, 4 bytes a texel plus mips
+	size_t GetMemoryUsage();
+
+private:
+	struct ArrayInfo
+	{
+		unsigned int id;
+		int width, height;
+		int format;
+		unsigned int numLayers;
+	};
+
+	std::vector<ArrayInfo> arrays;
+	std::map<unsigned int, TextureLayer> layers;
+};
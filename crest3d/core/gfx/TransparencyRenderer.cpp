@@ -0,0 +1,151 @@
+#include "TransparencyRenderer.h"
+#include "gfx/FrameBuffer.h"
+#include "Debug.h"
+
+TransparencyRenderer::TransparencyRenderer()
+{
+	fbo = 0;
+	accumulation = revealage = depth = 0;
+	allocatedWidth = allocatedHeight = 0;
+	allocatedDepthFormat = 0;
+	previousFramebuffer = 0;
+	viewport[0] = viewport[1] = viewport[2] = viewport[3] = 0;
+
+	compositeShader = std::make_shared<Shader>("res/shaders/framebuffer.vert", "res/shaders/oit_composite.frag");
+	compositeShader->use();
+	compositeShader->setInt("revealageTexture", 1);
+	glUseProgram(0);
+}
+
+TransparencyRenderer::~TransparencyRenderer()
+{
+	unsigned int textures[2] = { accumulation, revealage };
+	glDeleteTextures(2, textures);
+	glDeleteRenderbuffers(1, &depth);
+	glDeleteFramebuffers(1, &fbo);
+}
+
+static unsigned int MakeTarget(int internalFormat, int format, int width, int height)
+{
+	unsigned int t;
+	glGenTextures(1, &t);
+	glBindTexture(GL_TEXTURE_2D, t);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_HALF_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	return t;
+}
+
+void TransparencyRenderer::resize(int width, int height, int depthFormat)
+{
+	if (width <= allocatedWidth && height <= allocatedHeight && depthFormat == allocatedDepthFormat)
+	{
+		return;
+	}
+	allocatedWidth = std::max(width, allocatedWidth);
+	allocatedHeight = std::max(height, allocatedHeight);
+	allocatedDepthFormat = depthFormat;
+
+	if (fbo != 0)
+	{
+		unsigned int textures[2] = { accumulation, revealage };
+		glDeleteTextures(2, textures);
+		glDeleteRenderbuffers(1, &depth);
+		glDeleteFramebuffers(1, &fbo);
+	}
+
+	// premultiplied colour times weight can go well past 1, revealage is a product of small numbers
+	accumulation = MakeTarget(GL_RGBA16F, GL_RGBA, allocatedWidth, allocatedHeight);
+	revealage = MakeTarget(GL_R16F, GL_RED, allocatedWidth, allocatedHeight);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	// only ever tested against, so a renderbuffer
+	glGenRenderbuffers(1, &depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, depthFormat, allocatedWidth, allocatedHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	bool hasStencil = FrameBuffer::HasStencil(depthFormat);
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumulation, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, revealage, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, hasStencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+	unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, attachments);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		Debug::Error<TransparencyRenderer>("Transparency targets are incomplete");
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	std::stringstream s;
+	s << "Resized transparency targets to " << allocatedWidth << "x" << allocatedHeight;
+	Debug::Log<TransparencyRenderer>(s.str().c_str());
+}
+
+void TransparencyRenderer::begin()
+{
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+	resize(viewport[2], viewport[3], FrameBuffer::GetDepthFormat(previousFramebuffer));
+
+	// translucent draws are hidden by the opaque scene, so they need its depth. a multisampled source is
+	// resolved by the blit
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, previousFramebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+	GLbitfield mask = GL_DEPTH_BUFFER_BIT;
+	if (FrameBuffer::HasStencil(allocatedDepthFormat))
+	{
+		mask |= GL_STENCIL_BUFFER_BIT;
+	}
+	glBlitFramebuffer(viewport[0], viewport[1], viewport[0] + viewport[2], viewport[1] + viewport[3],
+		0, 0, viewport[2], viewport[3], mask, GL_NEAREST);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glViewport(0, 0, viewport[2], viewport[3]);
+	const float zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	const float one[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	glClearBufferfv(GL_COLOR, 0, zero);
+	glClearBufferfv(GL_COLOR, 1, one);
+
+	// accumulation sums, revealage multiplies by 1 - alpha
+	glEnable(GL_BLEND);
+	glBlendFunci(0, GL_ONE, GL_ONE);
+	glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+	glDepthMask(GL_FALSE);
+}
+
+void TransparencyRenderer::end()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+	// average colour over what's behind, letting revealage of it through
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, revealage);
+	compositeShader->use();
+	glUniform2i(glGetUniformLocation(compositeShader->id, "viewportOrigin"), viewport[0], viewport[1]);
+	glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+	glDepthFunc(GL_ALWAYS);
+	quad.Draw(*compositeShader, "accumulationTexture", accumulation);
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+size_t TransparencyRenderer::GetMemoryUsage()
+{
+	// rgba16f + r16f + a 4 byte depth (or 8 for 32f + stencil)
+	size_t depthBytes = allocatedDepthFormat == GL_DEPTH32F_STENCIL8 ? 8 : 4;
+	return (size_t)allocatedWidth * allocatedHeight * (8 + 2 + depthBytes);
+}
+
+void TransparencyRenderer::ui()
+{
+	ImGui::Text("Transparency targets %dx%d (%.1f MB)", allocatedWidth, allocatedHeight, GetMemoryUsage() / (1024.0f * 1024.0f));
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "Common.h"
+#include "gfx/Shader.h"
+#include "primitives/Quad.h"
+
+// weighted blended order independent transparency. translucent draws add their premultiplied colour, weighted
+// by depth and coverage, in to an accumulation target and multiply what they let through in to a revealage
+// target. both blends are commutative, so nothing has to be sorted. the composite then lays the weighted average
+// over the opaque image. the depth weighting is an approximation, close layers of similar alpha can blend in the
+// wrong order, which particles get away with.
+class TransparencyRenderer
+{
+public:
+	TransparencyRenderer();
+	~TransparencyRenderer();
+
+	// binds the targets sized to the current viewport, with the bound framebuffer's depth copied in, and sets
+	// the blending. draw with shaders built with WBOIT, depth is tested but not written
+	void begin();
+	// composites in to the framebuffer that was bound before begin, and puts the blend and depth state back
+	void end();
+
+	// accumulation, revealage and depth copy
+	size_t GetMemoryUsage();
+	void ui();
+
+private:
+	// grows like the g-buffer, and remakes the depth copy if the source's format changes
+	void resize(int width, int height, int depthFormat);
+
+	unsigned int fbo;
+	unsigned int accumulation, revealage, depth;
+	int allocatedWidth, allocatedHeight, allocatedDepthFormat;
+	int viewport[4];
+	int previousFramebuffer;
+
+	std::shared_ptr<Shader> compositeShader;
+	screenQuad quad;
+};
@@ -1,4 +1,5 @@
 #include "Quad.h"
+#include "gfx/SamplerCache.h"
 
 Quad::Quad(std::string texturePath) {
 	tex.t_Path = texturePath;
@@ -43,11 +44,12 @@ void Quad::Draw(Shader shader)
 	shader.setInt(s, 0);
 
 	glBindTexture(GL_TEXTURE_2D, tex.t_Id);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	// clamped through a shared sampler rather than changing the texture's parameters every draw
+	glBindSampler(0, SamplerCache::ScreenSampler());
 
 	glBindVertexArray(vao);
 	glDrawArrays(GL_TRIANGLES, 0, 6);
+	glBindSampler(0, 0);
 	glActiveTexture(GL_TEXTURE0);
 }
 
@@ -56,11 +58,12 @@ void Quad::Draw(Shader shader, const char* uniformName, unsigned int textureLoca
 	glActiveTexture(GL_TEXTURE0);
 	shader.setInt(uniformName, 0);
 	glBindTexture(GL_TEXTURE_2D, textureLocation);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	// clamped through a shared sampler rather than changing the texture's parameters every draw
+	glBindSampler(0, SamplerCache::ScreenSampler());
 
 	glBindVertexArray(vao);
 	glDrawArrays(GL_TRIANGLES, 0, 6);
+	glBindSampler(0, 0);
 	glActiveTexture(GL_TEXTURE0);
 }
 
@@ -82,11 +85,12 @@ void screenQuad::Draw(Shader shader, const char* uniformName, unsigned int textu
 	glActiveTexture(GL_TEXTURE0);
 	shader.setInt(uniformName, 0);
 	glBindTexture(GL_TEXTURE_2D, textureLocation);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	// clamped through a shared sampler rather than changing the texture's parameters every draw
+	glBindSampler(0, SamplerCache::ScreenSampler());
 
 	glBindVertexArray(vao);
 	glDrawArrays(GL_TRIANGLES, 0, 6);
+	glBindSampler(0, 0);
 	glActiveTexture(GL_TEXTURE0);
 }
 
@@ -41,6 +41,16 @@ public:
 		return v;
 	}
 
+	static glm::vec4 DeserializeVec4(tinyxml2::XMLElement* element)
+	{
+		glm::vec4 v = glm::vec4(0.0);
+		v.x = DeserializeFloat(element->Attribute("x"));
+		v.y = DeserializeFloat(element->Attribute("y"));
+		v.z = DeserializeFloat(element->Attribute("z"));
+		v.w = DeserializeFloat(element->Attribute("w"));
+		return v;
+	}
+
 	static glm::quat DeserializeQuaternion(tinyxml2::XMLElement* element)
 	{
 		glm::quat v;
@@ -102,6 +112,17 @@ public:
 		return vecElement;
 	}
 
+	static tinyxml2::XMLElement* SerializeVec4(glm::vec4 v, std::string name, tinyxml2::XMLDocument* doc)
+	{
+		auto vecElement = doc->NewElement("Vector4");
+		vecElement->SetAttribute("name", name.c_str());
+		vecElement->SetAttribute("x", v.x);
+		vecElement->SetAttribute("y", v.y);
+		vecElement->SetAttribute("z", v.z);
+		vecElement->SetAttribute("w", v.w);
+		return vecElement;
+	}
+
 	static tinyxml2::XMLElement *SerializeQuat(glm::quat v, std::string name, tinyxml2::XMLDocument *doc)
 	{
 		auto vecElement = doc->NewElement("Quaternion");
@@ -230,7 +251,7 @@ public:
 			if(strcmp(elementType, e->Value()) == 0)
 			{
 				// if element name is correct
-				if(strcmp(elementName, e->Attribute("name")))
+				if(e->Attribute("name") != nullptr && strcmp(elementName, e->Attribute("name")) == 0)
 				{
 					return e;
 				}
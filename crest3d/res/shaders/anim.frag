@@ -5,6 +5,12 @@ in vec2 TexCoords;
 in vec3 WorldPos;
 in vec3 Normal;
 
+// permutations, injected by ShaderVariants after #version:
+// HAS_NORMAL_MAP, HAS_AO_MAP, HAS_METALLIC_MAP, HAS_ROUGHNESS_MAP - material maps the mesh actually has,
+// without them the constant values below are used and the texture is never fetched.
+// MAX_POINT_LIGHTS - light count bucket, makes the light loop bound a compile time constant.
+// SHADOWS - directional light shadows from the cascaded shadow map.
+
 struct Material 
 {
 	sampler2D m_Diffuse;
@@ -15,6 +21,24 @@ struct Material
 	float m_Shininess;
 };
 
+// used when the mesh has no map for them, filled from the material's PropertyGroup
+layout(std140) uniform MaterialBlock
+{
+	float metallicValue;
+	float roughnessValue;
+	float aoValue;
+	// layer of each map when TEXTURE_ARRAYS is on
+	int diffuseLayer;
+	int normalLayer;
+	int aoLayer;
+	int roughnessLayer;
+	int metallicLayer;
+};
+
+#ifndef MAX_POINT_LIGHTS
+#define MAX_POINT_LIGHTS 32
+#endif
+
 struct DirLight
 {
 	vec3 direction;
@@ -43,12 +67,20 @@ uniform int numPointLights = 32;
 uniform Material mat;
 
 uniform DirLight dirLight;
-uniform PointLight pointLights[32];
+#if MAX_POINT_LIGHTS > 0
+uniform PointLight pointLights[MAX_POINT_LIGHTS];
+#endif
 
 uniform vec3 viewPosition;
 
 const float PI = 3.14159265359;
 
+#ifdef SHADOWS
+uniform mat4 view;
+#include "shadows.glsl"
+#endif
+
+
 // ----------------------------------------------------------------------------
 // Easy trick to get tangent-normals to world-space to keep PBR code simplified.
 // Don't worry if you don't get what's going on; you generally want to do normal 
@@ -57,6 +89,9 @@ const float PI = 3.14159265359;
 
 vec3 getNormalFromMap()
 {
+#ifndef HAS_NORMAL_MAP
+    return normalize(Normal);
+#else
     vec3 tangentNormal =texture(mat.m_Normal, TexCoords).xyz * 2.0 - 1.0;
 
     vec3 Q1  = dFdx(WorldPos);
@@ -70,6 +105,7 @@ vec3 getNormalFromMap()
     mat3 TBN = mat3(T, B, N);
 
     return normalize(TBN * tangentNormal);
+#endif
 }
 // ----------------------------------------------------------------------------
 float DistributionGGX(vec3 N, vec3 H, float roughness)
@@ -121,6 +157,9 @@ vec3 calculatePointLight(vec3 albedo, vec3 N, vec3 F0, vec3 V, float roughness,
 
     float distance = length(pl.position - WorldPos);
     float attenuation = 1.0 / (distance * distance);
+    // windowed to zero at pl.distance, matches pbr.frag
+    float falloff = clamp(1.0 - pow(distance / pl.distance, 4.0), 0.0, 1.0);
+    attenuation *= falloff * falloff;
     vec3 radiance = pl.diffuse * (attenuation * pl.distance);
 
     // Cook-Torrance BRDF
@@ -192,9 +231,21 @@ void main()
     if(rawTex.a < 0.1)
         discard;		
     vec3 albedo     = pow(rawTex.rgb, vec3(2.2));
+#ifdef HAS_METALLIC_MAP
     float metallic  = texture(mat.m_Metallic, TexCoords).r;
+#else
+    float metallic  = metallicValue;
+#endif
+#ifdef HAS_ROUGHNESS_MAP
     float roughness = texture(mat.m_Roughness, TexCoords).r;
+#else
+    float roughness = roughnessValue;
+#endif
+#ifdef HAS_AO_MAP
     float ao        = texture(mat.m_AO, TexCoords).r;
+#else
+    float ao        = aoValue;
+#endif
 
     vec3 N = getNormalFromMap();
     vec3 V = normalize(viewPosition - WorldPos);
@@ -207,12 +258,20 @@ void main()
     // reflectance equation
     vec3 Lo = vec3(0.0);
 
+#ifdef SHADOWS
+    Lo += calculateDirectionalLight(albedo, N, F0, V, roughness, metallic) * calculateShadow(WorldPos, normalize(Normal));
+#else
     Lo += calculateDirectionalLight(albedo, N, F0, V, roughness, metallic);
+#endif
 
-    for(int i = 0; i < numPointLights; i++) 
+#if MAX_POINT_LIGHTS > 0
+    for(int i = 0; i < MAX_POINT_LIGHTS; i++) 
     {
+        if (i >= numPointLights)
+            break;
          Lo += calculatePointLight(albedo, N, F0, V, roughness, metallic, pointLights[i]);  // note that we already multiplied the BRDF by the Fresnel (kS) so we won't multiply by kS again
-    }   
+    }
+#endif
     
     // ambient lighting (note that the next IBL tutorial will replace 
     // this ambient lighting with environment lighting).
@@ -0,0 +1,22 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 vTexCoords;
+
+// lit image from deferred_lighting.comp and the g-buffer depth, both the size of the viewport
+uniform sampler2D litTexture;
+uniform sampler2D depthTexture;
+// viewport offset in the target, gl_FragCoord is in window space
+uniform ivec2 viewportOrigin;
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy) - viewportOrigin;
+	float depth = texelFetch(depthTexture, pixel, 0).r;
+	if (depth >= 1.0)
+		discard;
+
+	// depth goes along so forward drawables after this still test against the opaque scene
+	gl_FragDepth = depth;
+	FragColor = texelFetch(litTexture, pixel, 0);
+}
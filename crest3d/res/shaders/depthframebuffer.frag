@@ -5,6 +5,7 @@ out vec4 FragColor;
 in vec2 vTexCoords;
 
 uniform sampler2D screenTexture;
+uniform vec2 uvScale;
 
 
 float LinearizeDepth(in vec2 uv)
@@ -17,6 +18,6 @@ float LinearizeDepth(in vec2 uv)
 
 void main()
 {
-    float c = LinearizeDepth(vTexCoords);
+    float c = LinearizeDepth(vTexCoords * uvScale);
     FragColor = vec4(c, c, c, 1.0);
 }
\ No newline at end of file
@@ -8,6 +8,8 @@ uniform sampler2D screenTexture;
 uniform sampler2D volumetrics;
 uniform float exposure;
 uniform float gamma;
+// portion of screenTexture that was rendered to (dynamic resolution)
+uniform vec2 uvScale;
 
 
 vec2 cubic_distortion()
@@ -35,7 +37,7 @@ vec2 cubic_distortion()
 void main()
 {
     vec2 pos = cubic_distortion();
-    vec4 baseMap = texture2D(screenTexture, pos);
+    vec4 baseMap = texture2D(screenTexture, pos * uvScale);
     // reinhard tone mapping
     vec3 mapped = vec3(1.0) - exp(-baseMap.xyz * exposure);
     // Gamma correction 
@@ -0,0 +1,28 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 vTexCoords;
+
+// weighted sums from the WBOIT draws, the size of the viewport. see TransparencyRenderer
+uniform sampler2D accumulationTexture;
+uniform sampler2D revealageTexture;
+// viewport offset in the target, gl_FragCoord is in window space
+uniform ivec2 viewportOrigin;
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy) - viewportOrigin;
+	float revealage = texelFetch(revealageTexture, pixel, 0).r;
+	// nothing translucent here
+	if (revealage >= 1.0)
+		discard;
+
+	vec4 accumulation = texelFetch(accumulationTexture, pixel, 0);
+	// a lot of bright layers can overflow half floats
+	if (isinf(max(max(abs(accumulation.r), abs(accumulation.g)), abs(accumulation.b))))
+		accumulation.rgb = vec3(accumulation.a);
+
+	// blended with GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA, revealage of the background shows through
+	vec3 average = accumulation.rgb / clamp(accumulation.a, 1e-4, 5e4);
+	FragColor = vec4(average, revealage);
+}
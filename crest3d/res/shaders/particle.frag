@@ -33,7 +33,13 @@ in vec3 Position;
 in vec4 particlecolor;
 
 // Ouput data
+#ifdef WBOIT
+// see TransparencyRenderer, weighted premultiplied colour and coverage
+layout(location = 0) out vec4 accumulation;
+layout(location = 1) out float revealage;
+#else
 out vec4 color;
+#endif
 
 uniform Material mat;
 
@@ -44,6 +50,37 @@ uniform int NOPL;
 uniform sampler2D m_Diffuse;
 uniform vec3 viewPosition;
 
+// this frame's opaque depth, recorded before particles draw, see DepthHistory
+uniform int hasPreviousDepth;
+uniform sampler2D previousDepth;
+uniform mat4 previousViewProjection;
+uniform vec2 previousDepthParams;
+uniform vec2 previousUVScale;
+// the emitter's, 0 for hard edges
+uniform float softDistance;
+// the emitter's blend, summed or over the scene by alpha
+uniform int additive;
+
+// 0 where the particle meets the scene, 1 from softDistance in front of it
+float softFade()
+{
+	if (hasPreviousDepth == 0 || softDistance <= 0.0)
+		return 1.0;
+	vec4 clip = previousViewProjection * vec4(Position, 1.0);
+	if (clip.w <= 0.0)
+		return 1.0;
+	vec2 ndc = clip.xy / clip.w;
+	if (any(greaterThan(abs(ndc), vec2(1.0))))
+		return 1.0;
+
+	vec2 drawnSize = vec2(textureSize(previousDepth, 0)) * previousUVScale;
+	// ndc of exactly 1 lands one past the recorded region
+	ivec2 texel = clamp(ivec2((ndc * 0.5 + 0.5) * drawnSize), ivec2(0), ivec2(drawnSize) - 1);
+	float depth = texelFetch(previousDepth, texel, 0).r;
+	float sceneDistance = previousDepthParams.y / (depth * 2.0 - 1.0 + previousDepthParams.x);
+	return clamp((sceneDistance - clip.w) / softDistance, 0.0, 1.0);
+}
+
 
 vec3 calcDirLight(DirLight dirLight, vec3 normal, vec3 fragPosition, vec3 viewDir)
 {
@@ -142,5 +179,23 @@ void main(){
 		result += calcPointLight(pointLights[i], norm, Position, viewDirection);
 	}
 	
-	color = vec4(result, 0.0);
+	float fade = softFade();
+#ifdef WBOIT
+	// near, opaque fragments dominate the average. 1 / w is the view depth
+	float alpha = clamp(tex.a, 0.0, 1.0) * fade;
+	float viewDepth = 1.0 / gl_FragCoord.w;
+	float weight = alpha * clamp(0.03 / (1e-5 + pow(viewDepth / 200.0, 4.0)), 1e-2, 3e3);
+	accumulation = vec4(result * alpha, alpha) * weight;
+	revealage = alpha;
+#else
+	if (additive != 0)
+	{
+		// fading is darkening
+		color = vec4(result * fade, 0.0);
+	}
+	else
+	{
+		color = vec4(result, clamp(tex.a, 0.0, 1.0) * fade);
+	}
+#endif
 }
\ No newline at end of file
@@ -1,20 +1,60 @@
 #version 440
 
+#ifdef GBUFFER
+layout(location = 0) out vec4 gAlbedoAO;
+layout(location = 1) out vec2 gNormal;
+layout(location = 2) out vec2 gMaterial;
+#else
 out vec4 FragColor;
+#endif
 in vec2 TexCoords;
 in vec3 WorldPos;
 in vec3 Normal;
 
+// permutations, injected by ShaderVariants after #version:
+// HAS_NORMAL_MAP, HAS_AO_MAP, HAS_METALLIC_MAP, HAS_ROUGHNESS_MAP - material maps the mesh actually has,
+// without them the constant values below are used and the texture is never fetched.
+// MAX_POINT_LIGHTS - bucket of the longest per draw light list, makes the light loop bound a compile time constant.
+// TEXTURE_ARRAYS - maps are layers of texture arrays shared between materials, see TextureArrays.
+// GBUFFER - write the surface to the DeferredRenderer's g-buffer instead of lighting it.
+// SHADOWS - directional light shadows from the cascaded shadow map.
+
+#ifdef TEXTURE_ARRAYS
+#define MATERIAL_SAMPLER sampler2DArray
+#define SAMPLE_MAP(map, layer) texture(map, vec3(TexCoords, layer))
+#else
+#define MATERIAL_SAMPLER sampler2D
+#define SAMPLE_MAP(map, layer) texture(map, TexCoords)
+#endif
+
 struct Material 
 {
-	sampler2D m_Diffuse;
-	sampler2D m_Normal;
-	sampler2D m_Metallic;
-	sampler2D m_Roughness;
-    sampler2D m_AO;
+	MATERIAL_SAMPLER m_Diffuse;
+	MATERIAL_SAMPLER m_Normal;
+	MATERIAL_SAMPLER m_Metallic;
+	MATERIAL_SAMPLER m_Roughness;
+	MATERIAL_SAMPLER m_AO;
 	float m_Shininess;
 };
 
+// used when the mesh has no map for them, filled from the material's PropertyGroup
+layout(std140) uniform MaterialBlock
+{
+	float metallicValue;
+	float roughnessValue;
+	float aoValue;
+	// layer of each map when TEXTURE_ARRAYS is on
+	int diffuseLayer;
+	int normalLayer;
+	int aoLayer;
+	int roughnessLayer;
+	int metallicLayer;
+};
+
+#ifndef MAX_POINT_LIGHTS
+#define MAX_POINT_LIGHTS 32
+#endif
+
 struct DirLight
 {
 	vec3 direction;
@@ -27,28 +67,46 @@ struct DirLight
 struct PointLight
 {
 	vec3 position;
-	float intensity;
-
-	vec3 ambient;
 	vec3 diffuse;
-	vec3 specular;
 
 	float distance;
 };
 
-// num lights
-uniform int numPointLights = 32;
+// every point light in the scene, uploaded once a frame by LightAssignment
+struct PointLightData
+{
+	// xyz position, w range
+	vec4 positionRadius;
+	vec4 colour;
+};
+
+layout(std430, binding = 0) readonly buffer PointLightBuffer
+{
+	PointLightData pointLightData[];
+};
+
+// lights reaching this draw
+uniform int numPointLights = 0;
 
 // material parameters
 uniform Material mat;
 
 uniform DirLight dirLight;
-uniform PointLight pointLights[32];
+#if MAX_POINT_LIGHTS > 0
+// indices in to pointLightData, set per draw
+uniform int lightIndices[MAX_POINT_LIGHTS];
+#endif
 
 uniform vec3 viewPosition;
 
 const float PI = 3.14159265359;
 
+#ifdef SHADOWS
+uniform mat4 view;
+#include "shadows.glsl"
+#endif
+
+
 
 
 
@@ -61,7 +119,10 @@ const float PI = 3.14159265359;
 
 vec3 getNormalFromMap()
 {
-    vec3 tangentNormal =texture(mat.m_Normal, TexCoords).xyz * 2.0 - 1.0;
+#ifndef HAS_NORMAL_MAP
+    return normalize(Normal);
+#else
+    vec3 tangentNormal =SAMPLE_MAP(mat.m_Normal, normalLayer).xyz * 2.0 - 1.0;
 
     vec3 Q1  = dFdx(WorldPos);
     vec3 Q2  = dFdy(WorldPos);
@@ -74,6 +135,7 @@ vec3 getNormalFromMap()
     mat3 TBN = mat3(T, B, N);
 
     return normalize(TBN * tangentNormal);
+#endif
 }
 // ----------------------------------------------------------------------------
 float DistributionGGX(vec3 N, vec3 H, float roughness)
@@ -125,6 +187,9 @@ vec3 calculatePointLight(vec3 albedo, vec3 N, vec3 F0, vec3 V, float roughness,
 
     float distance = length(pl.position - WorldPos);
     float attenuation = 1.0 / (distance * distance);
+    // windowed to zero at pl.distance, so the light has a hard range lights can be culled against
+    float falloff = clamp(1.0 - pow(distance / pl.distance, 4.0), 0.0, 1.0);
+    attenuation *= falloff * falloff;
     vec3 radiance = pl.diffuse * (attenuation * pl.distance);
 
     // Cook-Torrance BRDF
@@ -190,17 +255,48 @@ vec3 calculateDirectionalLight(vec3 albedo, vec3 N, vec3 F0, vec3 V, float rough
     return (kD * diffuse / PI + specular) * radiance * NdotL;
 }
 
+#ifdef GBUFFER
+// octahedral mapping, a unit normal in two channels
+vec2 encodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.xy;
+    if (n.z < 0.0)
+        e = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return e;
+}
+#endif
+
 void main()
 {
-    vec4 rawTex = texture(mat.m_Diffuse, TexCoords);
+    vec4 rawTex = SAMPLE_MAP(mat.m_Diffuse, diffuseLayer);
     if(rawTex.a <= 0.0 && rawTex.r <= 0)
          discard;		
     vec3 albedo     = pow(rawTex.rgb, vec3(2.2));
-    float metallic  = texture(mat.m_Metallic, TexCoords).r;
-    float roughness = texture(mat.m_Roughness, TexCoords).r;
-    float ao        = texture(mat.m_AO, TexCoords).r;
+#ifdef HAS_METALLIC_MAP
+    float metallic  = SAMPLE_MAP(mat.m_Metallic, metallicLayer).r;
+#else
+    float metallic  = metallicValue;
+#endif
+#ifdef HAS_ROUGHNESS_MAP
+    float roughness = SAMPLE_MAP(mat.m_Roughness, roughnessLayer).r;
+#else
+    float roughness = roughnessValue;
+#endif
+#ifdef HAS_AO_MAP
+    float ao        = SAMPLE_MAP(mat.m_AO, aoLayer).r;
+#else
+    float ao        = aoValue;
+#endif
 
     vec3 N = getNormalFromMap();
+#ifdef GBUFFER
+    // albedo stays gamma encoded so 8 bits go further, deferred_lighting.comp linearises it
+    gAlbedoAO = vec4(rawTex.rgb, ao);
+    gNormal = encodeNormal(N);
+    gMaterial = vec2(metallic, roughness);
+    return;
+#endif
     vec3 V = normalize(viewPosition - WorldPos);
 
     // calculate reflectance at normal incidence; if dia-electric (like plastic) use F0 
@@ -211,12 +307,25 @@ void main()
     // reflectance equation
     vec3 Lo = vec3(0.0);
 
+#ifdef SHADOWS
+    Lo += calculateDirectionalLight(albedo, N, F0, V, roughness, metallic) * calculateShadow(WorldPos, normalize(Normal));
+#else
     Lo += calculateDirectionalLight(albedo, N, F0, V, roughness, metallic);
+#endif
 
-    for(int i = 0; i < numPointLights; i++) 
+#if MAX_POINT_LIGHTS > 0
+    for(int i = 0; i < MAX_POINT_LIGHTS; i++) 
     {
-         Lo += calculatePointLight(albedo, N, F0, V, roughness, metallic, pointLights[i]);  // note that we already multiplied the BRDF by the Fresnel (kS) so we won't multiply by kS again
-    }   
+        if (i >= numPointLights)
+            break;
+        PointLightData data = pointLightData[lightIndices[i]];
+        PointLight pl;
+        pl.position = data.positionRadius.xyz;
+        pl.distance = data.positionRadius.w;
+        pl.diffuse = data.colour.rgb;
+         Lo += calculatePointLight(albedo, N, F0, V, roughness, metallic, pl);  // note that we already multiplied the BRDF by the Fresnel (kS) so we won't multiply by kS again
+    }
+#endif
     
     // ambient lighting (note that the next IBL tutorial will replace 
     // this ambient lighting with environment lighting).
@@ -231,5 +340,7 @@ void main()
     // gamma correct
     color = pow(color, vec3(1.0/2.2)); 
 
+#ifndef GBUFFER
     FragColor = vec4(color, 1.0);
+#endif
 }
\ No newline at end of file
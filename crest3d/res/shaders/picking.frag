@@ -0,0 +1,13 @@
+#version 440
+
+// entity ids for editor picking, see Scene::renderPicking. the id + 1 is split in to bytes so it survives
+// being read back as RGBA8, 0 is left where nothing was drawn
+uniform int entityId;
+
+out vec4 FragColor;
+
+void main()
+{
+	uint value = uint(entityId) + 1u;
+	FragColor = vec4(uvec4(value, value >> 8, value >> 16, value >> 24) & 0xFFu) / 255.0;
+}
@@ -0,0 +1,6 @@
+#version 440
+
+// depth only, used by CascadedShadowMap
+void main()
+{
+}
@@ -0,0 +1,30 @@
+// cascaded shadow map sampling, shared by pbr.frag, anim.frag and deferred_lighting.comp. see CascadedShadowMap.
+// the includer declares uniform mat4 view, numCascades is 0 when shadows are off
+#define MAX_CASCADES 4
+layout(binding = 5) uniform sampler2DArrayShadow shadowMap;
+uniform mat4 cascadeMatrices[MAX_CASCADES];
+// view space distance each cascade ends at
+uniform vec4 cascadeSplits;
+// how far to push the receiver along its normal in each cascade, about a texel
+uniform vec4 cascadeNormalBias;
+uniform int numCascades = 0;
+
+float calculateShadow(vec3 worldPos, vec3 N)
+{
+    float depth = -(view * vec4(worldPos, 1.0)).z;
+    int c = 0;
+    while (c < numCascades && depth > cascadeSplits[c])
+        c++;
+    if (c >= numCascades)
+        return 1.0;
+
+    vec4 p = cascadeMatrices[c] * vec4(worldPos + N * cascadeNormalBias[c], 1.0);
+    vec3 coord = p.xyz / p.w * 0.5 + 0.5;
+    // 3x3 taps on top of the hardware's bilinear compare
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for (int x = -1; x <= 1; x++)
+        for (int y = -1; y <= 1; y++)
+            lit += texture(shadowMap, vec4(coord.xy + vec2(x, y) * texel, float(c), coord.z));
+    return lit / 9.0;
+}
@@ -6,6 +6,7 @@ in vec2 vTexCoords;
 uniform sampler2D screenTexture;
 uniform mat4 viewMatrix;
 uniform vec3 lightDir;
+uniform vec2 uvScale;
 const float Decay = 0.03;
 const float Density = 1.0;
 const float offset = 1.0 / 300.0;
@@ -28,7 +29,7 @@ vec4 volumetric()
     // Divide by number of samples and scale by control factor.
     deltaTexCoord *= 1.0 / NUM_SAMPLES * Density;
     // Store initial sample.
-    vec3 color = texture(screenTexture, texCoord).xyz;
+    vec3 color = texture(screenTexture, texCoord * uvScale).xyz;
     // Set up illumination decay factor.
     float illuminationDecay = 1.0;
     // Evaluate summation from Equation 3 NUM_SAMPLES iterations.
@@ -37,7 +38,7 @@ vec4 volumetric()
         // Step sample location along ray.
         texCoord -= deltaTexCoord;
         // Retrieve sample at new location.
-        vec3 sample = texture(screenTexture, texCoord).xyz;
+        vec3 sample = texture(screenTexture, texCoord * uvScale).xyz;
         // Apply sample attenuation scale/decay factors.
         sample *= illuminationDecay * ((NUM_SAMPLES / i) / NUM_SAMPLES) * Weight;
         // Accumulate combined color.